@@ -52,7 +52,38 @@ CodeGenVisitor::CodeGenVisitor(TypesMgr       & Types,
                                TreeDecoration & Decorations) :
   Types{Types},
   Symbols{Symbols},
-  Decorations{Decorations} {
+  Decorations{Decorations},
+  shortCircuit{false},
+  fusedBranches{false},
+  immediates{false},
+  blockCopy{false},
+  stringPool{false},
+  compactCalls{false},
+  program{nullptr} {
+}
+
+void CodeGenVisitor::setShortCircuit(bool enable) {
+  shortCircuit = enable;
+}
+
+void CodeGenVisitor::setFusedBranches(bool enable) {
+  fusedBranches = enable;
+}
+
+void CodeGenVisitor::setImmediates(bool enable) {
+  immediates = enable;
+}
+
+void CodeGenVisitor::setBlockCopy(bool enable) {
+  blockCopy = enable;
+}
+
+void CodeGenVisitor::setStringPool(bool enable) {
+  stringPool = enable;
+}
+
+void CodeGenVisitor::setCompactCalls(bool enable) {
+  compactCalls = enable;
 }
 
 // Methods to visit each kind of node:
@@ -60,13 +91,18 @@ CodeGenVisitor::CodeGenVisitor(TypesMgr       & Types,
 antlrcpp::Any CodeGenVisitor::visitProgram(AslParser::ProgramContext *ctx) {
   DEBUG_ENTER();
   code my_code;
+  program = &my_code;
   SymTable::ScopeId sc = getScopeDecor(ctx);
   Symbols.pushThisScope(sc);
   for (auto ctxFunc : ctx->function()) { 
     subroutine subr = visit(ctxFunc);
     my_code.add_subroutine(subr);
   }
+  // only the functions reachable from main are emitted (all of them
+  // have been type-checked anyway)
+  my_code.remove_unreachable("main");
   Symbols.popScope();
+  program = nullptr;
   DEBUG_EXIT();
   return my_code;
 }
@@ -173,31 +209,37 @@ antlrcpp::Any CodeGenVisitor::visitAssignStmt(AslParser::AssignStmtContext *ctx)
     if (not isLocal1) code = code || instruction::LOAD(tempAddr1, addr1);
     if (not isLocal2)  code = code || instruction::LOAD(tempAddr2, addr2);
 
-    std::string tempIndex  = "%"+codeCounters.newTEMP();
-    std::string tempIncrem = "%"+codeCounters.newTEMP();
-    std::string tempSize   = "%"+codeCounters.newTEMP();
-    std::string tempOffset = "%"+codeCounters.newTEMP();
-    std::string tempOffHld = "%"+codeCounters.newTEMP();
-    std::string tempCompar = "%"+codeCounters.newTEMP();
-    std::string tempValue  = "%"+codeCounters.newTEMP();
-
-    std::string labelWhile = "while"+codeCounters.newLabelWHILE();
-    std::string labelEndWhile = "end"+labelWhile;
-
-    code = code || instruction::ILOAD(tempIndex, "0");
-    code = code || instruction::ILOAD(tempIncrem, "1");
-    code = code || instruction::ILOAD(tempSize, std::to_string(Types.getArraySize(Symbols.getType(addr1))));
-    code = code || instruction::ILOAD(tempOffset, "1");
-
-    code = code || instruction::LABEL(labelWhile);
-    code = code || instruction::LT(tempCompar, tempIndex, tempSize);
-    code = code || instruction::FJUMP(tempCompar, labelEndWhile);
-    code = code || instruction::MUL(tempOffHld, tempOffset, tempIndex);
-    code = code || instruction::LOADX(tempValue, isLocal2 ? addr2 : tempAddr2, tempOffHld);
-    code = code || instruction::XLOAD(isLocal1 ? addr1 : tempAddr1, tempOffHld, tempValue);
-    code = code || instruction::ADD(tempIndex, tempIndex, tempIncrem);
-    code = code || instruction::UJUMP(labelWhile);
-    code = code || instruction::LABEL(labelEndWhile);
+    std::string size = std::to_string(Types.getArraySize(Symbols.getType(addr1)));
+    if (blockCopy)
+      code = code || instruction::COPYN(isLocal1 ? addr1 : tempAddr1,
+                                        isLocal2 ? addr2 : tempAddr2, size);
+    else {
+      std::string tempIndex  = "%"+codeCounters.newTEMP();
+      std::string tempIncrem = "%"+codeCounters.newTEMP();
+      std::string tempSize   = "%"+codeCounters.newTEMP();
+      std::string tempOffset = "%"+codeCounters.newTEMP();
+      std::string tempOffHld = "%"+codeCounters.newTEMP();
+      std::string tempCompar = "%"+codeCounters.newTEMP();
+      std::string tempValue  = "%"+codeCounters.newTEMP();
+
+      std::string labelWhile = "while"+codeCounters.newLabelWHILE();
+      std::string labelEndWhile = "end"+labelWhile;
+
+      code = code || instruction::ILOAD(tempIndex, "0");
+      code = code || instruction::ILOAD(tempIncrem, "1");
+      code = code || instruction::ILOAD(tempSize, size);
+      code = code || instruction::ILOAD(tempOffset, "1");
+
+      code = code || instruction::LABEL(labelWhile);
+      code = code || instruction::LT(tempCompar, tempIndex, tempSize);
+      code = code || instruction::FJUMP(tempCompar, labelEndWhile);
+      code = code || instruction::MUL(tempOffHld, tempOffset, tempIndex);
+      code = code || instruction::LOADX(tempValue, isLocal2 ? addr2 : tempAddr2, tempOffHld);
+      code = code || instruction::XLOAD(isLocal1 ? addr1 : tempAddr1, tempOffHld, tempValue);
+      code = code || instruction::ADD(tempIndex, tempIndex, tempIncrem);
+      code = code || instruction::UJUMP(labelWhile);
+      code = code || instruction::LABEL(labelEndWhile);
+    }
   }
 
   else if (Types.isArrayTy(t1) or Types.isArrayTy(t2)){
@@ -232,9 +274,13 @@ antlrcpp::Any CodeGenVisitor::visitAssignStmt(AslParser::AssignStmtContext *ctx)
 antlrcpp::Any CodeGenVisitor::visitIfStmt(AslParser::IfStmtContext *ctx) {
   DEBUG_ENTER();
   instructionList code;
-  CodeAttribs     && codAtsE = visit(ctx->expr());
-  std::string          addr1 = codAtsE.addr;
-  instructionList &    code1 = codAtsE.code;
+  std::string          addr1;
+  instructionList      code1;
+  if (not conditionAsJumps(ctx->expr())) {
+    CodeAttribs   && codAtsE = visit(ctx->expr());
+    addr1 = codAtsE.addr;
+    code1 = codAtsE.code;
+  }
   instructionList &&   code2 = visit(ctx->statements(0));
 
   std::string label = "if" + codeCounters.newLabelIF();
@@ -244,13 +290,13 @@ antlrcpp::Any CodeGenVisitor::visitIfStmt(AslParser::IfStmtContext *ctx) {
     instructionList &&   code3 = visit(ctx->statements(1));
     std::string labelElse = "else"+label;
 
-    code = code1 || instruction::FJUMP(addr1, labelElse) ||
+    code = codeCondition(ctx->expr(), addr1, code1, labelElse) ||
            code2 || instruction::UJUMP(labelEndIf) || instruction::LABEL(labelElse) ||
            code3 || instruction::LABEL(labelEndIf);
 
   }
   else {
-    code = code1 || instruction::FJUMP(addr1, labelEndIf) ||
+    code = codeCondition(ctx->expr(), addr1, code1, labelEndIf) ||
            code2 || instruction::LABEL(labelEndIf);
   }
 
@@ -261,13 +307,17 @@ antlrcpp::Any CodeGenVisitor::visitIfStmt(AslParser::IfStmtContext *ctx) {
 antlrcpp::Any CodeGenVisitor::visitWhileStmt(AslParser::WhileStmtContext *ctx) {
   DEBUG_ENTER();
   instructionList code;
-  CodeAttribs     && codAtsE = visit(ctx->expr());
-  std::string          addr1 = codAtsE.addr;
-  instructionList &    code1 = codAtsE.code;
+  std::string          addr1;
+  instructionList      code1;
+  if (not conditionAsJumps(ctx->expr())) {
+    CodeAttribs   && codAtsE = visit(ctx->expr());
+    addr1 = codAtsE.addr;
+    code1 = codAtsE.code;
+  }
   instructionList &&   code2 = visit(ctx->statements());
   std::string label = "while" + codeCounters.newLabelWHILE();
   std::string labelEndWhile = "end" + label;
-  code = instruction::LABEL(label) || code1 || instruction::FJUMP(addr1, labelEndWhile) ||
+  code = instruction::LABEL(label) || codeCondition(ctx->expr(), addr1, code1, labelEndWhile) ||
          code2 || instruction::UJUMP(label) || instruction::LABEL(labelEndWhile);
   DEBUG_EXIT();
   return code;
@@ -281,7 +331,8 @@ antlrcpp::Any CodeGenVisitor::visitProcCall(AslParser::ProcCallContext *ctx) {
   TypesMgr::TypeId t = getTypeDecor(ctx->ident());
 
   // devuelve parametro _result
-  if(not Types.isVoidTy(t)) code = code || instruction::PUSH();
+  bool result = not Types.isVoidFunction(t);
+  if(result) code = code || instruction::PUSH();
   // si tiene parametros
   if(ctx->expr(0)){
     auto param_types = Types.getFuncParamsTypes(t);
@@ -308,16 +359,10 @@ antlrcpp::Any CodeGenVisitor::visitProcCall(AslParser::ProcCallContext *ctx) {
       else code = code || codepar || instruction::PUSH(addrpar);
       i++;
     }
-    // call fname execute function fname.
-    code = code || instruction::CALL(name);
-    for (uint i = 0; i < (ctx->expr()).size(); ++i)
-      code = code || instruction::POP();
   }
-  // call fname execute function fname.
-  else code = code || instruction::CALL(name);
-
-  std::string temp = "%"+codeCounters.newTEMP();
-  code = code || instruction::POP(temp);
+  // call fname execute function fname. The result (unused) is popped
+  // with the parameters
+  code = code || codeCall(name, ctx->expr().size() + (result ? 1 : 0));
 
   DEBUG_EXIT();
   return code;
@@ -374,6 +419,23 @@ antlrcpp::Any CodeGenVisitor::visitWriteString(AslParser::WriteStringContext *ct
   DEBUG_ENTER();
   instructionList code;
   std::string s = ctx->STRING()->getText();
+  if (stringPool) {
+    // the escapes are decoded here, as the char constants of the
+    // code below would be: only \n and \t, and \" or \\ write a backslash
+    std::string text;
+    for (int i = 1; i < int(s.size())-1; ++i) {
+      text += s[i];
+      if (s[i] != '\\') continue;
+      if (s[i+1] == 'n') text.back() = '\n';
+      else if (s[i+1] == 't') text.back() = '\t';
+      else if (s[i+1] != '"' and s[i+1] != '\\') continue;
+      ++i;
+    }
+    if (not text.empty())
+      code = instruction::WRITES(std::to_string(program->add_string(text)));
+    DEBUG_EXIT();
+    return code;
+  }
   std::string temp = "%"+codeCounters.newTEMP();
   int i = 1;
   while (i < int(s.size())-1) {
@@ -477,6 +539,46 @@ antlrcpp::Any CodeGenVisitor::visitArray(AslParser::ArrayContext *ctx) {
 
 antlrcpp::Any CodeGenVisitor::visitArithmetic(AslParser::ArithmeticContext *ctx) {
   DEBUG_ENTER();
+  bool isFloat = Types.isFloatTy(getTypeDecor(ctx->expr(0))) or
+                 Types.isFloatTy(getTypeDecor(ctx->expr(1)));
+  // a literal operand goes as an immediate: the right one, or the
+  // left one of + and *
+  std::string literal;
+  AslParser::ExprContext *other = nullptr;
+  if (immediateOperand(ctx->expr(1), isFloat, literal)) other = ctx->expr(0);
+  else if ((ctx->PLUS() or ctx->MUL()) and immediateOperand(ctx->expr(0), isFloat, literal))
+    other = ctx->expr(1);
+  if (other) {
+    CodeAttribs     && codAt = visit(other);
+    std::string         addr = codAt.addr;
+    instructionList &   code = codAt.code;
+    std::string temp = "%"+codeCounters.newTEMP();
+    if (isFloat and Types.isIntegerTy(getTypeDecor(other))) {
+      std::string faddr = "%"+codeCounters.newTEMP();
+      code = code || instruction::FLOAT(faddr, addr);
+      addr = faddr;
+    }
+    if (not isFloat) {
+      if (ctx->MUL()) code = code || instruction::MULI(temp, addr, literal);
+      else if (ctx->DIV())  code = code || instruction::DIVI(temp, addr, literal);
+      else if (ctx->MIN())  code = code || instruction::SUBI(temp, addr, literal);
+      else if (ctx->PLUS()) code = code || instruction::ADDI(temp, addr, literal);
+      else { //ctx->MOD()
+        code = code || instruction::DIVI(temp, addr, literal)
+                    || instruction::MULI(temp, temp, literal)
+                    || instruction::SUB(temp, addr, temp);
+      }
+    }
+    else {
+      if (ctx->MUL()) code = code || instruction::FMULI(temp, addr, literal);
+      else if (ctx->DIV())  code = code || instruction::FDIVI(temp, addr, literal);
+      else if (ctx->MIN())  code = code || instruction::FSUBI(temp, addr, literal);
+      else if (ctx->PLUS()) code = code || instruction::FADDI(temp, addr, literal);
+    }
+    CodeAttribs codAts(temp, "", code);
+    DEBUG_EXIT();
+    return codAts;
+  }
   CodeAttribs     && codAt1 = visit(ctx->expr(0));
   std::string         addr1 = codAt1.addr;
   instructionList &   code1 = codAt1.code;
@@ -524,6 +626,51 @@ antlrcpp::Any CodeGenVisitor::visitArithmetic(AslParser::ArithmeticContext *ctx)
 
 antlrcpp::Any CodeGenVisitor::visitRelational(AslParser::RelationalContext *ctx) {
   DEBUG_ENTER();
+  bool isFloat = Types.isFloatTy(getTypeDecor(ctx->expr(0))) or
+                 Types.isFloatTy(getTypeDecor(ctx->expr(1)));
+  // a literal operand goes as an immediate, on the right (k < a is
+  // coded as a > k, and so on)
+  std::string literal;
+  AslParser::ExprContext *other = nullptr;
+  bool flipped = false;
+  if (immediateOperand(ctx->expr(1), isFloat, literal)) other = ctx->expr(0);
+  else if (immediateOperand(ctx->expr(0), isFloat, literal)) {
+    other = ctx->expr(1);
+    flipped = true;
+  }
+  if (other) {
+    CodeAttribs     && codAt = visit(other);
+    std::string         addr = codAt.addr;
+    instructionList &   code = codAt.code;
+    std::string temp = "%"+codeCounters.newTEMP();
+    if (isFloat and Types.isIntegerTy(getTypeDecor(other))) {
+      std::string faddr = "%"+codeCounters.newTEMP();
+      code = code || instruction::FLOAT(faddr, addr);
+      addr = faddr;
+    }
+    bool lt  = (flipped ? ctx->GT()  : ctx->LT())  != nullptr;
+    bool lte = (flipped ? ctx->GTE() : ctx->LTE()) != nullptr;
+    bool gt  = (flipped ? ctx->LT()  : ctx->GT())  != nullptr;
+    if (not isFloat) {
+      if (ctx->EQUAL()) code = code || instruction::EQI(temp, addr, literal);
+      else if (ctx->NEQ()) code = code || instruction::EQI(temp, addr, literal) || instruction::NOT(temp, temp);
+      else if (lt)  code = code || instruction::LTI(temp, addr, literal);
+      else if (lte) code = code || instruction::LEI(temp, addr, literal);
+      else if (gt)  code = code || instruction::GTI(temp, addr, literal);
+      else          code = code || instruction::GEI(temp, addr, literal);
+    }
+    else {
+      if (ctx->EQUAL()) code = code || instruction::FEQI(temp, addr, literal);
+      else if (ctx->NEQ()) code = code || instruction::FEQI(temp, addr, literal) || instruction::NOT(temp, temp);
+      else if (lt)  code = code || instruction::FLTI(temp, addr, literal);
+      else if (lte) code = code || instruction::FLEI(temp, addr, literal);
+      else if (gt)  code = code || instruction::FGTI(temp, addr, literal);
+      else          code = code || instruction::FGEI(temp, addr, literal);
+    }
+    CodeAttribs codAts(temp, "", code);
+    DEBUG_EXIT();
+    return codAts;
+  }
   CodeAttribs     && codAt1 = visit(ctx->expr(0));
   std::string         addr1 = codAt1.addr;
   instructionList &   code1 = codAt1.code;
@@ -625,7 +772,7 @@ antlrcpp::Any CodeGenVisitor::visitCallFunc(AslParser::CallFuncContext *ctx) {
   TypesMgr::TypeId t = getTypeDecor(ctx->ident());
 
   //tiene return 
-  if(not Types.isVoidTy(t)) code = code || instruction::PUSH();
+  if(not Types.isVoidFunction(t)) code = code || instruction::PUSH();
   //tiene parametros
   if(ctx->expr(0)) {
     auto param_types = Types.getFuncParamsTypes(t);
@@ -652,15 +799,9 @@ antlrcpp::Any CodeGenVisitor::visitCallFunc(AslParser::CallFuncContext *ctx) {
       else code = code || codepar || instruction::PUSH(addrpar);
       i++;
     }
-    // call fname execute function fname.
-    code = code || instruction::CALL(addr1);
-    for (uint i = 0; i < (ctx->expr()).size(); ++i)
-      code = code || instruction::POP();
-  }
-
-  else {
-    code = code || instruction::CALL(addr1);
   }
+  // call fname execute function fname.
+  code = code || codeCall(addr1, ctx->expr().size());
 
   std::string temp = "%"+codeCounters.newTEMP();
   code = code || instruction::POP(temp);
@@ -680,6 +821,16 @@ antlrcpp::Any CodeGenVisitor::visitExprIdent(AslParser::ExprIdentContext *ctx) {
 
 antlrcpp::Any CodeGenVisitor::visitLogical(AslParser::LogicalContext *ctx) {
   DEBUG_ENTER();
+  if (shortCircuit) {
+    // the value is false unless the jumps reach the end of the code
+    std::string temp = "%"+codeCounters.newTEMP();
+    std::string labelEnd = "endlogic" + codeCounters.newLabelLOGIC();
+    instructionList && code = instruction::ILOAD(temp, "0") || codeJumpFalse(ctx, labelEnd) ||
+                              instruction::ILOAD(temp, "1") || instruction::LABEL(labelEnd);
+    CodeAttribs codAts(temp, "", code);
+    DEBUG_EXIT();
+    return codAts;
+  }
   CodeAttribs     && codAt1 = visit(ctx->expr(0));
   std::string         addr1 = codAt1.addr;
   instructionList &   code1 = codAt1.code;
@@ -708,6 +859,143 @@ antlrcpp::Any CodeGenVisitor::visitIdent(AslParser::IdentContext *ctx) {
 }
 
 
+// Code for the conditions of if/while, for 'and'/'or' with short
+// circuit, and for comparisons as fused compare-and-branch:
+
+instructionList CodeGenVisitor::codeCondition(AslParser::ExprContext *ctx,
+                                              const std::string & addr,
+                                              const instructionList & code,
+                                              const std::string & labelFalse) {
+  if (conditionAsJumps(ctx)) return codeJumpFalse(ctx, labelFalse);
+  return code || instruction::FJUMP(addr, labelFalse);
+}
+
+bool CodeGenVisitor::immediateOperand(AslParser::ExprContext *ctx, bool isFloat,
+                                      std::string & literal) {
+  if (not immediates) return false;
+  AslParser::ValueContext *val = dynamic_cast<AslParser::ValueContext *>(ctx);
+  if (not val) return false;
+  if (val->INTVAL()) literal = val->getText() + (isFloat ? ".0" : "");
+  else if (val->FLOATVAL()) literal = val->getText();
+  else if (val->BOOLVAL()) literal = (val->getText() == "true") ? "1" : "0";
+  else return false;   // characters are still loaded
+  return true;
+}
+
+bool CodeGenVisitor::conditionAsJumps(AslParser::ExprContext *ctx) {
+  if (shortCircuit) return true;
+  AslParser::ParenthesisContext *par = dynamic_cast<AslParser::ParenthesisContext *>(ctx);
+  if (par) return conditionAsJumps(par->expr());
+  return fusedBranches and dynamic_cast<AslParser::RelationalContext *>(ctx);
+}
+
+instructionList CodeGenVisitor::codeJumpFalse(AslParser::ExprContext *ctx,
+                                              const std::string & label) {
+  AslParser::ParenthesisContext *par = dynamic_cast<AslParser::ParenthesisContext *>(ctx);
+  if (par) return codeJumpFalse(par->expr(), label);
+  AslParser::UnaryContext *un = dynamic_cast<AslParser::UnaryContext *>(ctx);
+  if (un and un->NOT()) return codeJumpTrue(un->expr(), label);
+  AslParser::LogicalContext *lg = dynamic_cast<AslParser::LogicalContext *>(ctx);
+  if (lg and lg->AND())
+    return codeJumpFalse(lg->expr(0), label) || codeJumpFalse(lg->expr(1), label);
+  if (lg) {
+    // a true left operand skips the right one
+    std::string labelTrue = "endor" + codeCounters.newLabelLOGIC();
+    return codeJumpTrue(lg->expr(0), labelTrue) || codeJumpFalse(lg->expr(1), label) ||
+           instruction::LABEL(labelTrue);
+  }
+  AslParser::RelationalContext *rel = dynamic_cast<AslParser::RelationalContext *>(ctx);
+  if (fusedBranches and rel) return codeCompareJump(rel, false, label);
+  CodeAttribs && codAts = visit(ctx);
+  return codAts.code || instruction::FJUMP(codAts.addr, label);
+}
+
+instructionList CodeGenVisitor::codeJumpTrue(AslParser::ExprContext *ctx,
+                                             const std::string & label) {
+  AslParser::ParenthesisContext *par = dynamic_cast<AslParser::ParenthesisContext *>(ctx);
+  if (par) return codeJumpTrue(par->expr(), label);
+  AslParser::UnaryContext *un = dynamic_cast<AslParser::UnaryContext *>(ctx);
+  if (un and un->NOT()) return codeJumpFalse(un->expr(), label);
+  AslParser::LogicalContext *lg = dynamic_cast<AslParser::LogicalContext *>(ctx);
+  if (lg and lg->OR())
+    return codeJumpTrue(lg->expr(0), label) || codeJumpTrue(lg->expr(1), label);
+  if (lg) {
+    // a false left operand skips the right one
+    std::string labelFalse = "endand" + codeCounters.newLabelLOGIC();
+    return codeJumpFalse(lg->expr(0), labelFalse) || codeJumpTrue(lg->expr(1), label) ||
+           instruction::LABEL(labelFalse);
+  }
+  AslParser::RelationalContext *rel = dynamic_cast<AslParser::RelationalContext *>(ctx);
+  bool swap;
+  if (fusedBranches and rel and compareJump(rel, true, swap) != instruction::_INVALID)
+    return codeCompareJump(rel, true, label);
+  CodeAttribs && codAts = visit(ctx);
+  std::string temp = "%"+codeCounters.newTEMP();
+  return codAts.code || instruction::NOT(temp, codAts.addr) || instruction::FJUMP(temp, label);
+}
+
+instruction::Operation CodeGenVisitor::compareJump(AslParser::RelationalContext *ctx,
+                                                   bool jumpIfTrue, bool & swap) {
+  bool isFloat = Types.isFloatTy(getTypeDecor(ctx->expr(0))) or
+                 Types.isFloatTy(getTypeDecor(ctx->expr(1)));
+  // a > b is b < a, and a >= b is b <= a
+  swap = ctx->GT() or ctx->GTE();
+  bool strict = ctx->LT() or ctx->GT();
+  if (ctx->EQUAL() or ctx->NEQ()) {
+    bool equal = (ctx->EQUAL() != nullptr) != jumpIfTrue;
+    if (isFloat) return equal ? instruction::_FJFEQ : instruction::_FJFNE;
+    return equal ? instruction::_FJEQ : instruction::_FJNE;
+  }
+  if (not jumpIfTrue) {
+    if (isFloat) return strict ? instruction::_FJFLT : instruction::_FJFLE;
+    return strict ? instruction::_FJLT : instruction::_FJLE;
+  }
+  if (isFloat) return instruction::_INVALID;
+  // jumping when a < b is not jumping when b <= a (and so on)
+  swap = not swap;
+  return strict ? instruction::_FJLE : instruction::_FJLT;
+}
+
+instructionList CodeGenVisitor::codeCompareJump(AslParser::RelationalContext *ctx,
+                                                bool jumpIfTrue, const std::string & label) {
+  CodeAttribs     && codAt1 = visit(ctx->expr(0));
+  std::string         addr1 = codAt1.addr;
+  instructionList &   code1 = codAt1.code;
+  CodeAttribs     && codAt2 = visit(ctx->expr(1));
+  std::string         addr2 = codAt2.addr;
+  instructionList &   code2 = codAt2.code;
+  instructionList &&   code = code1 || code2;
+  TypesMgr::TypeId t1 = getTypeDecor(ctx->expr(0));
+  TypesMgr::TypeId t2 = getTypeDecor(ctx->expr(1));
+  if (Types.isFloatTy(t1) and Types.isIntegerTy(t2)) {
+    std::string temp = "%"+codeCounters.newTEMP();
+    code = code || instruction::FLOAT(temp, addr2);
+    addr2 = temp;
+  }
+  else if (Types.isIntegerTy(t1) and Types.isFloatTy(t2)) {
+    std::string temp = "%"+codeCounters.newTEMP();
+    code = code || instruction::FLOAT(temp, addr1);
+    addr1 = temp;
+  }
+  bool swap;
+  instruction::Operation op = compareJump(ctx, jumpIfTrue, swap);
+  if (swap) std::swap(addr1, addr2);
+  return code || instruction(op, addr1, addr2, label);
+}
+
+
+// Code of a call: the cells of the parameters are popped by the call
+// itself ("call f k") with compact calls, one by one otherwise
+
+instructionList CodeGenVisitor::codeCall(const std::string & name, std::size_t cells) {
+  if (compactCalls and cells > 0) return instruction::CALL(name, std::to_string(cells));
+  instructionList code = instruction::CALL(name);
+  for (std::size_t i = 0; i < cells; ++i)
+    code = code || instruction::POP();
+  return code;
+}
+
+
 // Getters for the necessary tree node atributes:
 //   Scope and Type
 SymTable::ScopeId CodeGenVisitor::getScopeDecor(antlr4::ParserRuleContext *ctx) const {
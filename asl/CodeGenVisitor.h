@@ -62,6 +62,28 @@ public:
 		 SymTable       & Symbols,
 		 TreeDecoration & Decorations);
 
+  // Evaluate 'and'/'or' with short circuit (off by default): the right
+  // operand is not evaluated (nor its calls made) when the left one
+  // decides the result
+  void setShortCircuit(bool enable);
+  // Jump on the comparisons of if/while conditions with the fused
+  // compare-and-branch instructions (off by default: tvm does not
+  // run them, ctvm does)
+  void setFusedBranches(bool enable);
+  // Give literal operands of arithmetic and relational operations as
+  // immediates (off by default: tvm does not run them, ctvm does)
+  void setImmediates(bool enable);
+  // Copy whole arrays in assignments with a single block copy (off by
+  // default: tvm does not run it, ctvm does)
+  void setBlockCopy(bool enable);
+  // Write string literals with a single instruction, from the string
+  // constants of the program (off by default: tvm does not run it,
+  // ctvm does)
+  void setStringPool(bool enable);
+  // Pop the parameters of a call with the call itself, "call f k"
+  // (off by default: tvm does not run it, ctvm does)
+  void setCompactCalls(bool enable);
+
   // Methods to visit each kind of node:
   antlrcpp::Any visitProgram(AslParser::ProgramContext *ctx);
   antlrcpp::Any visitFunction(AslParser::FunctionContext *ctx);
@@ -99,12 +121,48 @@ private:
   SymTable        & Symbols;
   TreeDecoration  & Decorations;
   counters          codeCounters;
+  bool              shortCircuit;
+  bool              fusedBranches;
+  bool              immediates;
+  bool              blockCopy;
+  bool              stringPool;
+  bool              compactCalls;
+  // program being generated (for its string constants)
+  code            * program;
 
   // Getters for the necessary tree node atributes:
   //   Scope and Type
   SymTable::ScopeId getScopeDecor (antlr4::ParserRuleContext *ctx) const;
   TypesMgr::TypeId  getTypeDecor  (antlr4::ParserRuleContext *ctx) const;
 
+  // Code of the condition of an if/while: go on if it is true, jump to
+  // 'labelFalse' otherwise. Without short circuit, 'addr' and 'code'
+  // are the condition already evaluated as a value
+  instructionList codeCondition(AslParser::ExprContext *ctx,
+                                const std::string & addr,
+                                const instructionList & code,
+                                const std::string & labelFalse);
+  // Code of a boolean expression with short circuit, as jumps: to
+  // 'label' when it is false (or true), going on otherwise
+  instructionList codeJumpFalse(AslParser::ExprContext *ctx, const std::string & label);
+  instructionList codeJumpTrue (AslParser::ExprContext *ctx, const std::string & label);
+  // Whether an operand is a literal that can go as the immediate of
+  // an arithmetic or relational instruction, and its text
+  bool immediateOperand(AslParser::ExprContext *ctx, bool isFloat, std::string & literal);
+  // Whether the condition of an if/while is coded as jumps (not
+  // evaluated as a value first)
+  bool conditionAsJumps(AslParser::ExprContext *ctx);
+  // Fused compare-and-branch jumping when a comparison is false (or
+  // true), and whether its operands go swapped; _INVALID if there is
+  // none (a float < is not the opposite of >=, because of NaN)
+  instruction::Operation compareJump(AslParser::RelationalContext *ctx,
+                                     bool jumpIfTrue, bool & swap);
+  instructionList codeCompareJump(AslParser::RelationalContext *ctx,
+                                  bool jumpIfTrue, const std::string & label);
+  // Call to function 'name', popping 'cells' cells (the parameters)
+  // after it returns
+  instructionList codeCall(const std::string & name, std::size_t cells);
+
 
   //////////////////////////////////////////////////////////////////
   // Class CodeAttribs: is declared inside CodeGenVisitor as an
@@ -60,3 +60,51 @@ for f in ../examples/jp_genc_*.asl; do
     rm -f tmp.t tmp.out
 done
 echo "END   examples-full/execution"
+
+echo ""
+echo "BEGIN examples-initial/execution-c"
+for f in ../examples/jpbasic_genc_*.asl; do
+    echo $(basename "$f")
+    ./asl --emit=c "$f" > tmp.c
+    gcc -std=c99 -O2 -o tmp.exe tmp.c
+    ./tmp.exe < "${f/asl/in}" > tmp.out
+    diff tmp.out "${f/asl/out}"
+    rm -f tmp.c tmp.exe tmp.out
+done
+echo "END   examples-initial/execution-c"
+
+echo ""
+echo "BEGIN examples-full/execution-c"
+for f in ../examples/jp_genc_*.asl; do
+    echo $(basename "$f")
+    ./asl --emit=c "$f" > tmp.c
+    gcc -std=c99 -O2 -o tmp.exe tmp.c
+    ./tmp.exe < "${f/asl/in}" > tmp.out
+    diff tmp.out "${f/asl/out}"
+    rm -f tmp.c tmp.exe tmp.out
+done
+echo "END   examples-full/execution-c"
+
+echo ""
+echo "BEGIN examples-initial/execution-asm"
+for f in ../examples/jpbasic_genc_*.asl; do
+    echo $(basename "$f")
+    ./asl --emit=asm "$f" > tmp.s
+    as -o tmp.o tmp.s && ld -o tmp.exe tmp.o
+    ./tmp.exe < "${f/asl/in}" > tmp.out
+    diff tmp.out "${f/asl/out}"
+    rm -f tmp.s tmp.o tmp.exe tmp.out
+done
+echo "END   examples-initial/execution-asm"
+
+echo ""
+echo "BEGIN examples-full/execution-asm"
+for f in ../examples/jp_genc_*.asl; do
+    echo $(basename "$f")
+    ./asl --emit=asm "$f" > tmp.s
+    as -o tmp.o tmp.s && ld -o tmp.exe tmp.o
+    ./tmp.exe < "${f/asl/in}" > tmp.out
+    diff tmp.out "${f/asl/out}"
+    rm -f tmp.s tmp.o tmp.exe tmp.out
+done
+echo "END   examples-full/execution-asm"
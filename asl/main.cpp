@@ -41,10 +41,16 @@
 #include "SymbolsVisitor.h"
 #include "TypeCheckVisitor.h"
 #include "../common/code.h"
+#include "../common/codeBinary.h"
+#include "../common/codeC.h"
+#include "../common/codeAsm.h"
+#include "../common/passManager.h"
 #include "CodeGenVisitor.h"
 
 #include <iostream>
-#include <fstream>    // ifstream
+#include <fstream>    // ifstream, ofstream
+#include <string>
+#include <vector>
 
 #include <cstdio>     // fopen
 #include <cstdlib>    // EXIT_FAILURE, EXIT_SUCCESS
@@ -53,22 +59,55 @@
 // using namespace antlr4;
 
 
+// size of the buffer used to write the generated code into a file
+static const std::size_t OUTPUT_BUFFER_SIZE = 1 << 20;
+
+
 int main(int argc, const char* argv[]) {
+  // all output goes through iostreams: no need to keep them in sync with stdio
+  std::ios::sync_with_stdio(false);
+
   // check the correct use of the program
-  if (argc > 2) {
-    std::cout << "Usage: ./main [<file>]" << std::endl;
-    return EXIT_FAILURE;
+  const char *inFile  = nullptr;
+  const char *outFile = nullptr;
+  std::string emit    = "t";     // output format: t-code text or binary, C or asm
+  bool shortCircuit   = false;   // evaluate and/or with short circuit
+  bool fusedBranches  = false;   // compare-and-branch instructions (ctvm only)
+  bool immediates     = false;   // immediate-operand instructions (ctvm only)
+  bool blockCopy      = false;   // block copy of whole arrays (ctvm only)
+  bool stringPool     = false;   // string constants written at once (ctvm only)
+  bool compactCalls   = false;   // params popped by the call (ctvm only)
+  passManager optimizer = passManager::standard();   // -O0 by default
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-o" and i+1 < argc) outFile = argv[++i];
+    else if (arg == "--emit=t" or arg == "--emit=bin" or arg == "--emit=c" or
+             arg == "--emit=asm") emit = arg.substr(7);
+    else if (arg == "--short-circuit") shortCircuit = true;
+    else if (arg == "--fused-branches") fusedBranches = true;
+    else if (arg == "--immediates") immediates = true;
+    else if (arg == "--block-copy") blockCopy = true;
+    else if (arg == "--string-pool") stringPool = true;
+    else if (arg == "--compact-calls") compactCalls = true;
+    else if (optimizer.parse_option(arg)) continue;
+    else if (not inFile and arg[0] != '-') inFile = argv[i];
+    else {
+      std::cout << "Usage: ./main [--emit=t|bin|c|asm] [-o <outfile>] [--short-circuit] [--fused-branches] [--immediates] "
+                << "[--block-copy] [--string-pool] [--compact-calls] "
+                << passManager::usage() << " [<file>]" << std::endl;
+      return EXIT_FAILURE;
+    }
   }
-  if (argc == 2 and not std::fopen(argv[1], "r")) {
-    std::cout << "No such file: " << argv[1] << std::endl;
+  if (inFile and not std::fopen(inFile, "r")) {
+    std::cout << "No such file: " << inFile << std::endl;
     return EXIT_FAILURE;
   }
 
   // open input file (or std::cin) and create a character stream
   antlr4::ANTLRInputStream input;
-  if (argc == 2) {  // read from <file>
+  if (inFile) {     // read from <file>
     std::ifstream stream;
-    stream.open(argv[1]);
+    stream.open(inFile);
     input = antlr4::ANTLRInputStream(stream);
   }
   else {            // read fron std::cin
@@ -120,10 +159,44 @@ int main(int argc, const char* argv[]) {
   // create a third visitor that will return the generated code
   // for each part of the tree, and will store it in 'mycode'
   CodeGenVisitor codegenerator(types, symbols, decorations);
+  codegenerator.setShortCircuit(shortCircuit);
+  codegenerator.setFusedBranches(fusedBranches);
+  codegenerator.setImmediates(immediates);
+  codegenerator.setBlockCopy(blockCopy);
+  codegenerator.setStringPool(stringPool);
+  codegenerator.setCompactCalls(compactCalls);
   code mycode = codegenerator.visit(tree);
 
-  // print generated code as output
-  std::cout << mycode.dump() << std::endl;
+  // run the optimization passes enabled by -O<n> (none at -O0, so the
+  // code is emitted exactly as generated), reporting into std::cerr
+  optimizer.run(mycode, std::cerr);
+
+  // print generated code as output, either as t-code text (streamed
+  // subroutine by subroutine), in binary format (see codeBinary.h), or
+  // translated to C99 (see codeC.h) or to x86-64 assembly (see
+  // codeAsm.h), into <outfile> through a large buffer, if given
+  std::vector<char> outBuffer;
+  std::ofstream     outStream;
+  if (outFile) {
+    outBuffer.resize(OUTPUT_BUFFER_SIZE);
+    outStream.rdbuf()->pubsetbuf(outBuffer.data(), outBuffer.size());
+    outStream.open(outFile, std::ios::binary);
+    if (not outStream) {
+      std::cout << "Cannot write file: " << outFile << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  std::ostream & out = outFile ? outStream : std::cout;
+  if (emit == "bin")
+    binaryCode::write(mycode, out);
+  else if (emit == "c")
+    cCode::write(mycode, out);
+  else if (emit == "asm")
+    asmCode::write(mycode, out);
+  else {
+    mycode.dump(out);
+    out << std::endl;
+  }
 
   return EXIT_SUCCESS;
 }
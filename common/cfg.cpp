@@ -0,0 +1,328 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+
+#include <algorithm>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+
+#include "cfg.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////
+/// Class cfg
+
+const unsigned cfg::NONE;
+
+cfg::cfg(const subroutine &s) : cfg(s.get_instructions()) {}
+
+cfg::cfg(const vector<instruction> &insts) : insts(insts) {
+  build_blocks();
+  build_edges();
+  build_rpo();
+  build_dominators();
+  build_loops();
+}
+
+/// true if the instruction ends a basic block
+static bool ends_block(const instruction &inst) {
+  return inst.is_jump() or inst.oper == instruction::_RETURN;
+}
+
+/// split the instructions into basic blocks
+void cfg::build_blocks() {
+  size_t n = insts.size();
+  blockOf.assign(n, 0);
+  for (size_t pc = 0; pc < n; ++pc) {
+    bool leader = pc == 0 or ends_block(insts[pc-1]) or
+                  (insts[pc].oper == instruction::_LABEL and
+                   insts[pc-1].oper != instruction::_LABEL);
+    if (leader) {
+      if (not blocks.empty()) blocks.back().end = pc;
+      block b;
+      b.first = b.end = pc;
+      b.succBegin = b.succEnd = b.predBegin = b.predEnd = 0;
+      b.idom = b.rpo = b.loop = NONE;
+      b.depth = 0;
+      blocks.push_back(b);
+    }
+    blockOf[pc] = blocks.size() - 1;
+  }
+  if (not blocks.empty()) blocks.back().end = n;
+}
+
+/// successors from the last instruction of each block, then the
+/// predecessors as the reverse edges
+void cfg::build_edges() {
+  unordered_map<uint32_t, unsigned> labelBlock;
+  for (size_t pc = 0; pc < insts.size(); ++pc)
+    if (insts[pc].oper == instruction::_LABEL)
+      labelBlock[insts[pc].arg1.handle()] = blockOf[pc];
+  auto target = [&](const operand &lab) {
+    auto it = labelBlock.find(lab.handle());
+    return it == labelBlock.end() ? NONE : it->second;
+  };
+
+  unsigned nb = blocks.size();
+  for (unsigned b = 0; b < nb; ++b) {
+    const instruction &last = insts[blocks[b].end - 1];
+    unsigned next = b + 1 < nb ? b + 1 : NONE;
+    unsigned s1 = NONE, s2 = NONE;
+    if (last.oper == instruction::_UJUMP) s1 = target(last.arg1);
+    else if (last.is_conditional_jump()) {
+      s1 = next;
+      s2 = target(last.jump_label());
+      if (s2 == s1) s2 = NONE;
+    }
+    else if (last.oper != instruction::_RETURN) s1 = next;
+    blocks[b].succBegin = succs.size();
+    if (s1 != NONE) succs.push_back(s1);
+    if (s2 != NONE) succs.push_back(s2);
+    blocks[b].succEnd = succs.size();
+  }
+
+  // predecessors, grouped by block in increasing order of source
+  vector<unsigned> count(nb + 1, 0);
+  for (unsigned s : succs) ++count[s + 1];
+  for (unsigned b = 0; b < nb; ++b) count[b + 1] += count[b];
+  preds.resize(succs.size());
+  for (unsigned b = 0; b < nb; ++b) {
+    blocks[b].predBegin = blocks[b].predEnd = count[b];
+  }
+  for (unsigned b = 0; b < nb; ++b)
+    for (unsigned s : successors(b)) preds[blocks[s].predEnd++] = b;
+}
+
+/// depth-first search from the entry, with an explicit stack
+void cfg::build_rpo() {
+  if (blocks.empty()) return;
+  vector<unsigned> post;
+  vector<bool> visited(blocks.size(), false);
+  vector<pair<unsigned, unsigned>> stack;   // block, next successor
+  stack.push_back(make_pair(0u, blocks[0].succBegin));
+  visited[0] = true;
+  while (not stack.empty()) {
+    unsigned b = stack.back().first;
+    unsigned &next = stack.back().second;
+    if (next < blocks[b].succEnd) {
+      unsigned s = succs[next++];
+      if (not visited[s]) {
+        visited[s] = true;
+        stack.push_back(make_pair(s, blocks[s].succBegin));
+      }
+    }
+    else {
+      post.push_back(b);
+      stack.pop_back();
+    }
+  }
+  rpo.assign(post.rbegin(), post.rend());
+  for (unsigned i = 0; i < rpo.size(); ++i) blocks[rpo[i]].rpo = i;
+}
+
+/// immediate dominators, with the iterative algorithm of Cooper,
+/// Harvey and Kennedy over the reverse postorder, and the dominator
+/// tree with a preorder numbering of its subtrees
+void cfg::build_dominators() {
+  if (rpo.empty()) return;
+  unsigned entry = rpo[0];
+  blocks[entry].idom = entry;
+  auto intersect = [&](unsigned a, unsigned b) {
+    while (a != b) {
+      while (blocks[a].rpo > blocks[b].rpo) a = blocks[a].idom;
+      while (blocks[b].rpo > blocks[a].rpo) b = blocks[b].idom;
+    }
+    return a;
+  };
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (unsigned i = 1; i < rpo.size(); ++i) {
+      unsigned b = rpo[i], d = NONE;
+      for (unsigned p : predecessors(b)) {
+        if (blocks[p].idom == NONE) continue;
+        d = d == NONE ? p : intersect(p, d);
+      }
+      if (d != blocks[b].idom) {
+        blocks[b].idom = d;
+        changed = true;
+      }
+    }
+  }
+  blocks[entry].idom = NONE;
+
+  // children in the dominator tree, grouped by block
+  unsigned nb = blocks.size();
+  domChildrenBegin.assign(nb + 1, 0);
+  for (unsigned b : rpo)
+    if (blocks[b].idom != NONE) ++domChildrenBegin[blocks[b].idom + 1];
+  for (unsigned b = 0; b < nb; ++b) domChildrenBegin[b + 1] += domChildrenBegin[b];
+  domChildren.resize(domChildrenBegin[nb]);
+  vector<unsigned> fill(domChildrenBegin.begin(), domChildrenBegin.end() - 1);
+  for (unsigned b : rpo)
+    if (blocks[b].idom != NONE) domChildren[fill[blocks[b].idom]++] = b;
+
+  // preorder interval of each subtree
+  domPre.assign(nb, NONE);
+  domPost.assign(nb, NONE);
+  unsigned counter = 0;
+  vector<pair<unsigned, unsigned>> stack;   // block, next child
+  stack.push_back(make_pair(entry, domChildrenBegin[entry]));
+  domPre[entry] = counter++;
+  while (not stack.empty()) {
+    unsigned b = stack.back().first;
+    unsigned &next = stack.back().second;
+    if (next < domChildrenBegin[b + 1]) {
+      unsigned c = domChildren[next++];
+      domPre[c] = counter++;
+      stack.push_back(make_pair(c, domChildrenBegin[c]));
+    }
+    else {
+      domPost[b] = counter - 1;
+      stack.pop_back();
+    }
+  }
+}
+
+/// natural loops: a back edge goes to a block that dominates its
+/// source; the loop holds the header and every block that reaches a
+/// source of a back edge to it without going through the header
+void cfg::build_loops() {
+  vector<pair<unsigned, vector<unsigned>>> found;   // header, blocks
+  vector<unsigned> mark(blocks.size(), NONE);
+  for (unsigned h : rpo) {
+    vector<unsigned> work;
+    for (unsigned p : predecessors(h))
+      if (dominates(h, p)) work.push_back(p);
+    if (work.empty()) continue;
+    unsigned id = found.size();
+    found.push_back(make_pair(h, vector<unsigned>(1, h)));
+    vector<unsigned> &body = found.back().second;
+    mark[h] = id;
+    while (not work.empty()) {
+      unsigned b = work.back();
+      work.pop_back();
+      if (mark[b] == id) continue;
+      mark[b] = id;
+      body.push_back(b);
+      for (unsigned p : predecessors(b))
+        if (is_reachable(p) and mark[p] != id) work.push_back(p);
+    }
+    sort(body.begin(), body.end());
+  }
+
+  // outer loops (larger) first, so that each loop comes after the
+  // loops containing it, and the innermost loop of a block is the
+  // last one that includes it
+  stable_sort(found.begin(), found.end(),
+              [](const pair<unsigned, vector<unsigned>> &a,
+                 const pair<unsigned, vector<unsigned>> &b) {
+                return a.second.size() > b.second.size();
+              });
+  for (const auto &f : found) {
+    loop l;
+    l.header = f.first;
+    l.parent = blocks[f.first].loop;
+    l.depth = l.parent == NONE ? 1 : loops[l.parent].depth + 1;
+    l.blocksBegin = loopBlocks.size();
+    for (unsigned b : f.second) {
+      loopBlocks.push_back(b);
+      blocks[b].loop = loops.size();
+      blocks[b].depth = l.depth;
+    }
+    l.blocksEnd = loopBlocks.size();
+    loops.push_back(l);
+  }
+}
+
+/// number of blocks, and each of them
+unsigned cfg::num_blocks() const { return blocks.size(); }
+const cfg::block & cfg::get_block(unsigned b) const { return blocks[b]; }
+/// block containing the instruction at 'pc'
+unsigned cfg::block_of(size_t pc) const { return blockOf[pc]; }
+
+/// edges of a block
+cfg::range cfg::successors(unsigned b) const {
+  return range(succs.data() + blocks[b].succBegin, succs.data() + blocks[b].succEnd);
+}
+cfg::range cfg::predecessors(unsigned b) const {
+  return range(preds.data() + blocks[b].predBegin, preds.data() + blocks[b].predEnd);
+}
+
+/// blocks reachable from the entry, in reverse postorder
+cfg::range cfg::reverse_postorder() const { return range(rpo.data(), rpo.data() + rpo.size()); }
+bool cfg::is_reachable(unsigned b) const { return blocks[b].rpo != NONE; }
+
+/// dominators
+unsigned cfg::idom(unsigned b) const { return blocks[b].idom; }
+bool cfg::dominates(unsigned a, unsigned b) const {
+  if (not is_reachable(a) or not is_reachable(b)) return false;
+  return domPre[a] <= domPre[b] and domPre[b] <= domPost[a];
+}
+cfg::range cfg::dominated(unsigned b) const {
+  if (domChildrenBegin.empty()) return range(nullptr, nullptr);
+  return range(domChildren.data() + domChildrenBegin[b],
+               domChildren.data() + domChildrenBegin[b + 1]);
+}
+
+/// natural loops
+unsigned cfg::num_loops() const { return loops.size(); }
+const cfg::loop & cfg::get_loop(unsigned l) const { return loops[l]; }
+cfg::range cfg::loop_blocks(unsigned l) const {
+  return range(loopBlocks.data() + loops[l].blocksBegin, loopBlocks.data() + loops[l].blocksEnd);
+}
+bool cfg::in_loop(unsigned b, unsigned l) const {
+  for (unsigned k = blocks[b].loop; k != NONE; k = loops[k].parent)
+    if (k == l) return true;
+  return false;
+}
+
+/// print the graph (for debugging)
+string cfg::dump() const {
+  auto name = [](unsigned b) { return b == NONE ? string("-") : "B" + to_string(b); };
+  ostringstream os;
+  for (unsigned b = 0; b < blocks.size(); ++b) {
+    os << name(b) << " [" << blocks[b].first << "," << blocks[b].end << ")";
+    os << " succ:";
+    for (unsigned s : successors(b)) os << " " << name(s);
+    os << " pred:";
+    for (unsigned p : predecessors(b)) os << " " << name(p);
+    os << " idom: " << name(blocks[b].idom);
+    os << " loop: " << (blocks[b].loop == NONE ? string("-") : "L" + to_string(blocks[b].loop));
+    if (not is_reachable(b)) os << " (unreachable)";
+    os << endl;
+  }
+  for (unsigned l = 0; l < loops.size(); ++l) {
+    os << "L" << l << " header: " << name(loops[l].header) << " blocks:";
+    for (unsigned b : loop_blocks(l)) os << " " << name(b);
+    os << " depth: " << loops[l].depth << endl;
+  }
+  return os.str();
+}
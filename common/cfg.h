@@ -0,0 +1,148 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "code.h"
+
+////////////////////////////////////////////////////////////////////
+/// Class cfg is the control-flow graph of a subroutine.
+/// A basic block is a maximal run of instructions entered only at its
+/// first one and left only at its last one: blocks start at the first
+/// instruction, at each label (consecutive labels share a block) and
+/// after each 'goto', 'ifFalse' and 'return'.
+/// Everything is kept in contiguous arrays indexed by block number:
+/// the blocks themselves, their edges (successors and predecessors,
+/// stored consecutively for each block), the dominator tree and the
+/// natural loops. Block 0 is the entry.
+/// The graph refers to the instructions it was built from, so it must
+/// be rebuilt when they change.
+
+class cfg {
+public:
+  /// "no block" / "no loop"
+  static const unsigned NONE = UINT32_MAX;
+
+  /// a contiguous range of block (or loop) numbers
+  class range {
+  public:
+    range(const unsigned *b, const unsigned *e) : b(b), e(e) {}
+    const unsigned *begin() const { return b; }
+    const unsigned *end() const { return e; }
+    std::size_t size() const { return e - b; }
+    bool empty() const { return b == e; }
+  private:
+    const unsigned *b, *e;
+  };
+
+  /// a basic block: instructions [first, end) of the subroutine
+  class block {
+  public:
+    std::size_t first, end;
+    /// position of its successors/predecessors in the edge arrays
+    unsigned succBegin, succEnd, predBegin, predEnd;
+    /// immediate dominator (NONE for the entry and unreachable blocks)
+    unsigned idom;
+    /// position in reverse postorder (NONE if unreachable)
+    unsigned rpo;
+    /// innermost loop containing the block (NONE if none), and the
+    /// number of loops containing it
+    unsigned loop, depth;
+  };
+
+  /// a natural loop: all the blocks of the back edges to a header
+  class loop {
+  public:
+    unsigned header;
+    /// position of its blocks (in increasing order) in the loop array
+    unsigned blocksBegin, blocksEnd;
+    /// innermost loop containing this one (NONE if none), and depth (1
+    /// for outermost loops)
+    unsigned parent, depth;
+  };
+
+  /// build the graph of a subroutine (or of a sequence of instructions)
+  explicit cfg(const subroutine &s);
+  explicit cfg(const std::vector<instruction> &insts);
+
+  /// number of blocks, and each of them
+  unsigned num_blocks() const;
+  const block & get_block(unsigned b) const;
+  /// block containing the instruction at 'pc'
+  unsigned block_of(std::size_t pc) const;
+  /// edges of a block
+  range successors(unsigned b) const;
+  range predecessors(unsigned b) const;
+
+  /// blocks reachable from the entry, in reverse postorder
+  range reverse_postorder() const;
+  bool is_reachable(unsigned b) const;
+
+  /// immediate dominator of a block, and dominance test (a block
+  /// dominates itself; unreachable blocks dominate nothing)
+  unsigned idom(unsigned b) const;
+  bool dominates(unsigned a, unsigned b) const;
+  /// children of a block in the dominator tree
+  range dominated(unsigned b) const;
+
+  /// natural loops, outer loops before the loops they contain
+  unsigned num_loops() const;
+  const loop & get_loop(unsigned l) const;
+  range loop_blocks(unsigned l) const;
+  /// whether block 'b' belongs to loop 'l'
+  bool in_loop(unsigned b, unsigned l) const;
+
+  /// print the graph (for debugging)
+  std::string dump() const;
+
+private:
+  const std::vector<instruction> &insts;
+  std::vector<block> blocks;
+  std::vector<unsigned> blockOf;
+  /// edges, grouped by block
+  std::vector<unsigned> succs, preds;
+  std::vector<unsigned> rpo;
+  /// dominator tree: children grouped by block, and the preorder
+  /// interval of each subtree (for constant-time dominance tests)
+  std::vector<unsigned> domChildren, domChildrenBegin;
+  std::vector<unsigned> domPre, domPost;
+  std::vector<loop> loops;
+  std::vector<unsigned> loopBlocks;
+
+  void build_blocks();
+  void build_edges();
+  void build_rpo();
+  void build_dominators();
+  void build_loops();
+};
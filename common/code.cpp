@@ -27,13 +27,79 @@
 ////////////////////////////////////////////////////////////////
 
 #include <iostream>
+#include <sstream>
+#include <type_traits>
 #include "code.h"
 
 using namespace std;
 
+////////////////////////////////////////////////////////////////////
+/// Implementation for class 'operand'
+
+vector<string> operand::symbols;
+unordered_map<string, uint32_t> operand::symbolIndex;
+
+static const uint32_t KIND_SHIFT = 30;
+static const uint32_t PAYLOAD_MASK = (uint32_t(1) << KIND_SHIFT) - 1;
+static const int MAX_INLINE_INT = (1 << (KIND_SHIFT-1)) - 1;
+
+/// check whether s is the canonical text of a (small) non-negative
+/// integer, so that it can be stored inline and printed back as is
+static bool inline_number(const string &s, size_t from, int &value) {
+  if (s.size() <= from or s.size() - from > 9) return false;
+  if (s[from] == '0' and s.size() - from > 1) return false;
+  value = 0;
+  for (size_t i = from; i < s.size(); ++i) {
+    if (s[i] < '0' or s[i] > '9') return false;
+    value = value*10 + (s[i]-'0');
+  }
+  return value <= MAX_INLINE_INT;
+}
+
+/// constructors
+operand::operand() : h(0) {}
+operand::operand(Kind k, uint32_t payload) : h((uint32_t(k) << KIND_SHIFT) | (payload & PAYLOAD_MASK)) {}
+operand::operand(const std::string &s) {
+  int n;
+  if (s.empty()) h = 0;
+  else if (s[0] == '%' and inline_number(s, 1, n)) *this = operand(_TEMP, n);
+  else if (inline_number(s, 0, n)) *this = operand(_INTEGER, n);
+  else {
+    auto it = symbolIndex.find(s);
+    if (it == symbolIndex.end()) {
+      it = symbolIndex.insert(make_pair(s, uint32_t(symbols.size()))).first;
+      symbols.push_back(s);
+    }
+    *this = operand(_SYMBOL, it->second);
+  }
+}
+
+operand::Kind operand::kind() const { return Kind(h >> KIND_SHIFT); }
+bool operand::empty() const { return kind() == _NONE; }
+bool operand::is_temp() const { return kind() == _TEMP; }
+unsigned operand::temp_number() const { return h & PAYLOAD_MASK; }
+int operand::int_value() const { return h & PAYLOAD_MASK; }
+uint32_t operand::handle() const { return h; }
+
+string operand::str() const {
+  switch (kind()) {
+  case _SYMBOL : return symbols[h & PAYLOAD_MASK];
+  case _TEMP : return "%" + std::to_string(h & PAYLOAD_MASK);
+  case _INTEGER : return std::to_string(h & PAYLOAD_MASK);
+  default : return "";
+  }
+}
+
+bool operand::operator==(const operand &op) const { return h == op.h; }
+bool operand::operator!=(const operand &op) const { return h != op.h; }
+
+
 ////////////////////////////////////////////////////////////////////
 /// Implementation for class 'instruction'
 
+static_assert(std::is_trivially_copyable<instruction>::value,
+              "instruction must stay a plain fixed-size record");
+
 /// Constructor
 instruction::instruction(Operation op,
                          const std::string &a1, const std::string &a2, const std::string &a3) {
@@ -46,9 +112,18 @@ instruction::instruction(Operation op,
 instruction instruction::LABEL(const std::string &a1) { return instruction(_LABEL, a1); }
 instruction instruction::UJUMP(const std::string &a1) { return instruction(_UJUMP, a1); }
 instruction instruction::FJUMP(const std::string &a1, const std::string &a2) { return instruction(_FJUMP, a1, a2); }
+instruction instruction::FJEQ(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_FJEQ, a1, a2, a3); }
+instruction instruction::FJNE(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_FJNE, a1, a2, a3); }
+instruction instruction::FJLT(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_FJLT, a1, a2, a3); }
+instruction instruction::FJLE(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_FJLE, a1, a2, a3); }
+instruction instruction::FJFEQ(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_FJFEQ, a1, a2, a3); }
+instruction instruction::FJFNE(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_FJFNE, a1, a2, a3); }
+instruction instruction::FJFLT(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_FJFLT, a1, a2, a3); }
+instruction instruction::FJFLE(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_FJFLE, a1, a2, a3); }
 instruction instruction::PUSH(const std::string &a1) { return instruction(_PUSH, a1); }
 instruction instruction::POP(const std::string &a1) { return instruction(_POP, a1); }
-instruction instruction::CALL(const std::string &a1) { return instruction(_CALL, a1); }
+instruction instruction::POPN(const std::string &a1) { return instruction(_POPN, a1); }
+instruction instruction::CALL(const std::string &a1, const std::string &a2) { return instruction(_CALL, a1, a2); }
 instruction instruction::RETURN() { return instruction(_RETURN); }
 instruction instruction::ADD(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_ADD, a1, a2, a3); }
 instruction instruction::SUB(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_SUB, a1, a2, a3); }
@@ -66,6 +141,24 @@ instruction instruction::FDIV(const std::string &a1, const std::string &a2, cons
 instruction instruction::FEQ(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_FEQ, a1, a2, a3); }
 instruction instruction::FLT(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_FLT, a1, a2, a3); }
 instruction instruction::FLE(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_FLE, a1, a2, a3); }
+instruction instruction::ADDI(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_ADDI, a1, a2, a3); }
+instruction instruction::SUBI(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_SUBI, a1, a2, a3); }
+instruction instruction::MULI(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_MULI, a1, a2, a3); }
+instruction instruction::DIVI(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_DIVI, a1, a2, a3); }
+instruction instruction::EQI(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_EQI, a1, a2, a3); }
+instruction instruction::LTI(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_LTI, a1, a2, a3); }
+instruction instruction::LEI(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_LEI, a1, a2, a3); }
+instruction instruction::GTI(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_GTI, a1, a2, a3); }
+instruction instruction::GEI(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_GEI, a1, a2, a3); }
+instruction instruction::FADDI(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_FADDI, a1, a2, a3); }
+instruction instruction::FSUBI(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_FSUBI, a1, a2, a3); }
+instruction instruction::FMULI(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_FMULI, a1, a2, a3); }
+instruction instruction::FDIVI(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_FDIVI, a1, a2, a3); }
+instruction instruction::FEQI(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_FEQI, a1, a2, a3); }
+instruction instruction::FLTI(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_FLTI, a1, a2, a3); }
+instruction instruction::FLEI(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_FLEI, a1, a2, a3); }
+instruction instruction::FGTI(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_FGTI, a1, a2, a3); }
+instruction instruction::FGEI(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_FGEI, a1, a2, a3); }
 instruction instruction::NOT(const std::string &a1, const std::string &a2) { return instruction(_NOT, a1, a2); }
 instruction instruction::NEG(const std::string &a1, const std::string &a2) { return instruction(_NEG, a1, a2); }
 instruction instruction::FNEG(const std::string &a1, const std::string &a2) { return instruction(_FNEG, a1, a2); }
@@ -79,6 +172,7 @@ instruction instruction::LOADX(const std::string &a1, const std::string &a2, con
 instruction instruction::ALOAD(const std::string &a1, const std::string &a2) { return instruction(_ALOAD, a1, a2); }
 instruction instruction::LOADC(const std::string &a1, const std::string &a2) { return instruction(_LOADC, a1, a2); }
 instruction instruction::CLOAD(const std::string &a1, const std::string &a2) { return instruction(_CLOAD, a1, a2); }
+instruction instruction::COPYN(const std::string &a1, const std::string &a2, const std::string &a3) { return instruction(_COPYN, a1, a2, a3); }
 instruction instruction::READI(const std::string &a1) { return instruction(_READI, a1); }
 instruction instruction::READF(const std::string &a1) { return instruction(_READF, a1); }
 instruction instruction::READC(const std::string &a1) { return instruction(_READC, a1); }
@@ -86,32 +180,70 @@ instruction instruction::WRITEI(const std::string &a1) { return instruction(_WRI
 instruction instruction::WRITEF(const std::string &a1) { return instruction(_WRITEF, a1); }
 instruction instruction::WRITEC(const std::string &a1) { return instruction(_WRITEC, a1); }
 instruction instruction::WRITELN() { return instruction(_WRITELN); }
+instruction instruction::WRITES(const std::string &a1) { return instruction(_WRITES, a1); }
 instruction instruction::NOOP() { return instruction(_NOOP); }
 
 
-/// Destructor
-instruction::~instruction() {}
+/// true for "goto", "ifFalse" and the fused compare-and-branch
+bool instruction::is_jump() const {
+  return oper == _UJUMP or is_conditional_jump();
+}
+
+/// true for "ifFalse" and the fused compare-and-branch
+bool instruction::is_conditional_jump() const {
+  return oper == _FJUMP or is_compare_jump();
+}
+
+/// true for the fused compare-and-branch
+bool instruction::is_compare_jump() const {
+  return oper >= _FJEQ and oper <= _FJFLE;
+}
+
+/// label a jump goes to
+const operand & instruction::jump_label() const {
+  return oper == _UJUMP ? arg1 : oper == _FJUMP ? arg2 : arg3;
+}
+
+operand & instruction::jump_label() {
+  return oper == _UJUMP ? arg1 : oper == _FJUMP ? arg2 : arg3;
+}
+
+/// true for the operations with an immediate a3 ("a1 = a2 + 1")
+bool instruction::is_immediate() const {
+  return oper >= _ADDI and oper <= _FGEI;
+}
 
 string instruction::dump() const {
   string s;
   string ind="   ";
+  string arg1 = this->arg1.str(), arg2 = this->arg2.str(), arg3 = this->arg3.str();
   switch (oper) {
   case instruction::_LABEL : { s = "label " + arg1 + " :"; ind = ""; break; }
   case instruction::_UJUMP : { s = "goto " + arg1; break; }
   case instruction::_FJUMP : { s = "ifFalse " + arg1 + " goto " +arg2; break; }
+  case instruction::_FJEQ : { s = "ifFalse " + arg1 + " == " + arg2 + " goto " + arg3; break; }
+  case instruction::_FJNE : { s = "ifFalse " + arg1 + " != " + arg2 + " goto " + arg3; break; }
+  case instruction::_FJLT : { s = "ifFalse " + arg1 + " < " + arg2 + " goto " + arg3; break; }
+  case instruction::_FJLE : { s = "ifFalse " + arg1 + " <= " + arg2 + " goto " + arg3; break; }
+  case instruction::_FJFEQ : { s = "ifFalse " + arg1 + " ==. " + arg2 + " goto " + arg3; break; }
+  case instruction::_FJFNE : { s = "ifFalse " + arg1 + " !=. " + arg2 + " goto " + arg3; break; }
+  case instruction::_FJFLT : { s = "ifFalse " + arg1 + " <. " + arg2 + " goto " + arg3; break; }
+  case instruction::_FJFLE : { s = "ifFalse " + arg1 + " <=. " + arg2 + " goto " + arg3; break; }
   case instruction::_LOAD : 
   case instruction::_FLOAD : 
   case instruction::_ILOAD : { s = arg1 + " = " + arg2; break; } 
   case instruction::_CHLOAD : { s = arg1 + " = '" + arg2 +"'"; break; } 
   case instruction::_PUSH : { s = "pushparam " + (arg1.empty()? "" : arg1); break; }
   case instruction::_POP : { s = "popparam " + (arg1.empty()? "" : arg1); break; }
-  case instruction::_CALL : { s = "call " + arg1; break; }
+  case instruction::_POPN : { s = "popn " + arg1; break; }
+  case instruction::_CALL : { s = "call " + arg1 + (arg2.empty()? "" : " " + arg2); break; }
   case instruction::_RETURN : { s = "return"; break; }
   case instruction::_XLOAD : { s = arg1 + "[" + arg2 + "] = " + arg3; break; }
   case instruction::_LOADX : { s = arg1 + " = " + arg2 + "[" + arg3 + "]"; break; }
   case instruction::_ALOAD : { s = arg1 + " = &" + arg2; break; }
   case instruction::_LOADC : { s = arg1 + " = *" + arg2; break; }
   case instruction::_CLOAD : { s = "*" + arg1 + " = " + arg2; break; }
+  case instruction::_COPYN : { s = "copyn " + arg1 + " " + arg2 + " " + arg3; break; }
   case instruction::_READI : { s = "readi " + arg1; break; }
   case instruction::_READF : { s = "readf " + arg1; break; }
   case instruction::_READC : { s = "readc " + arg1; break; }
@@ -119,6 +251,7 @@ string instruction::dump() const {
   case instruction::_WRITEF : { s = "writef " + arg1; break; }
   case instruction::_WRITEC : { s = "writec " + arg1; break; }
   case instruction::_WRITELN : { s = "writeln"; break; }
+  case instruction::_WRITES : { s = "writes " + arg1; break; }
   case instruction::_ADD : { s = arg1 + " = " + arg2 + " + " + arg3; break; }
   case instruction::_SUB : { s = arg1 + " = " + arg2 + " - " + arg3; break; }
   case instruction::_MUL : { s = arg1 + " = " + arg2 + " * " + arg3; break; }
@@ -137,6 +270,24 @@ string instruction::dump() const {
   case instruction::_FEQ : { s = arg1 + " = " + arg2 + " ==. " + arg3; break; }
   case instruction::_FLT : { s = arg1 + " = " + arg2 + " <. " + arg3; break; }
   case instruction::_FLE : { s =  arg1 + " = " + arg2 + " <=. " + arg3; break; }
+  case instruction::_ADDI : { s = arg1 + " = " + arg2 + " + " + arg3; break; }
+  case instruction::_SUBI : { s = arg1 + " = " + arg2 + " - " + arg3; break; }
+  case instruction::_MULI : { s = arg1 + " = " + arg2 + " * " + arg3; break; }
+  case instruction::_DIVI : { s = arg1 + " = " + arg2 + " / " + arg3; break; }
+  case instruction::_EQI : { s = arg1 + " = " + arg2 + " == " + arg3; break; }
+  case instruction::_LTI : { s = arg1 + " = " + arg2 + " < " + arg3; break; }
+  case instruction::_LEI : { s = arg1 + " = " + arg2 + " <= " + arg3; break; }
+  case instruction::_GTI : { s = arg1 + " = " + arg2 + " > " + arg3; break; }
+  case instruction::_GEI : { s = arg1 + " = " + arg2 + " >= " + arg3; break; }
+  case instruction::_FADDI : { s = arg1 + " = " + arg2 + " +. " + arg3; break; }
+  case instruction::_FSUBI : { s = arg1 + " = " + arg2 + " -. " + arg3; break; }
+  case instruction::_FMULI : { s = arg1 + " = " + arg2 + " *. " + arg3; break; }
+  case instruction::_FDIVI : { s = arg1 + " = " + arg2 + " /. " + arg3; break; }
+  case instruction::_FEQI : { s = arg1 + " = " + arg2 + " ==. " + arg3; break; }
+  case instruction::_FLTI : { s = arg1 + " = " + arg2 + " <. " + arg3; break; }
+  case instruction::_FLEI : { s = arg1 + " = " + arg2 + " <=. " + arg3; break; }
+  case instruction::_FGTI : { s = arg1 + " = " + arg2 + " >. " + arg3; break; }
+  case instruction::_FGEI : { s = arg1 + " = " + arg2 + " >=. " + arg3; break; }
   case instruction::_FNEG : { s =  arg1 + " = -. " + arg2; break; }
   case instruction::_FLOAT : { s = arg1 + " = float " + arg2; break; }
   case instruction::_NOOP : { s = "noop"; break; }
@@ -157,25 +308,104 @@ instructionList instruction::operator||(const instructionList &lst) const {
 ////////////////////////////////////////////////////////////////////
 /// Implementation for class 'instructionList'
 
+/// rope node. Leaves hold a chunk of instructions, inner nodes
+/// link two sublists. Nodes are never modified once they are
+/// reachable from more than one list.
+class instructionList::node {
+public:
+  /// instructions in this chunk (leaves only)
+  std::vector<instruction> chunk;
+  /// concatenated sublists (inner nodes only)
+  std::shared_ptr<node> left, right;
+  /// total number of instructions under this node
+  std::size_t size;
+
+  node(const instruction &inst) : chunk(1, inst), size(1) {}
+  node(const std::shared_ptr<node> &l, const std::shared_ptr<node> &r) :
+    left(l), right(r), size(l->size + r->size) {}
+  ~node();
+};
+
+/// Lists built with "code = code || inst" are left-deep chains, so
+/// releasing them recursively could exhaust the C++ stack. Nodes that
+/// are only owned by this one are dismantled iteratively instead.
+instructionList::node::~node() {
+  std::vector<std::shared_ptr<node>> pending;
+  if (left) pending.push_back(std::move(left));
+  if (right) pending.push_back(std::move(right));
+  while (not pending.empty()) {
+    std::shared_ptr<node> n = std::move(pending.back());
+    pending.pop_back();
+    if (n.use_count() == 1) {
+      if (n->left) pending.push_back(std::move(n->left));
+      if (n->right) pending.push_back(std::move(n->right));
+    }
+  }
+}
+
 // constructor
 instructionList::instructionList() {}
 // constructor from a single instruction
-instructionList::instructionList(const instruction &inst) { this->push_back(inst); }
+instructionList::instructionList(const instruction &inst) : root(std::make_shared<node>(inst)) {}
 // destructor
 instructionList::~instructionList() {}
 
 // concatenation of lists (or list+instruction, via automatic coertion)
 instructionList instructionList::operator||(const instructionList &lst) const {
-  instructionList newlist = (*this);
-  newlist.insert(newlist.end(), lst.begin(), lst.end());
+  if (not lst.root) return *this;
+  if (not root) return lst;
+  instructionList newlist;
+  newlist.root = std::make_shared<node>(root, lst.root);
   return newlist;
 }
 
+// append an instruction at the end of the list
+void instructionList::push_back(const instruction &inst) {
+  *this = *this || instructionList(inst);
+}
+
+// number of instructions in the list
+std::size_t instructionList::size() const { return root ? root->size : 0; }
+// true if the list has no instructions
+bool instructionList::empty() const { return not root; }
+
+// apply f to every chunk of instructions, in order
+template <class F>
+void instructionList::for_each_chunk(F f) const {
+  vector<const node *> pending;
+  if (root) pending.push_back(root.get());
+  while (not pending.empty()) {
+    const node *n = pending.back();
+    pending.pop_back();
+    if (n->left) {
+      pending.push_back(n->right.get());
+      pending.push_back(n->left.get());
+    }
+    else f(n->chunk);
+  }
+}
+
+// sequence of instructions in the list, in order
+vector<instruction> instructionList::flatten() const {
+  vector<instruction> seq;
+  seq.reserve(size());
+  for_each_chunk([&seq](const vector<instruction> &chunk) {
+      seq.insert(seq.end(), chunk.begin(), chunk.end());
+    });
+  return seq;
+}
+
 // print instructionList (for debugging)
 string instructionList::dump() const {
-  string s;  
-  for (auto i : *this ) s += i.dump() + "\n";
-  return s;
+  ostringstream os;
+  dump(os);
+  return os.str();
+}
+// print instructionList into a stream
+void instructionList::dump(ostream &os) const {
+  for_each_chunk([&os](const vector<instruction> &chunk) {
+      for (const auto &i : chunk) os << i.dump() << '\n';
+    });
 }
 
 
@@ -215,18 +445,25 @@ void subroutine::add_var(const std::string &name, size_t sz) { vars.push_back(va
 void subroutine::add_param(const std::string &name) { params.push_back(var(name,0)); }
 /// add new instruction
 void subroutine::add_instruction(const instruction &inst) {
-  if (inst.oper == instruction::_LABEL) labels.insert(make_pair(inst.arg1,instructions.size()));
+  if (inst.oper == instruction::_LABEL) labels.insert(make_pair(inst.arg1.str(),instructions.size()));
   instructions.push_back(inst);
 }
 /// add instruction list to current instructions
 void subroutine::add_instructions(const instructionList &lins) {
-  for (auto i : lins)
+  for (auto &i : lins.flatten())
     this->add_instruction(i);
 }
 /// set instruction list (overwritting current instructions)
 void subroutine::set_instructions(const instructionList &lins) {
-  instructions.clear();
-  this->add_instructions(lins);
+  set_instructions(lins.flatten());
+}
+/// set instructions from a sequence (overwritting current instructions)
+void subroutine::set_instructions(const vector<instruction> &insts) {
+  instructions = insts;
+  labels.clear();
+  for (size_t pc = 0; pc < instructions.size(); ++pc)
+    if (instructions[pc].oper == instruction::_LABEL)
+      labels.insert(make_pair(instructions[pc].arg1.str(), pc));
 }
 /// get instruction at given program counter
 instruction subroutine::get_instruction_at(size_t pc) const {
@@ -235,26 +472,34 @@ instruction subroutine::get_instruction_at(size_t pc) const {
 }
 /// get program counter for given label
 size_t subroutine::get_label_pc(std::string &lab) const { return labels.find(lab)->second; }
+/// get all instructions
+const vector<instruction> & subroutine::get_instructions() const { return instructions; }
+/// get map label name -> program counter
+const map<string, size_t> & subroutine::get_labels() const { return labels; }
 /// print (for debugging)
 string subroutine::dump() const {
-  string s;
-  s = "function " + name + "\n";
+  ostringstream os;
+  dump(os);
+  return os.str();
+}
+/// print into a stream
+void subroutine::dump(ostream &os) const {
+  os << "function " << name << "\n";
   if (not params.empty()) {
-    s += "  params\n" ;
-    for (auto p : params) s += "    " + p.dump() + "\n";
-    s += "  endparams\n\n";
+    os << "  params\n" ;
+    for (const auto &p : params) os << "    " << p.dump() << "\n";
+    os << "  endparams\n\n";
   }
   if (not vars.empty()) {
-    s += "  vars\n";
-    for (auto v : vars) s += "    " + v.dump() + "\n";
-    s += "  endvars\n\n";
+    os << "  vars\n";
+    for (const auto &v : vars) os << "    " << v.dump() << "\n";
+    os << "  endvars\n\n";
   }
 
-  string ind = "  ";
+  const char *ind = "  ";
   if (labels.empty()) ind="";
-  for (auto i : instructions) s += ind + i.dump() + "\n";  
-  s += "endfunction\n\n";
-  return s;
+  for (const auto &i : instructions) os << ind << i.dump() << "\n";
+  os << "endfunction\n\n";
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -277,11 +522,74 @@ void code::add_subroutine(const subroutine &s) {
   subs.push_back(s);
   names.insert(make_pair(s.get_name(), subs.size()-1));
 }
+/// check whether a subroutine exists
+bool code::has_subroutine(const string &name) const { return names.find(name) != names.end(); }
+/// get all subroutines
+const vector<subroutine> & code::get_subroutines() const { return subs; }
+vector<subroutine> & code::get_subroutines() { return subs; }
+/// remove the subroutines not reachable from 'root'
+size_t code::remove_unreachable(const string &root) {
+  if (not has_subroutine(root)) return 0;
+  // walk the call graph from 'root'
+  vector<bool> reached(subs.size(), false);
+  vector<size_t> pending(1, names[root]);
+  reached[names[root]] = true;
+  while (not pending.empty()) {
+    size_t p = pending.back();
+    pending.pop_back();
+    for (const auto &inst : subs[p].get_instructions()) {
+      if (inst.oper != instruction::_CALL) continue;
+      auto it = names.find(inst.arg1.str());
+      if (it == names.end() or reached[it->second]) continue;
+      reached[it->second] = true;
+      pending.push_back(it->second);
+    }
+  }
+  vector<subroutine> kept;
+  names.clear();
+  for (size_t p = 0; p < subs.size(); ++p) {
+    if (not reached[p]) continue;
+    kept.push_back(subs[p]);
+    names.insert(make_pair(subs[p].get_name(), kept.size()-1));
+  }
+  size_t removed = subs.size() - kept.size();
+  subs = kept;
+  return removed;
+}
+/// add a string constant
+size_t code::add_string(const string &s) {
+  auto it = stringIndex.find(s);
+  if (it != stringIndex.end()) return it->second;
+  stringIndex.insert(make_pair(s, strings.size()));
+  strings.push_back(s);
+  return strings.size()-1;
+}
+/// get all string constants
+const vector<string> & code::get_strings() const { return strings; }
 /// print (for debugging)
 string code::dump() const {
-  string c;
-  for (auto s : subs) c += s.dump();
-  return c;
+  ostringstream os;
+  dump(os);
+  return os.str();
+}
+/// print into a stream
+void code::dump(ostream &os) const {
+  if (not strings.empty()) {
+    // "..." with the escapes \n \t \" and \\ only
+    os << "strings\n";
+    for (const auto &s : strings) {
+      os << "  \"";
+      for (char c : s) {
+        if (c == '\n') os << "\\n";
+        else if (c == '\t') os << "\\t";
+        else if (c == '"' or c == '\\') os << '\\' << c;
+        else os << c;
+      }
+      os << "\"\n";
+    }
+    os << "endstrings\n\n";
+  }
+  for (const auto &s : subs) s.dump(os);
 }
 
 
@@ -289,15 +597,18 @@ string code::dump() const {
 /// Static methods to manage counters
 int counters::countIF = 0;
 int counters::countWHILE = 0;
+int counters::countLOGIC = 0;
 int counters::countTEMP = 0;
 
 string counters::newLabelIF() { return std::to_string(++countIF); }
 string counters::newLabelWHILE() { return std::to_string(++countWHILE); }
+string counters::newLabelLOGIC() { return std::to_string(++countLOGIC); }
 string counters::newTEMP() { return std::to_string(++countTEMP); }
 
 void counters::resetLabelIF() { countIF = 0; }
 void counters::resetLabelWHILE() { countWHILE = 0; }
+void counters::resetLabelLOGIC() { countLOGIC = 0; }
 void counters::resetTEMP() { countTEMP = 0; }
 
-void counters::resetLabels() { resetLabelIF(); resetLabelWHILE(); }
+void counters::resetLabels() { resetLabelIF(); resetLabelWHILE(); resetLabelLOGIC(); }
 void counters::reset() { resetLabels(); resetTEMP(); }
@@ -31,10 +31,61 @@
 #include <map>
 #include <list>
 #include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <unordered_map>
+#include <iosfwd>
 
 /// predeclaration
 class instructionList;
 
+////////////////////////////////////////////////////////////////////
+/// Class operand is a compact (one word) handle for an instruction
+/// argument. Temporaries ("%N") and integer constants are encoded
+/// inline in the handle; any other text (variable, function and label
+/// names, float and char constants) is interned once in a table shared
+/// by all subroutines, and referenced by its index.
+
+class operand {
+public:
+  /// kinds of operand
+  typedef enum {_NONE, _SYMBOL, _TEMP, _INTEGER} Kind;
+
+  /// constructor for an absent operand
+  operand();
+  /// constructor from the operand text (encoded or interned)
+  operand(const std::string &s);
+
+  /// kind of operand
+  Kind kind() const;
+  /// true if there is no operand
+  bool empty() const;
+  /// true if the operand is a temporary ("%N")
+  bool is_temp() const;
+  /// number N of a temporary "%N"
+  unsigned temp_number() const;
+  /// value of an integer constant
+  int int_value() const;
+  /// raw handle (kind and payload)
+  std::uint32_t handle() const;
+
+  /// text of the operand, exactly as it was given
+  std::string str() const;
+
+  bool operator==(const operand &op) const;
+  bool operator!=(const operand &op) const;
+
+private:
+  /// two high bits hold the kind, the rest is the payload
+  std::uint32_t h;
+  operand(Kind k, std::uint32_t payload);
+
+  /// interned symbols, shared by all subroutines
+  static std::vector<std::string> symbols;
+  static std::unordered_map<std::string, std::uint32_t> symbolIndex;
+};
+
 ////////////////////////////////////////////////////////////////////
 /// Class instruction stores a VM instruction code with its operands
 
@@ -45,23 +96,53 @@ public:
                 _ADD, _SUB, _MUL, _DIV, _EQ, _LT, _LE, _NEG, _NOT, _AND, _OR, _FLOAT,
                 _FADD, _FSUB, _FMUL, _FDIV, _FEQ, _FLT, _FLE, _FNEG,
                 _LOAD, _ILOAD, _CHLOAD, _FLOAD, _XLOAD, _LOADX, _ALOAD, _LOADC, _CLOAD,
-                _READI, _READF, _READC, _WRITEI, _WRITEF, _WRITEC, _WRITELN, _NOOP, _INVALID} Operation;
-  
+                _READI, _READF, _READC, _WRITEI, _WRITEF, _WRITEC, _WRITELN, _NOOP,
+                _FJEQ, _FJNE, _FJLT, _FJLE, _FJFEQ, _FJFNE, _FJFLT, _FJFLE,
+                _ADDI, _SUBI, _MULI, _DIVI, _EQI, _LTI, _LEI, _GTI, _GEI,
+                _FADDI, _FSUBI, _FMULI, _FDIVI, _FEQI, _FLTI, _FLEI, _FGTI, _FGEI,
+                _COPYN, _WRITES, _POPN, _INVALID} Operation;
+  // _FJEQ.._FJFLE are the fused compare-and-branch instructions
+  // "ifFalse a1 <op> a2 goto a3": they jump when the comparison is
+  // false, as an 'ifFalse' on its result would (so floats compared
+  // with a NaN jump on all of them but !=). They go last, so that
+  // the codes of the others (in binary t-code) do not change.
+  // _ADDI.._FGEI are "a1 = a2 <op> k", with a literal k as a3 (an
+  // integer, or a float for the float ones), which saves loading it
+  // into a temporary. The literal is always the right operand, so
+  // there are > and >= forms too.
+  // _COPYN is "copyn a1 a2 k": copy k cells from array a2 to array a1
+  // (each an array var, or a temporary holding its address, as in
+  // a1[i] = a2[i]), with k a literal integer.
+  // _WRITES is "writes k": write string constant number k of the
+  // program
+  // _POPN is "popn k": pop (and discard) k cells, as k "popparam"
+  // with no operand. A _CALL with a2 ("call f k") pops k cells too,
+  // after the callee returns: the args (and an unused result).
+
   /// instruction code
   Operation oper;
   /// arguments
-  std::string arg1, arg2, arg3;
+  operand arg1, arg2, arg3;
   
   /// constructor
   instruction(Operation op,
               const std::string &a1="", const std::string &a2="", const std::string &a3="");
 
-  /// destructor
-  ~instruction();
-
   // concatenation of instruction+list (or instruction+instruction, via automatic coertion)
   instructionList operator||(const instructionList &lst) const;
 
+  /// true for "goto", "ifFalse" and the fused compare-and-branch
+  bool is_jump() const;
+  /// true for "ifFalse" and the fused compare-and-branch
+  bool is_conditional_jump() const;
+  /// true for the fused compare-and-branch
+  bool is_compare_jump() const;
+  /// label a jump goes to
+  const operand & jump_label() const;
+  operand & jump_label();
+  /// true for the operations with an immediate a3 ("a1 = a2 + 1")
+  bool is_immediate() const;
+
   /// ------ specific constructors for each instruction -------
 
   // create new instruction "a1 :"
@@ -70,12 +151,30 @@ public:
   static instruction UJUMP(const std::string &a1);
   // create new instruction "ifFalse a1 goto a2"
   static instruction FJUMP(const std::string &a1, const std::string &a2);
+  // create new instruction "ifFalse a1 == a2 goto a3" (jump if a1 != a2)
+  static instruction FJEQ(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "ifFalse a1 != a2 goto a3" (jump if a1 == a2)
+  static instruction FJNE(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "ifFalse a1 < a2 goto a3"
+  static instruction FJLT(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "ifFalse a1 <= a2 goto a3"
+  static instruction FJLE(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "ifFalse a1 ==. a2 goto a3"
+  static instruction FJFEQ(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "ifFalse a1 !=. a2 goto a3"
+  static instruction FJFNE(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "ifFalse a1 <. a2 goto a3"
+  static instruction FJFLT(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "ifFalse a1 <=. a2 goto a3"
+  static instruction FJFLE(const std::string &a1, const std::string &a2, const std::string &a3);
   // create new instruction "pushparam a1"
   static instruction PUSH(const std::string &a1="");
   // create new instruction "popparam a1"
   static instruction POP(const std::string &a1="");
-  // create new instruction "call a1"
-  static instruction CALL(const std::string &a1);
+  // create new instruction "popn a1" (a1 is the number of cells)
+  static instruction POPN(const std::string &a1);
+  // create new instruction "call a1" ("call a1 a2": and pop a2 cells on return)
+  static instruction CALL(const std::string &a1, const std::string &a2="");
   // create new instruction "return"
   static instruction RETURN();
   // create new instruction "a1 = a2 + a3"
@@ -110,6 +209,42 @@ public:
   static instruction FLT(const std::string &a1, const std::string &a2, const std::string &a3);
   // create new instruction "a1 = a2 <=. a3"
   static instruction FLE(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "a1 = a2 + a3" (where a3 is an integer constant)
+  static instruction ADDI(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "a1 = a2 - a3" (where a3 is an integer constant)
+  static instruction SUBI(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "a1 = a2 * a3" (where a3 is an integer constant)
+  static instruction MULI(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "a1 = a2 / a3" (where a3 is an integer constant)
+  static instruction DIVI(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "a1 = a2 == a3" (where a3 is an integer constant)
+  static instruction EQI(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "a1 = a2 < a3" (where a3 is an integer constant)
+  static instruction LTI(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "a1 = a2 <= a3" (where a3 is an integer constant)
+  static instruction LEI(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "a1 = a2 > a3" (where a3 is an integer constant)
+  static instruction GTI(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "a1 = a2 >= a3" (where a3 is an integer constant)
+  static instruction GEI(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "a1 = a2 +. a3" (where a3 is a float constant)
+  static instruction FADDI(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "a1 = a2 -. a3" (where a3 is a float constant)
+  static instruction FSUBI(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "a1 = a2 *. a3" (where a3 is a float constant)
+  static instruction FMULI(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "a1 = a2 /. a3" (where a3 is a float constant)
+  static instruction FDIVI(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "a1 = a2 ==. a3" (where a3 is a float constant)
+  static instruction FEQI(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "a1 = a2 <. a3" (where a3 is a float constant)
+  static instruction FLTI(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "a1 = a2 <=. a3" (where a3 is a float constant)
+  static instruction FLEI(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "a1 = a2 >. a3" (where a3 is a float constant)
+  static instruction FGTI(const std::string &a1, const std::string &a2, const std::string &a3);
+  // create new instruction "a1 = a2 >=. a3" (where a3 is a float constant)
+  static instruction FGEI(const std::string &a1, const std::string &a2, const std::string &a3);
   // create new instruction "a1 = not a2"
   static instruction NOT(const std::string &a1, const std::string &a2);
   // create new instruction "a1 = - a2"
@@ -136,6 +271,8 @@ public:
   static instruction LOADC(const std::string &a1, const std::string &a2);
   // create new instruction "*a1 = a2" 
   static instruction CLOAD(const std::string &a1, const std::string &a2);
+  // create new instruction "copyn a1 a2 a3" (a3 cells from a2 to a1)
+  static instruction COPYN(const std::string &a1, const std::string &a2, const std::string &a3);
   // create new instruction "readi a1" 
   static instruction READI(const std::string &a1);
   // create new instruction "readf a1" 
@@ -150,6 +287,8 @@ public:
   static instruction WRITEC(const std::string &a1);
   // create new instruction "writeln" 
   static instruction WRITELN();
+  // create new instruction "writes a1" (a1 is the index of a string constant)
+  static instruction WRITES(const std::string &a1);
   // create new instruction "noop" (not really needed) 
   static instruction NOOP();
   
@@ -159,9 +298,12 @@ public:
 
 
 ////////////////////////////////////////////////////////////////////
-/// Class instructionList stores a list of instructions
+/// Class instructionList stores a list of instructions.
+/// It is kept as a rope: concatenation just links both operands
+/// (which are shared, not copied) so it costs O(1), and the actual
+/// sequence is only built once, when flattened into a subroutine.
 
-class instructionList : public std::vector<instruction> {
+class instructionList {
 public:
   // constructor
   instructionList();
@@ -172,9 +314,29 @@ public:
 
   // concatenation of lists (or list+instruction, via automatic coertion)
   instructionList operator||(const instructionList &lst) const;
+  // append an instruction at the end of the list
+  void push_back(const instruction &inst);
+
+  // number of instructions in the list
+  std::size_t size() const;
+  // true if the list has no instructions
+  bool empty() const;
+  // sequence of instructions in the list, in order
+  std::vector<instruction> flatten() const;
 
   // print instructionList
-  std::string dump() const;   
+  std::string dump() const;
+  // print instructionList into a stream
+  void dump(std::ostream &os) const;
+
+private:
+  /// rope node: either a leaf holding one chunk of instructions,
+  /// or the concatenation of two (shared) sublists
+  class node;
+  std::shared_ptr<node> root;
+
+  // apply f to every chunk of instructions, in order
+  template <class F> void for_each_chunk(F f) const;
 };
 
 
@@ -202,8 +364,8 @@ class subroutine {
 private:
   /// name of the subroutine
   std::string name;
-  /// instructions
-  instructionList instructions;
+  /// instructions (flattened)
+  std::vector<instruction> instructions;
   /// map label name -> position in instructions
   std::map<std::string, size_t> labels;
 
@@ -231,14 +393,22 @@ public:
   void add_instructions(const instructionList &lins);
   /// set instruction list (overwritting current instructions)
   void set_instructions(const instructionList &lins);
+  /// set instructions from a sequence (overwritting current instructions)
+  void set_instructions(const std::vector<instruction> &insts);
   
   /// get instruction at given program counter in subroutine
   instruction get_instruction_at(size_t pc) const;
   /// get program counter in subroutine for given label
   size_t get_label_pc(std::string &lab) const;
+  /// get all instructions in subroutine
+  const std::vector<instruction> & get_instructions() const;
+  /// get map label name -> program counter
+  const std::map<std::string, size_t> & get_labels() const;
 
   // print subroutine (params, vars, and instructions)
   std::string dump() const;
+  // print subroutine into a stream
+  void dump(std::ostream &os) const;
 };
 
 ////////////////////////////////////////////////////////////////////
@@ -250,6 +420,9 @@ private:
   std::vector<subroutine> subs;
   /// index to access subroutines by name
   std::map<std::string, size_t> names;
+  /// string constants (written by "writes"), and their index
+  std::vector<std::string> strings;
+  std::map<std::string, size_t> stringIndex;
   
 public:
   /// constructor and destructor
@@ -262,9 +435,24 @@ public:
   const subroutine& get_subroutine(const std::string &name) const;
   /// add new subroutine
   void add_subroutine(const subroutine &s);
+  /// check whether there is a subroutine with the given name
+  bool has_subroutine(const std::string &name) const;
+  /// get all subroutines, in order
+  const std::vector<subroutine> & get_subroutines() const;
+  /// get all subroutines, in order, to modify them
+  std::vector<subroutine> & get_subroutines();
+  /// remove the subroutines not reachable by calls from 'root' (when
+  /// there is one), and get how many were removed
+  size_t remove_unreachable(const std::string &root);
+  /// add a string constant (if new), and get its index
+  size_t add_string(const std::string &s);
+  /// get all string constants, in order
+  const std::vector<std::string> & get_strings() const;
 
   // print code (all info for all subroutines)
   std::string dump() const;
+  // print code into a stream, one subroutine at a time
+  void dump(std::ostream &os) const;
 };
 
 
@@ -275,6 +463,7 @@ class counters {
 private:
   static int countIF;
   static int countWHILE;
+  static int countLOGIC;
   static int countTEMP;
 
 public:
@@ -282,15 +471,17 @@ public:
   // to ease concatenation with other literals (e.g. "labelIF" + "4" -> "LabelIF4")
   static std::string newLabelIF();
   static std::string newLabelWHILE();
+  static std::string newLabelLOGIC();
   static std::string newTEMP();
   
   // reset individual counters 
   static void resetLabelIF();
   static void resetLabelWHILE();
+  static void resetLabelLOGIC();
   static void resetTEMP();
   
-  // reset label counters (IF and WHILE)
+  // reset label counters (IF, WHILE and LOGIC)
   static void resetLabels();
-  // reset all counters (IF, WHILE, and TEMP)
+  // reset all counters (IF, WHILE, LOGIC and TEMP)
   static void reset();
 };
@@ -0,0 +1,991 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "codeAsm.h"
+
+using namespace std;
+
+/// runtime support included in every translated program: buffered
+/// I/O on stdin/stdout, error reports and the entry point. The
+/// routines take their argument in %edi and return it in %eax. They
+/// may clobber any caller-saved register.
+static const char *RUNTIME = R"ASM(
+        .bss
+        .align  16
+rt_outbuf:      .zero   65536
+rt_inbuf:       .zero   65536
+        .data
+        .align  8
+rt_outlen:      .quad   0
+rt_inpos:       .quad   0
+rt_inlen:       .quad   0
+        .section .rodata
+rt_inf:         .asciz  "inf"
+rt_nan:         .asciz  "nan"
+rt_crashmsg:    .asciz  "VM_CRASH: "
+rt_divzero:     .asciz  "Division by zero.\n"
+
+        .text
+        .globl  _start
+_start:
+        xorl    %ebp, %ebp
+        call    f_main
+        call    rt_flush
+        movl    $60, %eax               # exit(0)
+        xorl    %edi, %edi
+        syscall
+
+# write the output buffer to stdout
+rt_flush:
+        movq    rt_outlen(%rip), %rdx
+        leaq    rt_outbuf(%rip), %rsi
+1:      testq   %rdx, %rdx
+        jz      2f
+        movl    $1, %eax                # write(1, buf, len)
+        movl    $1, %edi
+        syscall
+        testq   %rax, %rax
+        jle     2f
+        addq    %rax, %rsi
+        subq    %rax, %rdx
+        jmp     1b
+2:      movq    $0, rt_outlen(%rip)
+        ret
+
+# append the byte in %dil to the output buffer
+rt_putc:
+        movq    rt_outlen(%rip), %rax
+        cmpq    $65536, %rax
+        jb      1f
+        pushq   %rdi
+        call    rt_flush
+        popq    %rdi
+        xorl    %eax, %eax
+1:      leaq    rt_outbuf(%rip), %rcx
+        movb    %dil, (%rcx,%rax)
+        incq    %rax
+        movq    %rax, rt_outlen(%rip)
+        ret
+
+# write the NUL-terminated string at %rsi
+rt_puts:
+        pushq   %rbx
+        movq    %rsi, %rbx
+1:      movzbl  (%rbx), %edi
+        testl   %edi, %edi
+        jz      2f
+        call    rt_putc
+        incq    %rbx
+        jmp     1b
+2:      popq    %rbx
+        ret
+
+# write the NUL-terminated string at %rsi to stderr
+rt_eputs:
+        xorl    %edx, %edx
+1:      cmpb    $0, (%rsi,%rdx)
+        je      2f
+        incq    %rdx
+        jmp     1b
+2:      movl    $1, %eax                # write(2, str, len)
+        movl    $2, %edi
+        syscall
+        ret
+
+# report the error message at %rdi as the tVM does, and exit(1)
+rt_crash:
+        pushq   %rdi
+        call    rt_flush
+        leaq    rt_crashmsg(%rip), %rsi
+        call    rt_eputs
+        popq    %rsi
+        call    rt_eputs
+        movl    $60, %eax               # exit(1)
+        movl    $1, %edi
+        syscall
+
+# %eax = %eax / %ecx; a zero divisor, or INT_MIN / -1 (that would
+# trap with SIGFPE), crashes as in the tVM
+rt_idiv:
+        testl   %ecx, %ecx
+        jz      2f
+        cmpl    $-1, %ecx
+        jne     1f
+        cmpl    $0x80000000, %eax
+        je      2f
+1:      cltd
+        idivl   %ecx
+        ret
+2:      leaq    rt_divzero(%rip), %rdi
+        jmp     rt_crash
+
+# copy %rdx cells from (%rsi) to (%rdi), as memmove does
+rt_copyn:
+        movq    %rdx, %rcx
+        cmpq    %rsi, %rdi
+        jbe     1f
+        leaq    -4(%rsi,%rcx,4), %rsi   # overlapping upwards: copy backwards
+        leaq    -4(%rdi,%rcx,4), %rdi
+        std
+        rep movsl
+        cld
+        ret
+1:      rep movsl
+        ret
+
+rt_writeln:
+        movl    $10, %edi
+        jmp     rt_putc
+
+rt_writec:
+        jmp     rt_putc
+
+# write the integer in %edi
+rt_writei:
+        movslq  %edi, %rax
+        testq   %rax, %rax
+        jns     rt_writeu
+        pushq   %rax
+        movl    $45, %edi               # '-'
+        call    rt_putc
+        popq    %rax
+        negq    %rax
+# write the unsigned integer in %rax
+rt_writeu:
+        subq    $32, %rsp
+        leaq    32(%rsp), %rsi
+        movl    $10, %ecx
+1:      xorl    %edx, %edx
+        divq    %rcx
+        addb    $48, %dl
+        decq    %rsi
+        movb    %dl, (%rsi)
+        testq   %rax, %rax
+        jnz     1b
+2:      movzbl  (%rsi), %edi
+        pushq   %rsi
+        call    rt_putc
+        popq    %rsi
+        incq    %rsi
+        leaq    32(%rsp), %rax
+        cmpq    %rax, %rsi
+        jb      2b
+        addq    $32, %rsp
+        ret
+
+# write the float whose bits are in %edi, as '%g' does: 6 significant
+# digits, trailing zeros removed, exponent notation when the decimal
+# exponent is below -4 or above 5
+rt_writef:
+        pushq   %rbx
+        pushq   %r12
+        pushq   %r13
+        subq    $16, %rsp               # the 6 digits, at (%rsp)
+        movl    %edi, %ebx
+        testl   %ebx, %ebx
+        jns     1f
+        movl    $45, %edi               # '-'
+        call    rt_putc
+        andl    $0x7fffffff, %ebx
+1:      cmpl    $0x7f800000, %ebx
+        jb      3f
+        leaq    rt_inf(%rip), %rsi
+        je      2f
+        leaq    rt_nan(%rip), %rsi
+2:      call    rt_puts
+        jmp     9f
+3:      testl   %ebx, %ebx
+        jnz     4f
+        movl    $48, %edi               # '0'
+        call    rt_putc
+        jmp     9f
+        # x = |value| as a double; scaled by 10^50 when below 1
+4:      movd    %ebx, %xmm0
+        cvtss2sd %xmm0, %xmm0
+        leaq    rt_pow10(%rip), %rcx
+        xorl    %r13d, %r13d
+        ucomisd (%rcx), %xmm0
+        jae     5f
+        mulsd   400(%rcx), %xmm0
+        movl    $50, %r13d
+        # decimal exponent: largest e with 10^e <= x
+5:      xorl    %r12d, %r12d
+6:      cmpl    $50, %r12d
+        jae     7f
+        ucomisd 8(%rcx,%r12,8), %xmm0
+        jb      7f
+        incl    %r12d
+        jmp     6b
+        # digits: x * 10^(5-e), rounded to nearest
+7:      movl    $5, %eax
+        subl    %r12d, %eax
+        js      8f
+        mulsd   (%rcx,%rax,8), %xmm0
+        jmp     10f
+8:      negl    %eax
+        divsd   (%rcx,%rax,8), %xmm0
+10:     cvtsd2si %xmm0, %rax
+        subl    %r13d, %r12d            # e, without the scaling
+        cmpq    $1000000, %rax
+        jb      11f
+        movl    $10, %ecx               # rounded up to 10^6
+        xorl    %edx, %edx
+        divq    %rcx
+        incl    %r12d
+11:     movl    $10, %ecx
+        movl    $5, %esi
+12:     xorl    %edx, %edx
+        divq    %rcx
+        addb    $48, %dl
+        movb    %dl, (%rsp,%rsi)
+        decl    %esi
+        jns     12b
+        # %r13 = position of the last non-zero digit
+        movl    $5, %r13d
+13:     cmpb    $48, (%rsp,%r13)
+        jne     14f
+        decl    %r13d
+        jmp     13b
+14:     cmpl    $-4, %r12d
+        jl      20f
+        cmpl    $6, %r12d
+        jge     20f
+        testl   %r12d, %r12d
+        js      17f
+        # fixed notation, x >= 1: digits 0..e, then the fraction
+        xorl    %ebx, %ebx
+15:     movzbl  (%rsp,%rbx), %edi
+        call    rt_putc
+        incl    %ebx
+        cmpl    %r12d, %ebx
+        jle     15b
+        cmpl    %r12d, %r13d
+        jle     9f
+        movl    $46, %edi               # '.'
+        call    rt_putc
+16:     movzbl  (%rsp,%rbx), %edi
+        call    rt_putc
+        incl    %ebx
+        cmpl    %r13d, %ebx
+        jle     16b
+        jmp     9f
+        # fixed notation, x < 1: "0." and -e-1 zeros before the digits
+17:     movl    $48, %edi
+        call    rt_putc
+        movl    $46, %edi
+        call    rt_putc
+        leal    1(%r12), %ebx
+18:     testl   %ebx, %ebx
+        jz      19f
+        movl    $48, %edi
+        call    rt_putc
+        incl    %ebx
+        jmp     18b
+19:     xorl    %ebx, %ebx
+        jmp     16b
+        # exponent notation: d[.ddddd]e+XX
+20:     movzbl  (%rsp), %edi
+        call    rt_putc
+        movl    $1, %ebx
+        testl   %r13d, %r13d
+        jz      21f
+        movl    $46, %edi               # '.'
+        call    rt_putc
+22:     movzbl  (%rsp,%rbx), %edi
+        call    rt_putc
+        incl    %ebx
+        cmpl    %r13d, %ebx
+        jle     22b
+21:     movl    $101, %edi              # 'e'
+        call    rt_putc
+        movl    $43, %edi               # '+'
+        testl   %r12d, %r12d
+        jns     23f
+        movl    $45, %edi               # '-'
+        negl    %r12d
+23:     call    rt_putc
+        cmpl    $10, %r12d
+        jae     24f
+        movl    $48, %edi
+        call    rt_putc
+24:     movl    %r12d, %eax
+        call    rt_writeu
+9:      addq    $16, %rsp
+        popq    %r13
+        popq    %r12
+        popq    %rbx
+        ret
+
+# next input byte in %eax, without consuming it (-1 at end of input)
+rt_peekc:
+        movq    rt_inpos(%rip), %rax
+        cmpq    rt_inlen(%rip), %rax
+        jb      2f
+        xorl    %eax, %eax              # read(0, buf, size)
+        xorl    %edi, %edi
+        leaq    rt_inbuf(%rip), %rsi
+        movl    $65536, %edx
+        syscall
+        testq   %rax, %rax
+        jg      1f
+        movl    $-1, %eax
+        ret
+1:      movq    %rax, rt_inlen(%rip)
+        movq    $0, rt_inpos(%rip)
+        xorl    %eax, %eax
+2:      leaq    rt_inbuf(%rip), %rcx
+        movzbl  (%rcx,%rax), %eax
+        ret
+
+# skip white space; the next input byte is left in %eax
+rt_skipws:
+        call    rt_peekc
+        cmpl    $32, %eax
+        je      1f
+        leal    -9(%rax), %ecx          # \t \n \v \f \r
+        cmpl    $4, %ecx
+        ja      2f
+1:      incq    rt_inpos(%rip)
+        jmp     rt_skipws
+2:      ret
+
+# read a char (after white space), 0 at end of input
+rt_readc:
+        call    rt_skipws
+        testl   %eax, %eax
+        js      1f
+        incq    rt_inpos(%rip)
+        ret
+1:      xorl    %eax, %eax
+        ret
+
+# read an integer, 0 if there is none, saturated if it overflows
+rt_readi:
+        pushq   %rbx
+        pushq   %r12
+        call    rt_skipws
+        xorl    %ebx, %ebx
+        xorl    %r12d, %r12d
+        cmpl    $43, %eax               # '+'
+        je      1f
+        cmpl    $45, %eax               # '-'
+        jne     2f
+        incl    %r12d
+1:      incq    rt_inpos(%rip)
+        call    rt_peekc
+2:      leal    -48(%rax), %ecx
+        cmpl    $9, %ecx
+        ja      3f
+        movl    $0x80000000, %edx
+        cmpq    %rdx, %rbx
+        ja      1b
+        imulq   $10, %rbx, %rbx
+        addq    %rcx, %rbx
+        jmp     1b
+3:      testl   %r12d, %r12d
+        jz      4f
+        negq    %rbx
+4:      movl    $0x7fffffff, %eax
+        cmpq    %rax, %rbx
+        cmovg   %rax, %rbx
+        movq    $-0x80000000, %rax
+        cmpq    %rax, %rbx
+        cmovl   %rax, %rbx
+        movl    %ebx, %eax
+        popq    %r12
+        popq    %rbx
+        ret
+
+# read a float (bits in %eax), 0 if there is none
+rt_readf:
+        pushq   %rbx
+        pushq   %r12
+        pushq   %r13
+        pushq   %r14
+        pushq   %r15
+        call    rt_skipws
+        xorl    %ebx, %ebx              # up to 17 significant digits
+        xorl    %r12d, %r12d            # negative
+        xorl    %r13d, %r13d            # decimal exponent
+        xorl    %r14d, %r14d            # in the fraction
+        cmpl    $43, %eax               # '+'
+        je      1f
+        cmpl    $45, %eax               # '-'
+        jne     2f
+        incl    %r12d
+1:      incq    rt_inpos(%rip)
+        call    rt_peekc
+2:      leal    -48(%rax), %ecx
+        cmpl    $9, %ecx
+        ja      4f
+        movabsq $100000000000000000, %rdx
+        cmpq    %rdx, %rbx
+        jae     3f
+        imulq   $10, %rbx, %rbx
+        addq    %rcx, %rbx
+        subl    %r14d, %r13d
+        jmp     1b
+3:      incl    %r13d                   # digit dropped
+        subl    %r14d, %r13d
+        jmp     1b
+4:      testl   %r14d, %r14d
+        jnz     5f
+        cmpl    $46, %eax               # '.'
+        jne     5f
+        movl    $1, %r14d
+        jmp     1b
+5:      orl     $32, %eax
+        cmpl    $101, %eax              # 'e' or 'E'
+        jne     9f
+        incq    rt_inpos(%rip)
+        call    rt_peekc
+        xorl    %r14d, %r14d            # negative exponent
+        xorl    %r15d, %r15d            # exponent
+        cmpl    $43, %eax
+        je      6f
+        cmpl    $45, %eax
+        jne     7f
+        incl    %r14d
+6:      incq    rt_inpos(%rip)
+        call    rt_peekc
+7:      leal    -48(%rax), %ecx
+        cmpl    $9, %ecx
+        ja      8f
+        cmpl    $100000, %r15d
+        jae     6b
+        imull   $10, %r15d, %r15d
+        addl    %ecx, %r15d
+        jmp     6b
+8:      testl   %r14d, %r14d
+        jz      10f
+        negl    %r15d
+10:     addl    %r15d, %r13d
+        # value = digits * 10^exponent, by steps of at most 10^50
+9:      cvtsi2sdq %rbx, %xmm0
+        leaq    rt_pow10(%rip), %rcx
+11:     movl    %r13d, %eax
+        testl   %eax, %eax
+        jz      14f
+        js      12f
+        cmpl    $50, %eax
+        jbe     13f
+        movl    $50, %eax
+13:     mulsd   (%rcx,%rax,8), %xmm0
+        subl    %eax, %r13d
+        jmp     11b
+12:     negl    %eax
+        cmpl    $50, %eax
+        jbe     15f
+        movl    $50, %eax
+15:     divsd   (%rcx,%rax,8), %xmm0
+        addl    %eax, %r13d
+        jmp     11b
+14:     cvtsd2ss %xmm0, %xmm0
+        movd    %xmm0, %eax
+        testl   %r12d, %r12d
+        jz      16f
+        xorl    $0x80000000, %eax
+16:     popq    %r15
+        popq    %r14
+        popq    %r13
+        popq    %r12
+        popq    %rbx
+        ret
+)ASM";
+
+/// value of a char constant, as the tVM reads it: '\n' and '\t' are
+/// the only escapes, otherwise the first character is taken
+static int char_value(const string &s) {
+  if (s == "\\n") return '\n';
+  if (s == "\\t") return '\t';
+  return s.empty() ? 0 : (unsigned char)s[0];
+}
+
+/// string literal for the assembler
+static string quoted(const string &s) {
+  string q = "\"";
+  for (char c : s) {
+    if (c == '\n') q += "\\n";
+    else if (c == '"' or c == '\\') q += string("\\") + c;
+    else q += c;
+  }
+  return q + "\"";
+}
+
+////////////////////////////////////////////////////////////////////
+/// translation of one subroutine
+
+class asmSubroutine {
+public:
+  asmSubroutine(const subroutine &s, ostream &os);
+  void write();
+
+private:
+  const subroutine &sub;
+  ostream &os;
+  /// frame offset (from %rbp) of each param, var and temporary
+  map<string, long> params;
+  map<string, long> vars;
+  map<uint32_t, long> temps;
+  long frameSize;
+  long varBytes;
+  /// names not declared in the subroutine
+  set<string> undefined;
+
+  /// memory operand for the slot of an operand, and whether it is an
+  /// 8-byte slot (temporaries and params) or a 4-byte cell (vars)
+  string slot(const operand &op);
+  bool wide(const operand &op) const;
+  /// move an operand into/from a register (given by its 64-bit name)
+  void load(const operand &op, const string &reg);
+  void store(const operand &op, const string &reg);
+  /// address of a param or var, or value of a temporary holding an
+  /// address, into %rcx
+  void base(const operand &op);
+  string label(const operand &op) const;
+  void emit(const string &line);
+  void binary(const instruction &inst, const string &op);
+  void compare(const instruction &inst, const string &setcc);
+  void fbinary(const instruction &inst, const string &op);
+  void fcompare(const instruction &inst, const string &setcc);
+  void compare_jump(const instruction &inst);
+  void immediate(const instruction &inst);
+  void instruction_to_asm(const instruction &inst);
+};
+
+asmSubroutine::asmSubroutine(const subroutine &s, ostream &os) : sub(s), os(os) {
+  // params: first pushed is deepest, above the return address
+  long n = s.params.size(), k = 0;
+  for (const auto &p : s.params) params[p.name] = 16 + 8 * (n - 1 - k++);
+  // vars: 4 bytes per cell, below the saved %rbp
+  long off = 0;
+  for (const auto &v : s.vars) {
+    off += 4 * long(v.size);
+    vars[v.name] = -off;
+  }
+  varBytes = (off + 7) & ~7L;
+  // temporaries: 8 bytes each, below the vars
+  off = varBytes;
+  for (const auto &inst : s.get_instructions())
+    for (const operand *op : {&inst.arg1, &inst.arg2, &inst.arg3})
+      if (op->is_temp() and not temps.count(op->temp_number())) {
+        off += 8;
+        temps[op->temp_number()] = -off;
+      }
+  frameSize = (off + 15) & ~15L;
+}
+
+string asmSubroutine::slot(const operand &op) {
+  long off = 0;
+  if (op.is_temp()) off = temps[op.temp_number()];
+  else {
+    string name = op.str();
+    auto p = params.find(name);
+    auto v = vars.find(name);
+    if (p != params.end()) off = p->second;
+    else if (v != vars.end()) off = v->second;
+    else undefined.insert(name);
+  }
+  return to_string(off) + "(%rbp)";
+}
+
+bool asmSubroutine::wide(const operand &op) const {
+  return op.is_temp() or params.count(op.str());
+}
+
+void asmSubroutine::load(const operand &op, const string &reg) {
+  if (wide(op)) emit("movq    " + slot(op) + ", %" + reg);
+  else emit("movl    " + slot(op) + ", %e" + reg.substr(1));
+}
+
+void asmSubroutine::store(const operand &op, const string &reg) {
+  if (wide(op)) emit("movq    %" + reg + ", " + slot(op));
+  else emit("movl    %e" + reg.substr(1) + ", " + slot(op));
+}
+
+void asmSubroutine::base(const operand &op) {
+  // a temporary holds the address of the array, a name is the array
+  if (op.is_temp()) emit("movq    " + slot(op) + ", %rcx");
+  else emit("leaq    " + slot(op) + ", %rcx");
+}
+
+string asmSubroutine::label(const operand &op) const {
+  return ".L" + sub.get_name() + "." + op.str();
+}
+
+void asmSubroutine::emit(const string &line) {
+  os << "        " << line << endl;
+}
+
+void asmSubroutine::binary(const instruction &inst, const string &op) {
+  load(inst.arg2, "rax");
+  load(inst.arg3, "rcx");
+  emit(op + "    %ecx, %eax");
+  store(inst.arg1, "rax");
+}
+
+void asmSubroutine::compare(const instruction &inst, const string &setcc) {
+  load(inst.arg2, "rax");
+  load(inst.arg3, "rcx");
+  emit("cmpl    %ecx, %eax");
+  emit(setcc + "    %al");
+  emit("movzbl  %al, %eax");
+  store(inst.arg1, "rax");
+}
+
+void asmSubroutine::fbinary(const instruction &inst, const string &op) {
+  load(inst.arg2, "rax");
+  load(inst.arg3, "rcx");
+  emit("movd    %eax, %xmm0");
+  emit("movd    %ecx, %xmm1");
+  emit(op + "   %xmm1, %xmm0");
+  emit("movd    %xmm0, %eax");
+  store(inst.arg1, "rax");
+}
+
+void asmSubroutine::fcompare(const instruction &inst, const string &setcc) {
+  // a < b as b > a (and a <= b as b >= a), false when unordered
+  load(inst.arg2, "rax");
+  load(inst.arg3, "rcx");
+  emit("movd    %eax, %xmm0");
+  emit("movd    %ecx, %xmm1");
+  emit("ucomiss %xmm0, %xmm1");
+  emit(setcc + "    %al");
+  if (setcc == "sete") {
+    emit("setnp   %cl");
+    emit("andb    %cl, %al");
+  }
+  emit("movzbl  %al, %eax");
+  store(inst.arg1, "rax");
+}
+
+void asmSubroutine::compare_jump(const instruction &inst) {
+  // jump when the comparison is false (unordered floats compare false)
+  string target = label(inst.arg3);
+  load(inst.arg1, "rax");
+  load(inst.arg2, "rcx");
+  switch (inst.oper) {
+  case instruction::_FJEQ : emit("cmpl    %ecx, %eax"); emit("jne     " + target); return;
+  case instruction::_FJNE : emit("cmpl    %ecx, %eax"); emit("je      " + target); return;
+  case instruction::_FJLT : emit("cmpl    %ecx, %eax"); emit("jge     " + target); return;
+  case instruction::_FJLE : emit("cmpl    %ecx, %eax"); emit("jg      " + target); return;
+  default : break;
+  }
+  emit("movd    %eax, %xmm0");
+  emit("movd    %ecx, %xmm1");
+  emit("ucomiss %xmm0, %xmm1");
+  switch (inst.oper) {
+  case instruction::_FJFEQ : emit("jne     " + target); emit("jp      " + target); break;
+  case instruction::_FJFNE : emit("jp      1f"); emit("je      " + target); os << "1:" << endl; break;
+  case instruction::_FJFLT : emit("jbe     " + target); break;
+  default : emit("jb      " + target); break;
+  }
+}
+
+void asmSubroutine::immediate(const instruction &inst) {
+  // the literal goes into %ecx, and then as the forms with two operands
+  string text = inst.arg3.str();
+  int32_t k;
+  if (inst.oper < instruction::_FADDI) k = int32_t(strtol(text.c_str(), nullptr, 10));
+  else {
+    float f = strtof(text.c_str(), nullptr);
+    memcpy(&k, &f, sizeof(k));
+  }
+  load(inst.arg2, "rax");
+  emit("movl    $" + to_string(k) + ", %ecx");
+  if (inst.oper >= instruction::_FADDI) {
+    emit("movd    %eax, %xmm0");
+    emit("movd    %ecx, %xmm1");
+  }
+  switch (inst.oper) {
+  case instruction::_ADDI : emit("addl    %ecx, %eax"); break;
+  case instruction::_SUBI : emit("subl    %ecx, %eax"); break;
+  case instruction::_MULI : emit("imull   %ecx, %eax"); break;
+  case instruction::_DIVI : emit("call    rt_idiv"); break;
+  case instruction::_EQI : case instruction::_LTI : case instruction::_LEI :
+  case instruction::_GTI : case instruction::_GEI : {
+    static const char *const setcc[] = {"sete ", "setl ", "setle", "setg ", "setge"};
+    emit("cmpl    %ecx, %eax");
+    emit(string(setcc[inst.oper - instruction::_EQI]) + "    %al");
+    emit("movzbl  %al, %eax");
+    break;
+  }
+  case instruction::_FADDI : emit("addss   %xmm1, %xmm0"); emit("movd    %xmm0, %eax"); break;
+  case instruction::_FSUBI : emit("subss   %xmm1, %xmm0"); emit("movd    %xmm0, %eax"); break;
+  case instruction::_FMULI : emit("mulss   %xmm1, %xmm0"); emit("movd    %xmm0, %eax"); break;
+  case instruction::_FDIVI : emit("divss   %xmm1, %xmm0"); emit("movd    %xmm0, %eax"); break;
+  case instruction::_FEQI :
+    emit("ucomiss %xmm0, %xmm1");
+    emit("sete    %al");
+    emit("setnp   %cl");
+    emit("andb    %cl, %al");
+    emit("movzbl  %al, %eax");
+    break;
+  default :
+    // a < k as k > a, and a > k as it is (false when unordered)
+    if (inst.oper == instruction::_FLTI or inst.oper == instruction::_FLEI) emit("ucomiss %xmm0, %xmm1");
+    else emit("ucomiss %xmm1, %xmm0");
+    emit(inst.oper == instruction::_FLTI or inst.oper == instruction::_FGTI ? "seta    %al" : "setae   %al");
+    emit("movzbl  %al, %eax");
+    break;
+  }
+  store(inst.arg1, "rax");
+}
+
+void asmSubroutine::instruction_to_asm(const instruction &inst) {
+  os << "        # " << inst.dump() << endl;
+  switch (inst.oper) {
+  case instruction::_LABEL : os << label(inst.arg1) << ":" << endl; break;
+  case instruction::_UJUMP : emit("jmp     " + label(inst.arg1)); break;
+  case instruction::_FJUMP :
+    load(inst.arg1, "rax");
+    emit("testl   %eax, %eax");
+    emit("jz      " + label(inst.arg2));
+    break;
+  case instruction::_FJEQ : case instruction::_FJNE : case instruction::_FJLT : case instruction::_FJLE :
+  case instruction::_FJFEQ : case instruction::_FJFNE : case instruction::_FJFLT : case instruction::_FJFLE :
+    compare_jump(inst);
+    break;
+  case instruction::_PUSH :
+    if (inst.arg1.empty()) emit("pushq   $0");
+    else if (wide(inst.arg1)) emit("pushq   " + slot(inst.arg1));
+    else {
+      load(inst.arg1, "rax");
+      emit("pushq   %rax");
+    }
+    break;
+  case instruction::_POP :
+    if (inst.arg1.empty()) emit("addq    $8, %rsp");
+    else {
+      emit("popq    %rax");
+      store(inst.arg1, "rax");
+    }
+    break;
+  case instruction::_POPN : emit("addq    $" + to_string(8L * inst.arg1.int_value()) + ", %rsp"); break;
+  case instruction::_CALL :
+    emit("call    f_" + inst.arg1.str());
+    if (not inst.arg2.empty()) emit("addq    $" + to_string(8L * inst.arg2.int_value()) + ", %rsp");
+    break;
+  case instruction::_RETURN : emit("leave"); emit("ret"); break;
+
+  case instruction::_ADD : binary(inst, "addl "); break;
+  case instruction::_SUB : binary(inst, "subl "); break;
+  case instruction::_MUL : binary(inst, "imull"); break;
+  case instruction::_DIV :
+    load(inst.arg2, "rax");
+    load(inst.arg3, "rcx");
+    emit("call    rt_idiv");
+    store(inst.arg1, "rax");
+    break;
+  case instruction::_EQ : compare(inst, "sete "); break;
+  case instruction::_LT : compare(inst, "setl "); break;
+  case instruction::_LE : compare(inst, "setle"); break;
+  case instruction::_NEG :
+    load(inst.arg2, "rax");
+    emit("negl    %eax");
+    store(inst.arg1, "rax");
+    break;
+  case instruction::_NOT :
+    load(inst.arg2, "rax");
+    emit("testl   %eax, %eax");
+    emit("sete    %al");
+    emit("movzbl  %al, %eax");
+    store(inst.arg1, "rax");
+    break;
+  case instruction::_AND :
+  case instruction::_OR :
+    load(inst.arg2, "rax");
+    load(inst.arg3, "rcx");
+    emit("testl   %eax, %eax");
+    emit("setne   %al");
+    emit("testl   %ecx, %ecx");
+    emit("setne   %cl");
+    emit(string(inst.oper == instruction::_AND ? "andb" : "orb ") + "    %cl, %al");
+    emit("movzbl  %al, %eax");
+    store(inst.arg1, "rax");
+    break;
+  case instruction::_FLOAT :
+    load(inst.arg2, "rax");
+    emit("cvtsi2ssl %eax, %xmm0");
+    emit("movd    %xmm0, %eax");
+    store(inst.arg1, "rax");
+    break;
+
+  case instruction::_FADD : fbinary(inst, "addss"); break;
+  case instruction::_FSUB : fbinary(inst, "subss"); break;
+  case instruction::_FMUL : fbinary(inst, "mulss"); break;
+  case instruction::_FDIV : fbinary(inst, "divss"); break;
+  case instruction::_FEQ : fcompare(inst, "sete"); break;
+  case instruction::_FLT : fcompare(inst, "seta"); break;
+  case instruction::_FLE : fcompare(inst, "setae"); break;
+  case instruction::_ADDI : case instruction::_SUBI : case instruction::_MULI :
+  case instruction::_DIVI : case instruction::_EQI : case instruction::_LTI :
+  case instruction::_LEI : case instruction::_GTI : case instruction::_GEI :
+  case instruction::_FADDI : case instruction::_FSUBI : case instruction::_FMULI :
+  case instruction::_FDIVI : case instruction::_FEQI : case instruction::_FLTI :
+  case instruction::_FLEI : case instruction::_FGTI : case instruction::_FGEI :
+    immediate(inst);
+    break;
+  case instruction::_FNEG :
+    load(inst.arg2, "rax");
+    emit("xorl    $0x80000000, %eax");
+    store(inst.arg1, "rax");
+    break;
+
+  case instruction::_LOAD :
+    load(inst.arg2, "rax");
+    store(inst.arg1, "rax");
+    break;
+  case instruction::_ILOAD :
+  case instruction::_FLOAD :
+  case instruction::_CHLOAD : {
+    string text = inst.arg2.str();
+    int32_t value;
+    if (inst.oper == instruction::_ILOAD) value = int32_t(strtol(text.c_str(), nullptr, 10));
+    else if (inst.oper == instruction::_CHLOAD) value = char_value(text);
+    else {
+      float f = strtof(text.c_str(), nullptr);
+      memcpy(&value, &f, sizeof(value));
+    }
+    emit("movl    $" + to_string(value) + ", %eax");
+    store(inst.arg1, "rax");
+    break;
+  }
+  case instruction::_XLOAD :
+    base(inst.arg1);
+    load(inst.arg2, "rdx");
+    emit("movslq  %edx, %rdx");
+    load(inst.arg3, "rax");
+    emit("movl    %eax, (%rcx,%rdx,4)");
+    break;
+  case instruction::_LOADX :
+    base(inst.arg2);
+    load(inst.arg3, "rdx");
+    emit("movslq  %edx, %rdx");
+    emit("movl    (%rcx,%rdx,4), %eax");
+    store(inst.arg1, "rax");
+    break;
+  case instruction::_ALOAD :
+    emit("leaq    " + slot(inst.arg2) + ", %rax");
+    store(inst.arg1, "rax");
+    break;
+  case instruction::_COPYN :
+    base(inst.arg2);
+    emit("movq    %rcx, %rsi");
+    base(inst.arg1);
+    emit("movq    %rcx, %rdi");
+    emit("movl    $" + to_string(strtoul(inst.arg3.str().c_str(), nullptr, 10)) + ", %edx");
+    emit("call    rt_copyn");
+    break;
+  case instruction::_LOADC :
+    load(inst.arg2, "rcx");
+    emit("movl    (%rcx), %eax");
+    store(inst.arg1, "rax");
+    break;
+  case instruction::_CLOAD :
+    load(inst.arg1, "rcx");
+    load(inst.arg2, "rax");
+    emit("movl    %eax, (%rcx)");
+    break;
+
+  case instruction::_READI : emit("call    rt_readi"); store(inst.arg1, "rax"); break;
+  case instruction::_READF : emit("call    rt_readf"); store(inst.arg1, "rax"); break;
+  case instruction::_READC : emit("call    rt_readc"); store(inst.arg1, "rax"); break;
+  case instruction::_WRITEI : load(inst.arg1, "rdi"); emit("call    rt_writei"); break;
+  case instruction::_WRITEF : load(inst.arg1, "rdi"); emit("call    rt_writef"); break;
+  case instruction::_WRITEC : load(inst.arg1, "rdi"); emit("call    rt_writec"); break;
+  case instruction::_WRITELN : emit("call    rt_writeln"); break;
+  case instruction::_WRITES :
+    emit("leaq    .Lstring." + inst.arg1.str() + "(%rip), %rsi");
+    emit("call    rt_puts");
+    break;
+  case instruction::_NOOP : break;
+  default : emit(".error \"invalid instruction\""); break;
+  }
+}
+
+void asmSubroutine::write() {
+  const vector<instruction> &insts = sub.get_instructions();
+  string name = sub.get_name();
+  os << endl << "# subroutine " << name << endl;
+  os << "f_" << name << ":" << endl;
+  emit("pushq   %rbp");
+  emit("movq    %rsp, %rbp");
+  if (frameSize > 0) emit("subq    $" + to_string(frameSize) + ", %rsp");
+  if (varBytes > 0) {
+    emit("leaq    -" + to_string(varBytes) + "(%rbp), %rdi");
+    emit("movl    $" + to_string(varBytes / 8) + ", %ecx");
+    emit("xorl    %eax, %eax");
+    emit("rep stosq");
+  }
+  for (const auto &inst : insts) instruction_to_asm(inst);
+  if (insts.empty() or insts.back().oper != instruction::_RETURN) {
+    string msg = "Control reaches end of subroutine " + name + ". Missing 'return' ?\n";
+    emit("leaq    .Lnoreturn." + name + "(%rip), %rdi");
+    emit("jmp     rt_crash");
+    os << "        .section .rodata" << endl;
+    os << ".Lnoreturn." << name << ":" << endl;
+    emit(".asciz  " + quoted(msg));
+    os << "        .text" << endl;
+  }
+  for (const string &u : undefined)
+    emit(".error " + quoted("Undefined ID " + u + " in subroutine " + name));
+}
+
+
+////////////////////////////////////////////////////////////////////
+/// Class asmCode
+
+/// write program 'prog' as a GNU-as x86-64 source file
+void asmCode::write(const code &prog, std::ostream &os) {
+  os << "# t-code program translated to x86-64 assembly (GNU as)" << endl;
+  os << RUNTIME;
+  // powers of ten for the float conversions
+  os << "        .section .rodata" << endl;
+  os << "        .align  8" << endl;
+  os << "rt_pow10:" << endl;
+  for (int e = 0; e <= 50; ++e) os << "        .double 1e" << e << endl;
+  // string constants
+  const vector<string> &strings = prog.get_strings();
+  for (size_t k = 0; k < strings.size(); ++k) {
+    os << ".Lstring." << k << ":" << endl;
+    os << "        .asciz  " << quoted(strings[k]) << endl;
+  }
+  os << "        .text" << endl;
+  for (const auto &s : prog.get_subroutines()) asmSubroutine(s, os).write();
+}
@@ -0,0 +1,60 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+#include <ostream>
+
+#include "code.h"
+
+////////////////////////////////////////////////////////////////////
+/// Class asmCode translates a t-code program to x86-64 assembly for
+/// the GNU assembler (AT&T syntax). The result is a static Linux
+/// executable that needs no C library:
+///       as -o prog.o prog.s && ld -o prog prog.o
+///   - each subroutine is a function that follows the System V
+///     calling convention: the frame is linked through %rbp, the
+///     callee-saved registers are preserved and the params are
+///     passed on the stack. 'pushparam' pushes an 8-byte slot,
+///     'call' calls the function, and the callee reads and writes its
+///     params (including '_result') in place. 'popparam' pops them
+///     again, as the tVM does.
+///   - local vars are placed in the frame with 4 bytes per cell, as
+///     given by their size. They are zeroed on entry. Temporaries get
+///     an 8-byte slot each, so they can hold addresses.
+///   - a small runtime, written with Linux system calls, does the
+///     buffered I/O with the same formats as the tVM. It also reports
+///     missing returns in the same way.
+
+class asmCode {
+public:
+  /// write program 'prog' as a GNU-as x86-64 source file
+  static void write(const code &prog, std::ostream &os);
+};
@@ -0,0 +1,286 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>      // open
+#include <sys/mman.h>   // mmap, munmap
+#include <sys/stat.h>   // fstat
+#include <unistd.h>     // close
+
+#include "codeBinary.h"
+
+using namespace std;
+
+static const uint32_t KIND_SHIFT = 30;
+static const uint32_t PAYLOAD_MASK = (uint32_t(1) << KIND_SHIFT) - 1;
+
+////////////////////////////////////////////////////////////////////
+/// string table under construction while writing a program
+
+class stringTable {
+public:
+  vector<string> strs;
+  unordered_map<string, uint32_t> index;
+
+  /// index of s in the table (added if new)
+  uint32_t add(const string &s) {
+    auto it = index.find(s);
+    if (it != index.end()) return it->second;
+    index.insert(make_pair(s, uint32_t(strs.size())));
+    strs.push_back(s);
+    return strs.size()-1;
+  }
+};
+
+/// encode an operand, moving symbols to the string table
+static uint32_t encode(const operand &op, stringTable &st) {
+  if (op.kind() != operand::_SYMBOL) return op.handle();
+  return (uint32_t(operand::_SYMBOL) << KIND_SHIFT) | st.add(op.str());
+}
+
+/// write a table of 32-bit records
+template <class T>
+static void write_table(ostream &os, const vector<T> &v) {
+  if (not v.empty()) os.write(reinterpret_cast<const char *>(v.data()), v.size()*sizeof(T));
+}
+
+/// write program in binary format
+void binaryCode::write(const code &prog, std::ostream &os) {
+  stringTable st;
+  vector<subroutineEntry> subs;
+  vector<varEntry> vars;
+  vector<labelEntry> labels;
+  vector<instructionEntry> instrs;
+  vector<uint32_t> constants;
+
+  for (const auto &s : prog.get_strings()) constants.push_back(st.add(s));
+  const vector<subroutine> &psubs = prog.get_subroutines();
+  unordered_map<string, uint32_t> subIndex;
+  for (size_t i = 0; i < psubs.size(); ++i)
+    subIndex.insert(make_pair(psubs[i].get_name(), uint32_t(i)));
+
+  for (const auto &s : psubs) {
+    subroutineEntry se;
+    se.name = st.add(s.get_name());
+    se.firstParam = vars.size();
+    for (const auto &p : s.params) vars.push_back(varEntry{st.add(p.name), uint32_t(p.size)});
+    se.numParams = vars.size() - se.firstParam;
+    se.firstVar = vars.size();
+    for (const auto &v : s.vars) vars.push_back(varEntry{st.add(v.name), uint32_t(v.size)});
+    se.numVars = vars.size() - se.firstVar;
+
+    const std::map<string, size_t> &slabels = s.get_labels();
+    se.firstLabel = labels.size();
+    for (const auto &l : slabels) labels.push_back(labelEntry{st.add(l.first), uint32_t(l.second)});
+    se.numLabels = labels.size() - se.firstLabel;
+
+    se.firstInstruction = instrs.size();
+    for (const auto &i : s.get_instructions()) {
+      instructionEntry ie;
+      ie.oper = i.oper;
+      ie.arg1 = encode(i.arg1, st);
+      ie.arg2 = encode(i.arg2, st);
+      ie.arg3 = encode(i.arg3, st);
+      ie.target = NO_TARGET;
+      if (i.is_jump()) {
+        auto l = slabels.find(i.jump_label().str());
+        if (l != slabels.end()) ie.target = l->second;
+      }
+      else if (i.oper == instruction::_CALL) {
+        auto f = subIndex.find(i.arg1.str());
+        if (f != subIndex.end()) ie.target = f->second;
+      }
+      instrs.push_back(ie);
+    }
+    se.numInstructions = instrs.size() - se.firstInstruction;
+    subs.push_back(se);
+  }
+
+  vector<uint32_t> offsets;
+  string pool;
+  for (const auto &s : st.strs) {
+    offsets.push_back(pool.size());
+    pool += s;
+    pool += '\0';
+  }
+
+  header h;
+  h.magic = MAGIC;
+  h.version = VERSION;
+  h.numSubroutines = subs.size();
+  h.numVars = vars.size();
+  h.numLabels = labels.size();
+  h.numInstructions = instrs.size();
+  h.numConstants = constants.size();
+  h.numStrings = offsets.size();
+  h.poolSize = pool.size();
+
+  os.write(reinterpret_cast<const char *>(&h), sizeof(h));
+  write_table(os, subs);
+  write_table(os, vars);
+  write_table(os, labels);
+  write_table(os, instrs);
+  write_table(os, constants);
+  write_table(os, offsets);
+  os.write(pool.data(), pool.size());
+}
+
+/// check whether the given file starts like a binary t-code file
+bool binaryCode::is_binary(const std::string &filename) {
+  ifstream f(filename, ios::binary);
+  uint32_t magic = 0;
+  f.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+  return f and magic == MAGIC;
+}
+
+
+/// constructor
+binaryCode::binaryCode() : base(nullptr), length(0), hdr(nullptr), subs(nullptr), vars(nullptr),
+                           labels(nullptr), instrs(nullptr), constants(nullptr), strings(nullptr),
+                           pool(nullptr) {}
+/// destructor
+binaryCode::~binaryCode() {
+  if (base) munmap(const_cast<char *>(base), length);
+}
+
+/// check that an encoded operand refers to an existing string
+static bool valid_operand(uint32_t arg, uint32_t numStrings) {
+  return (arg >> KIND_SHIFT) != operand::_SYMBOL or (arg & PAYLOAD_MASK) < numStrings;
+}
+
+/// map a binary file in memory, and check it
+bool binaryCode::map(const std::string &filename, std::string &err) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) { err = "cannot open file " + filename; return false; }
+  struct stat st;
+  if (fstat(fd, &st) != 0 or size_t(st.st_size) < sizeof(header)) {
+    close(fd);
+    err = "not a binary t-code file";
+    return false;
+  }
+  void *m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (m == MAP_FAILED) { err = "cannot map file " + filename; return false; }
+  base = static_cast<const char *>(m);
+  length = st.st_size;
+
+  hdr = reinterpret_cast<const header *>(base);
+  if (hdr->magic != MAGIC) { err = "not a binary t-code file"; return false; }
+  if (hdr->version != VERSION) { err = "unsupported binary t-code version " + to_string(hdr->version); return false; }
+
+  uint64_t expected = sizeof(header) + uint64_t(hdr->numSubroutines)*sizeof(subroutineEntry)
+                      + uint64_t(hdr->numVars)*sizeof(varEntry) + uint64_t(hdr->numLabels)*sizeof(labelEntry)
+                      + uint64_t(hdr->numInstructions)*sizeof(instructionEntry)
+                      + uint64_t(hdr->numConstants)*sizeof(uint32_t)
+                      + uint64_t(hdr->numStrings)*sizeof(uint32_t) + hdr->poolSize;
+  if (expected != length) { err = "truncated or corrupted binary t-code file"; return false; }
+
+  const char *p = base + sizeof(header);
+  subs = reinterpret_cast<const subroutineEntry *>(p);   p += hdr->numSubroutines*sizeof(subroutineEntry);
+  vars = reinterpret_cast<const varEntry *>(p);          p += hdr->numVars*sizeof(varEntry);
+  labels = reinterpret_cast<const labelEntry *>(p);      p += hdr->numLabels*sizeof(labelEntry);
+  instrs = reinterpret_cast<const instructionEntry *>(p); p += hdr->numInstructions*sizeof(instructionEntry);
+  constants = reinterpret_cast<const uint32_t *>(p);      p += hdr->numConstants*sizeof(uint32_t);
+  strings = reinterpret_cast<const uint32_t *>(p);        p += hdr->numStrings*sizeof(uint32_t);
+  pool = p;
+
+  // all references must stay inside their tables
+  err = "corrupted binary t-code file";
+  if (hdr->poolSize > 0 and pool[hdr->poolSize-1] != '\0') return false;
+  for (uint32_t i = 0; i < hdr->numStrings; ++i)
+    if (strings[i] >= hdr->poolSize) return false;
+  for (uint32_t i = 0; i < hdr->numConstants; ++i)
+    if (constants[i] >= hdr->numStrings) return false;
+  for (uint32_t i = 0; i < hdr->numVars; ++i)
+    if (vars[i].name >= hdr->numStrings) return false;
+  for (uint32_t s = 0; s < hdr->numSubroutines; ++s) {
+    const subroutineEntry &se = subs[s];
+    if (se.name >= hdr->numStrings or
+        uint64_t(se.firstParam) + se.numParams > hdr->numVars or
+        uint64_t(se.firstVar) + se.numVars > hdr->numVars or
+        uint64_t(se.firstLabel) + se.numLabels > hdr->numLabels or
+        uint64_t(se.firstInstruction) + se.numInstructions > hdr->numInstructions) return false;
+    for (uint32_t l = se.firstLabel; l < se.firstLabel + se.numLabels; ++l)
+      if (labels[l].name >= hdr->numStrings or labels[l].pc >= se.numInstructions) return false;
+    for (uint32_t i = se.firstInstruction; i < se.firstInstruction + se.numInstructions; ++i) {
+      const instructionEntry &ie = instrs[i];
+      if (ie.oper >= instruction::_INVALID or not valid_operand(ie.arg1, hdr->numStrings) or
+          not valid_operand(ie.arg2, hdr->numStrings) or not valid_operand(ie.arg3, hdr->numStrings))
+        return false;
+      if (ie.target != NO_TARGET) {
+        if (instruction(instruction::Operation(ie.oper)).is_jump() and ie.target >= se.numInstructions) return false;
+        if (ie.oper == instruction::_CALL and ie.target >= hdr->numSubroutines) return false;
+      }
+    }
+  }
+  err = "";
+  return true;
+}
+
+/// access to the tables
+const binaryCode::header & binaryCode::get_header() const { return *hdr; }
+const binaryCode::subroutineEntry * binaryCode::get_subroutines() const { return subs; }
+const binaryCode::varEntry * binaryCode::get_vars() const { return vars; }
+const binaryCode::labelEntry * binaryCode::get_labels() const { return labels; }
+const binaryCode::instructionEntry * binaryCode::get_instructions() const { return instrs; }
+const char * binaryCode::get_string(std::uint32_t i) const { return pool + strings[i]; }
+const char * binaryCode::get_constant(std::uint32_t i) const { return get_string(constants[i]); }
+
+/// text of an encoded operand
+std::string binaryCode::get_operand_text(std::uint32_t arg) const {
+  uint32_t payload = arg & PAYLOAD_MASK;
+  switch (arg >> KIND_SHIFT) {
+  case operand::_SYMBOL : return get_string(payload);
+  case operand::_TEMP : return "%" + to_string(payload);
+  case operand::_INTEGER : return to_string(payload);
+  default : return "";
+  }
+}
+
+/// rebuild the program as a 'code' object
+code binaryCode::to_code() const {
+  code prog;
+  for (uint32_t i = 0; i < hdr->numConstants; ++i) prog.add_string(get_constant(i));
+  for (uint32_t s = 0; s < hdr->numSubroutines; ++s) {
+    const subroutineEntry &se = subs[s];
+    subroutine subr(get_string(se.name));
+    for (uint32_t p = se.firstParam; p < se.firstParam + se.numParams; ++p)
+      subr.add_param(get_string(vars[p].name));
+    for (uint32_t v = se.firstVar; v < se.firstVar + se.numVars; ++v)
+      subr.add_var(get_string(vars[v].name), vars[v].size);
+    for (uint32_t i = se.firstInstruction; i < se.firstInstruction + se.numInstructions; ++i)
+      subr.add_instruction(instruction(instruction::Operation(instrs[i].oper), get_operand_text(instrs[i].arg1),
+                                       get_operand_text(instrs[i].arg2), get_operand_text(instrs[i].arg3)));
+    prog.add_subroutine(subr);
+  }
+  return prog;
+}
@@ -0,0 +1,143 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "code.h"
+
+////////////////////////////////////////////////////////////////////
+/// Class binaryCode handles the binary t-code object format, which
+/// holds the same program as the text format but can be mapped in
+/// memory and used right away, with no lexing or parsing.
+///
+/// The file is a sequence of tables of 32-bit words (in the byte order
+/// of the machine that wrote it; the magic number doubles as a byte
+/// order check), each one starting right after the previous one:
+///
+///    header                           sizes of all other tables
+///    subroutines   [numSubroutines]   ranges of vars/labels/instructions
+///    vars          [numVars]          params (size 0) and local vars
+///    labels        [numLabels]        label name and position
+///    instructions  [numInstructions]  fixed-width encoded instructions
+///    constants     [numConstants]     string table index of each string
+///                                     constant of the program
+///    strings       [numStrings]       offset of each string in the pool
+///    pool          [poolSize bytes]   NUL-terminated strings
+///
+/// Instruction operands keep the operand handle encoding (kind in the
+/// two high bits), except that the payload of a symbol is an index in
+/// the string table. Jumps and calls also carry their pre-resolved
+/// target: the position of the label, or the index of the subroutine.
+
+class binaryCode {
+public:
+  /// format identification
+  static const std::uint32_t MAGIC = 0x43425474;   // "tTBC"
+  static const std::uint32_t VERSION = 2;
+  /// target of a call to an undeclared subroutine
+  static const std::uint32_t NO_TARGET = 0xFFFFFFFF;
+
+  class header {
+  public:
+    std::uint32_t magic, version;
+    std::uint32_t numSubroutines, numVars, numLabels, numInstructions, numConstants;
+    std::uint32_t numStrings, poolSize;
+  };
+  class subroutineEntry {
+  public:
+    std::uint32_t name;
+    std::uint32_t firstParam, numParams, firstVar, numVars;
+    std::uint32_t firstLabel, numLabels, firstInstruction, numInstructions;
+  };
+  class varEntry {
+  public:
+    std::uint32_t name, size;
+  };
+  class labelEntry {
+  public:
+    std::uint32_t name, pc;
+  };
+  class instructionEntry {
+  public:
+    std::uint32_t oper;
+    std::uint32_t arg1, arg2, arg3;
+    std::uint32_t target;
+  };
+
+  /// write program 'prog' in binary format
+  static void write(const code &prog, std::ostream &os);
+  /// check whether the given file starts like a binary t-code file
+  static bool is_binary(const std::string &filename);
+
+  /// constructor and destructor (unmaps the file, if any)
+  binaryCode();
+  ~binaryCode();
+
+  /// map a binary t-code file in memory and check its tables are
+  /// consistent. On failure, returns false and sets 'err'
+  bool map(const std::string &filename, std::string &err);
+
+  /// access to the tables of the mapped file
+  const header & get_header() const;
+  const subroutineEntry * get_subroutines() const;
+  const varEntry * get_vars() const;
+  const labelEntry * get_labels() const;
+  const instructionEntry * get_instructions() const;
+  /// string with the given index in the string table
+  const char * get_string(std::uint32_t i) const;
+  /// string constant with the given index
+  const char * get_constant(std::uint32_t i) const;
+  /// text of an encoded operand
+  std::string get_operand_text(std::uint32_t arg) const;
+
+  /// rebuild the program as a 'code' object
+  code to_code() const;
+
+private:
+  /// mapped file
+  const char *base;
+  std::size_t length;
+  /// position of each table in the mapped file
+  const header *hdr;
+  const subroutineEntry *subs;
+  const varEntry *vars;
+  const labelEntry *labels;
+  const instructionEntry *instrs;
+  const std::uint32_t *constants;
+  const std::uint32_t *strings;
+  const char *pool;
+
+  /// no copies: the object owns the mapping
+  binaryCode(const binaryCode &);
+  binaryCode & operator=(const binaryCode &);
+};
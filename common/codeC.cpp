@@ -0,0 +1,361 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "codeC.h"
+
+using namespace std;
+
+/// runtime support included in every translated program
+static const char *PRELUDE =
+  "#include <stdio.h>\n"
+  "#include <stdlib.h>\n"
+  "#include <stdint.h>\n"
+  "#include <string.h>\n"
+  "\n"
+  "typedef union word { int32_t i; float f; union word *p; } word;\n"
+  "\n"
+  "#define STACK_SIZE (1 << 20)\n"
+  "static word stack_[STACK_SIZE];\n"
+  "static size_t sp_ = 0;\n"
+  "\n"
+  "/* integer arithmetic wraps around, as in the tVM */\n"
+  "#define ADD_(a, b) ((int32_t)((uint32_t)(a) + (uint32_t)(b)))\n"
+  "#define SUB_(a, b) ((int32_t)((uint32_t)(a) - (uint32_t)(b)))\n"
+  "#define MUL_(a, b) ((int32_t)((uint32_t)(a) * (uint32_t)(b)))\n"
+  "#define NEG_(a) ((int32_t)(0u - (uint32_t)(a)))\n"
+  "\n"
+  "static inline void crash_(const char *msg) {\n"
+  "  fflush(stdout);\n"
+  "  fprintf(stderr, \"VM_CRASH: %s\\n\", msg);\n"
+  "  exit(1);\n"
+  "}\n"
+  "/* as in the tVM, INT_MIN / -1 fails too (it does not fit) */\n"
+  "static inline int32_t DIV_(int32_t a, int32_t b) {\n"
+  "  if (b == 0 || (b == -1 && a == INT32_MIN)) crash_(\"Division by zero.\");\n"
+  "  return a / b;\n"
+  "}\n"
+  "static inline void push_(word w) {\n"
+  "  if (sp_ == STACK_SIZE) crash_(\"Stack overflow.\");\n"
+  "  stack_[sp_++] = w;\n"
+  "}\n"
+  "static inline word pop_(void) {\n"
+  "  if (sp_ == 0) crash_(\"Stack underflow.\");\n"
+  "  return stack_[--sp_];\n"
+  "}\n"
+  "static inline void popn_(size_t n) {\n"
+  "  if (sp_ < n) crash_(\"Stack underflow.\");\n"
+  "  sp_ -= n;\n"
+  "}\n"
+  "static inline word *params_(size_t n) {\n"
+  "  if (sp_ < n) crash_(\"Invalid memory reference.\");\n"
+  "  return stack_ + sp_ - n;\n"
+  "}\n"
+  "static inline word readi_(void) {\n"
+  "  word w;\n"
+  "  w.i = 0;\n"
+  "  if (scanf(\"%d\", &w.i) != 1) w.i = 0;\n"
+  "  return w;\n"
+  "}\n"
+  "static inline word readf_(void) {\n"
+  "  word w;\n"
+  "  w.f = 0;\n"
+  "  if (scanf(\"%f\", &w.f) != 1) w.f = 0;\n"
+  "  return w;\n"
+  "}\n"
+  "static inline word readc_(void) {\n"
+  "  char c = 0;\n"
+  "  word w;\n"
+  "  if (scanf(\" %c\", &c) != 1) c = 0;\n"
+  "  w.i = (unsigned char)c;\n"
+  "  return w;\n"
+  "}\n";
+
+/// value of a char constant, as the tVM reads it: '\n' and '\t' are
+/// the only escapes, otherwise the first character is taken
+static int char_value(const string &s) {
+  if (s == "\\n") return '\n';
+  if (s == "\\t") return '\t';
+  return s.empty() ? 0 : (unsigned char)s[0];
+}
+
+/// C string literal (with no trigraphs)
+static string c_string(const string &s) {
+  string q = "\"";
+  for (char c : s) {
+    if (c == '\n') q += "\\n";
+    else if (c == '\t') q += "\\t";
+    else if (c == '"' or c == '\\' or c == '?') q += string("\\") + c;
+    else if ((unsigned char)c < ' ' or (unsigned char)c >= 127) {
+      char oct[8];
+      snprintf(oct, sizeof(oct), "\\%03o", (unsigned char)c);
+      q += oct;
+    }
+    else q += c;
+  }
+  return q + "\"";
+}
+
+////////////////////////////////////////////////////////////////////
+/// translation of one subroutine
+
+class cSubroutine {
+public:
+  cSubroutine(const subroutine &s, ostream &os);
+  void write();
+
+private:
+  const subroutine &sub;
+  ostream &os;
+  /// position of each param, and size of each local var
+  map<string, size_t> params;
+  map<string, size_t> vars;
+
+  /// C expressions for the value of an operand (a word), and for the
+  /// address of a param or var (a word pointer)
+  string value(const operand &op) const;
+  string address(const operand &op) const;
+  /// C expressions for the first cell of an array, and for the cell
+  /// at given base + index
+  string array(const operand &base) const;
+  string element(const operand &base, const operand &index) const;
+  /// statement storing an expression into a field of an operand
+  void store(const operand &op, const string &field, const string &expr);
+  void instruction_to_c(const instruction &inst);
+};
+
+cSubroutine::cSubroutine(const subroutine &s, ostream &os) : sub(s), os(os) {
+  size_t i = 0;
+  for (const auto &p : s.params) params[p.name] = i++;
+  for (const auto &v : s.vars) vars[v.name] = v.size;
+}
+
+string cSubroutine::value(const operand &op) const {
+  if (op.is_temp()) return "t" + to_string(op.temp_number());
+  string name = op.str();
+  auto p = params.find(name);
+  if (p != params.end()) return "P[" + to_string(p->second) + "]";
+  auto v = vars.find(name);
+  if (v != vars.end() and v->second != 1) return "v_" + name + "[0]";
+  return "v_" + name;
+}
+
+string cSubroutine::address(const operand &op) const {
+  string name = op.str();
+  auto p = params.find(name);
+  if (p != params.end()) return "&P[" + to_string(p->second) + "]";
+  auto v = vars.find(name);
+  if (v != vars.end() and v->second != 1) return "v_" + name;
+  return "&v_" + name;
+}
+
+string cSubroutine::array(const operand &base) const {
+  // a temporary holds the address of the array, a name is the array
+  return base.is_temp() ? value(base) + ".p" : "(" + address(base) + ")";
+}
+
+string cSubroutine::element(const operand &base, const operand &index) const {
+  return array(base) + "[" + value(index) + ".i]";
+}
+
+void cSubroutine::store(const operand &op, const string &field, const string &expr) {
+  os << "  " << value(op) << field << " = " << expr << ";" << endl;
+}
+
+void cSubroutine::instruction_to_c(const instruction &inst) {
+  string a1 = inst.arg1.empty() ? "" : value(inst.arg1);
+  string a2 = inst.arg2.empty() ? "" : value(inst.arg2);
+  string a3 = inst.arg3.empty() ? "" : value(inst.arg3);
+  // the literal of the immediate forms, as a C constant
+  string k = inst.oper >= instruction::_FADDI ? inst.arg3.str() + "f" :
+             to_string(int32_t(strtol(inst.arg3.str().c_str(), nullptr, 10)));
+  switch (inst.oper) {
+  case instruction::_LABEL : os << " L_" << inst.arg1.str() << ": ;" << endl; break;
+  case instruction::_UJUMP : os << "  goto L_" << inst.arg1.str() << ";" << endl; break;
+  case instruction::_FJUMP : os << "  if (!" << a1 << ".i) goto L_" << inst.arg2.str() << ";" << endl; break;
+  case instruction::_FJEQ : case instruction::_FJNE : case instruction::_FJLT : case instruction::_FJLE :
+  case instruction::_FJFEQ : case instruction::_FJFNE : case instruction::_FJFLT : case instruction::_FJFLE : {
+    static const char *const cmp[] = {"==", "!=", "<", "<="};
+    bool f = inst.oper >= instruction::_FJFEQ;
+    string field = f ? ".f" : ".i";
+    os << "  if (!(" << a1 << field << " " << cmp[(inst.oper - instruction::_FJEQ) % 4] << " "
+       << a2 << field << ")) goto L_" << inst.arg3.str() << ";" << endl;
+    break;
+  }
+  case instruction::_PUSH :
+    if (inst.arg1.empty()) os << "  push_((word){0});" << endl;
+    else os << "  push_(" << a1 << ");" << endl;
+    break;
+  case instruction::_POP :
+    if (inst.arg1.empty()) os << "  (void)pop_();" << endl;
+    else store(inst.arg1, "", "pop_()");
+    break;
+  case instruction::_POPN : os << "  popn_(" << inst.arg1.str() << ");" << endl; break;
+  case instruction::_CALL :
+    os << "  f_" << inst.arg1.str() << "();" << endl;
+    if (not inst.arg2.empty()) os << "  popn_(" << inst.arg2.str() << ");" << endl;
+    break;
+  case instruction::_RETURN : os << "  return;" << endl; break;
+
+  case instruction::_ADD : store(inst.arg1, ".i", "ADD_(" + a2 + ".i, " + a3 + ".i)"); break;
+  case instruction::_SUB : store(inst.arg1, ".i", "SUB_(" + a2 + ".i, " + a3 + ".i)"); break;
+  case instruction::_MUL : store(inst.arg1, ".i", "MUL_(" + a2 + ".i, " + a3 + ".i)"); break;
+  case instruction::_DIV : store(inst.arg1, ".i", "DIV_(" + a2 + ".i, " + a3 + ".i)"); break;
+  case instruction::_EQ : store(inst.arg1, ".i", a2 + ".i == " + a3 + ".i"); break;
+  case instruction::_LT : store(inst.arg1, ".i", a2 + ".i < " + a3 + ".i"); break;
+  case instruction::_LE : store(inst.arg1, ".i", a2 + ".i <= " + a3 + ".i"); break;
+  case instruction::_NEG : store(inst.arg1, ".i", "NEG_(" + a2 + ".i)"); break;
+  case instruction::_NOT : store(inst.arg1, ".i", "!" + a2 + ".i"); break;
+  case instruction::_AND : store(inst.arg1, ".i", a2 + ".i && " + a3 + ".i"); break;
+  case instruction::_OR : store(inst.arg1, ".i", a2 + ".i || " + a3 + ".i"); break;
+  case instruction::_FLOAT : store(inst.arg1, ".f", "(float)" + a2 + ".i"); break;
+
+  case instruction::_FADD : store(inst.arg1, ".f", a2 + ".f + " + a3 + ".f"); break;
+  case instruction::_FSUB : store(inst.arg1, ".f", a2 + ".f - " + a3 + ".f"); break;
+  case instruction::_FMUL : store(inst.arg1, ".f", a2 + ".f * " + a3 + ".f"); break;
+  case instruction::_FDIV : store(inst.arg1, ".f", a2 + ".f / " + a3 + ".f"); break;
+  case instruction::_FEQ : store(inst.arg1, ".i", a2 + ".f == " + a3 + ".f"); break;
+  case instruction::_FLT : store(inst.arg1, ".i", a2 + ".f < " + a3 + ".f"); break;
+  case instruction::_FLE : store(inst.arg1, ".i", a2 + ".f <= " + a3 + ".f"); break;
+  case instruction::_FNEG : store(inst.arg1, ".f", "-" + a2 + ".f"); break;
+
+  case instruction::_ADDI : store(inst.arg1, ".i", "ADD_(" + a2 + ".i, " + k + ")"); break;
+  case instruction::_SUBI : store(inst.arg1, ".i", "SUB_(" + a2 + ".i, " + k + ")"); break;
+  case instruction::_MULI : store(inst.arg1, ".i", "MUL_(" + a2 + ".i, " + k + ")"); break;
+  case instruction::_DIVI : store(inst.arg1, ".i", "DIV_(" + a2 + ".i, " + k + ")"); break;
+  case instruction::_EQI : store(inst.arg1, ".i", a2 + ".i == " + k); break;
+  case instruction::_LTI : store(inst.arg1, ".i", a2 + ".i < " + k); break;
+  case instruction::_LEI : store(inst.arg1, ".i", a2 + ".i <= " + k); break;
+  case instruction::_GTI : store(inst.arg1, ".i", a2 + ".i > " + k); break;
+  case instruction::_GEI : store(inst.arg1, ".i", a2 + ".i >= " + k); break;
+  case instruction::_FADDI : store(inst.arg1, ".f", a2 + ".f + " + k); break;
+  case instruction::_FSUBI : store(inst.arg1, ".f", a2 + ".f - " + k); break;
+  case instruction::_FMULI : store(inst.arg1, ".f", a2 + ".f * " + k); break;
+  case instruction::_FDIVI : store(inst.arg1, ".f", a2 + ".f / " + k); break;
+  case instruction::_FEQI : store(inst.arg1, ".i", a2 + ".f == " + k); break;
+  case instruction::_FLTI : store(inst.arg1, ".i", a2 + ".f < " + k); break;
+  case instruction::_FLEI : store(inst.arg1, ".i", a2 + ".f <= " + k); break;
+  case instruction::_FGTI : store(inst.arg1, ".i", a2 + ".f > " + k); break;
+  case instruction::_FGEI : store(inst.arg1, ".i", a2 + ".f >= " + k); break;
+
+  case instruction::_LOAD : store(inst.arg1, "", a2); break;
+  case instruction::_ILOAD : store(inst.arg1, ".i", to_string(int32_t(strtol(inst.arg2.str().c_str(), nullptr, 10)))); break;
+  case instruction::_FLOAD : store(inst.arg1, ".f", inst.arg2.str() + "f"); break;
+  case instruction::_CHLOAD : store(inst.arg1, ".i", to_string(char_value(inst.arg2.str()))); break;
+  case instruction::_XLOAD : os << "  " << element(inst.arg1, inst.arg2) << " = " << a3 << ";" << endl; break;
+  case instruction::_LOADX : store(inst.arg1, "", element(inst.arg2, inst.arg3)); break;
+  case instruction::_ALOAD : store(inst.arg1, ".p", address(inst.arg2)); break;
+  case instruction::_COPYN :
+    os << "  memmove(" << array(inst.arg1) << ", " << array(inst.arg2) << ", "
+       << strtoul(inst.arg3.str().c_str(), nullptr, 10) << " * sizeof(word));" << endl;
+    break;
+  case instruction::_LOADC : store(inst.arg1, "", "*" + a2 + ".p"); break;
+  case instruction::_CLOAD : os << "  *" << a1 << ".p = " << a2 << ";" << endl; break;
+
+  case instruction::_READI : store(inst.arg1, "", "readi_()"); break;
+  case instruction::_READF : store(inst.arg1, "", "readf_()"); break;
+  case instruction::_READC : store(inst.arg1, "", "readc_()"); break;
+  case instruction::_WRITEI : os << "  printf(\"%d\", " << a1 << ".i);" << endl; break;
+  case instruction::_WRITEF : os << "  printf(\"%g\", (double)" << a1 << ".f);" << endl; break;
+  case instruction::_WRITEC : os << "  putchar((unsigned char)" << a1 << ".i);" << endl; break;
+  case instruction::_WRITELN : os << "  putchar('\\n');" << endl; break;
+  case instruction::_WRITES : os << "  fputs(strings_[" << inst.arg1.str() << "], stdout);" << endl; break;
+  case instruction::_NOOP : break;
+  default : os << "  /* invalid instruction */" << endl; break;
+  }
+}
+
+void cSubroutine::write() {
+  const vector<instruction> &insts = sub.get_instructions();
+  // only the params, vars and temporaries that are used get a C local,
+  // so that the translation compiles cleanly with -Wall
+  set<string> names;
+  vector<bool> used;
+  for (const auto &inst : insts)
+    for (const operand *op : {&inst.arg1, &inst.arg2, &inst.arg3})
+      if (op->is_temp()) {
+        if (used.size() <= op->temp_number()) used.resize(op->temp_number() + 1);
+        used[op->temp_number()] = true;
+      }
+      else if (not op->empty()) names.insert(op->str());
+  bool usesParams = false;
+  for (const auto &p : sub.params) usesParams = usesParams or names.count(p.name);
+
+  os << "static void f_" << sub.get_name() << "(void) {" << endl;
+  if (usesParams) os << "  word *P = params_(" << params.size() << ");" << endl;
+  else if (not params.empty()) os << "  (void)params_(" << params.size() << ");" << endl;
+  for (const auto &v : sub.vars) {
+    if (not names.count(v.name)) continue;
+    if (v.size == 1) os << "  word v_" << v.name << " = {0};" << endl;
+    else os << "  word v_" << v.name << "[" << v.size << "] = {{0}};" << endl;
+  }
+  string temps;
+  for (size_t t = 0; t < used.size(); ++t)
+    if (used[t]) temps += (temps.empty() ? "" : ", t") + to_string(t);
+  if (not temps.empty()) os << "  word t" << temps << ";" << endl;
+
+  for (const auto &inst : insts) instruction_to_c(inst);
+  if (insts.empty() or insts.back().oper != instruction::_RETURN)
+    os << "  crash_(\"Control reaches end of subroutine " << sub.get_name() << ". Missing 'return' ?\");" << endl;
+  os << "}" << endl << endl;
+}
+
+
+////////////////////////////////////////////////////////////////////
+/// Class cCode
+
+/// write program 'prog' as a C99 translation unit
+void cCode::write(const code &prog, std::ostream &os) {
+  os << "/* t-code program translated to C99 */" << endl << endl;
+  os << PRELUDE << endl;
+  const vector<string> &strings = prog.get_strings();
+  if (not strings.empty()) {
+    os << "static const char *const strings_[] = {" << endl;
+    for (const auto &s : strings) os << "  " << c_string(s) << "," << endl;
+    os << "};" << endl << endl;
+  }
+  const vector<subroutine> &subs = prog.get_subroutines();
+  for (const auto &s : subs) os << "static void f_" << s.get_name() << "(void);" << endl;
+  os << endl;
+  for (const auto &s : subs) cSubroutine(s, os).write();
+
+  os << "int main(void) {" << endl;
+  os << "  static char buffer[1 << 16];" << endl;
+  os << "  setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));" << endl;
+  os << "  f_main();" << endl;
+  os << "  return 0;" << endl;
+  os << "}" << endl;
+}
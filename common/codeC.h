@@ -0,0 +1,55 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include <ostream>
+
+#include "code.h"
+
+////////////////////////////////////////////////////////////////////
+/// Class cCode translates a t-code program to portable C99, so that
+/// it can be compiled to native code by any C compiler:
+///   - every cell is a 'word' (a union of int, float and pointer), so
+///     values keep the bit-level behaviour of the tVM.
+///   - local vars and temporaries become C locals, and arrays become
+///     C arrays. Addresses (as taken by '&a', and passed for array
+///     params) are C pointers.
+///   - params are passed in a stack of words, as in the tVM: the
+///     callee accesses its params (including '_result') in place, so
+///     the caller pops them with their final values.
+///   - readX/writeX use buffered stdio, with the same formats as the
+///     tVM. Stack errors and missing returns are reported as the tVM
+///     does (other errors are left to the C program).
+
+class cCode {
+public:
+  /// write program 'prog' as a C99 translation unit
+  static void write(const code &prog, std::ostream &os);
+};
@@ -0,0 +1,421 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+#include <iostream>
+#include <cctype>
+#include "codeReader.h"
+
+using namespace std;
+
+/// thrown when the input does not match the expected syntax (after
+/// the error has been reported), to resume at the next line
+class syntaxError {};
+
+/// binary operators and the instructions they build, between two
+/// addresses and with a literal as right operand (_INVALID if none)
+static const struct { const char *text; instruction::Operation oper, immediate; } BINOPS[] = {
+  {"+", instruction::_ADD, instruction::_ADDI}, {"-", instruction::_SUB, instruction::_SUBI},
+  {"*", instruction::_MUL, instruction::_MULI}, {"/", instruction::_DIV, instruction::_DIVI},
+  {"==", instruction::_EQ, instruction::_EQI}, {"<", instruction::_LT, instruction::_LTI},
+  {"<=", instruction::_LE, instruction::_LEI}, {">", instruction::_INVALID, instruction::_GTI},
+  {">=", instruction::_INVALID, instruction::_GEI},
+  {"and", instruction::_AND, instruction::_INVALID}, {"or", instruction::_OR, instruction::_INVALID},
+  {"+.", instruction::_FADD, instruction::_FADDI}, {"-.", instruction::_FSUB, instruction::_FSUBI},
+  {"*.", instruction::_FMUL, instruction::_FMULI}, {"/.", instruction::_FDIV, instruction::_FDIVI},
+  {"==.", instruction::_FEQ, instruction::_FEQI}, {"<.", instruction::_FLT, instruction::_FLTI},
+  {"<=.", instruction::_FLE, instruction::_FLEI}, {">.", instruction::_INVALID, instruction::_FGTI},
+  {">=.", instruction::_INVALID, instruction::_FGEI}
+};
+
+/// comparisons of the fused compare-and-branch ("ifFalse a < b goto L")
+static const struct { const char *text; instruction::Operation oper; } JUMPOPS[] = {
+  {"==", instruction::_FJEQ}, {"!=", instruction::_FJNE}, {"<", instruction::_FJLT}, {"<=", instruction::_FJLE},
+  {"==.", instruction::_FJFEQ}, {"!=.", instruction::_FJFNE}, {"<.", instruction::_FJFLT}, {"<=.", instruction::_FJFLE}
+};
+
+/// instructions with a single address operand
+static const struct { const char *text; instruction::Operation oper; } IOOPS[] = {
+  {"readi", instruction::_READI}, {"readf", instruction::_READF}, {"readc", instruction::_READC},
+  {"writei", instruction::_WRITEI}, {"writef", instruction::_WRITEF}, {"writec", instruction::_WRITEC}
+};
+
+
+/// constructor
+codeReader::codeReader(std::istream &is) : next(0), startLine(0), numErrors(0) { tokenize(is); }
+/// destructor
+codeReader::~codeReader() {}
+
+/// number of syntax errors
+size_t codeReader::getNumberOfSyntaxErrors() const { return numErrors; }
+
+/// split input into tokens
+void codeReader::tokenize(std::istream &is) {
+  string ln;
+  size_t nline = 0;
+  while (getline(is, ln)) {
+    ++nline;
+    size_t i = 0;
+    while (i < ln.size()) {
+      char c = ln[i];
+      if (isspace((unsigned char)c)) { ++i; continue; }
+      if (c == ';') break;
+      token t;
+      t.line = nline;
+      t.col = i;
+      size_t j = i+1;
+      if (isalpha((unsigned char)c) or c == '_') {
+        while (j < ln.size() and (isalnum((unsigned char)ln[j]) or ln[j] == '_')) ++j;
+        t.kind = _ID;
+      }
+      else if (c == '%') {
+        while (j < ln.size() and isdigit((unsigned char)ln[j])) ++j;
+        t.kind = _TEMP;
+      }
+      else if (isdigit((unsigned char)c)) {
+        while (j < ln.size() and isdigit((unsigned char)ln[j])) ++j;
+        t.kind = _INT;
+        if (j+1 < ln.size() and ln[j] == '.' and isdigit((unsigned char)ln[j+1])) {
+          j += 1;
+          while (j < ln.size() and isdigit((unsigned char)ln[j])) ++j;
+          t.kind = _FLOAT;
+        }
+      }
+      else if (c == '\'') {
+        // 'x' or '\x'
+        if (j < ln.size() and ln[j] == '\\') ++j;
+        j += 2;
+        if (j > ln.size() or ln[j-1] != '\'') {
+          cerr << "line " << nline << ":" << i << " token recognition error at: '" << ln.substr(i) << "'" << endl;
+          ++numErrors;
+          break;
+        }
+        t.kind = _CHAR;
+      }
+      else if (c == '"') {
+        // "..." with the escapes \n \t \" and \\ (the text is decoded)
+        string s;
+        while (j < ln.size() and ln[j] != '"') {
+          char d = ln[j++];
+          if (d == '\\' and j < ln.size()) {
+            d = ln[j++];
+            if (d == 'n') d = '\n';
+            else if (d == 't') d = '\t';
+            else if (d != '"' and d != '\\') { s += '\\'; --j; continue; }
+          }
+          s += d;
+        }
+        if (j == ln.size()) {
+          cerr << "line " << nline << ":" << i << " token recognition error at: '" << ln.substr(i) << "'" << endl;
+          ++numErrors;
+          break;
+        }
+        ++j;
+        t.kind = _STRING;
+        t.text = s;
+        tokens.push_back(t);
+        i = j;
+        continue;
+      }
+      else {
+        t.kind = _SYMBOL;
+        // two and three character operators: == <= >= != <. >. +. -. *. /. ==. <=. >=. !=.
+        if (j < ln.size() and ln[j] == '=' and (c == '=' or c == '<' or c == '>' or c == '!')) ++j;
+        if (j < ln.size() and ln[j] == '.' and string("+-*/<>=!").find(c) != string::npos and
+            not ((c == '=' or c == '!') and j == i+1)) ++j;
+      }
+      t.text = ln.substr(i, j-i);
+      if (t.kind == _CHAR) t.text = t.text.substr(1, t.text.size()-2);
+      tokens.push_back(t);
+      i = j;
+    }
+  }
+  token t;
+  t.kind = _END;
+  t.text = "<EOF>";
+  t.line = nline+1;
+  t.col = 0;
+  tokens.push_back(t);
+}
+
+/// next token (not consumed)
+const codeReader::token & codeReader::peek() const { return tokens[next]; }
+
+/// check next token text
+bool codeReader::at(const std::string &text) const {
+  return peek().kind != _END and peek().kind != _CHAR and peek().kind != _STRING and
+         peek().text == text;
+}
+
+/// check next token text, only if it is in the same line as the previous one
+bool codeReader::at_same_line(const std::string &text) const {
+  return next > 0 and peek().line == tokens[next-1].line and at(text);
+}
+
+/// check whether next token is an address in the same line as the previous one
+bool codeReader::at_address_same_line() const {
+  return next > 0 and peek().line == tokens[next-1].line and
+         (peek().kind == _ID or peek().kind == _TEMP);
+}
+
+/// report error at next token
+void codeReader::report(const std::string &msg) {
+  const token &t = peek();
+  cerr << "line " << t.line << ":" << t.col << " " << msg << " at '" << t.text << "'" << endl;
+  ++numErrors;
+}
+
+/// report error at next token, and skip the rest of the line where
+/// the current instruction started
+void codeReader::error(const std::string &msg) {
+  report(msg);
+  while (peek().kind != _END and peek().line == startLine) ++next;
+  throw syntaxError();
+}
+
+/// consume a token of given kind
+codeReader::token codeReader::expect(TokenKind kind, const std::string &what) {
+  if (peek().kind != kind) error("expecting " + what);
+  return tokens[next++];
+}
+
+/// consume a token with given text
+void codeReader::expect(const std::string &text) {
+  if (not at(text)) error("expecting '" + text + "'");
+  ++next;
+}
+
+/// consume an address (variable or temporary)
+std::string codeReader::expect_address() {
+  if (peek().kind != _ID and peek().kind != _TEMP) error("expecting {TEMP, ID}");
+  return tokens[next++].text;
+}
+
+
+/// parse the whole input
+void codeReader::read(code &prog) {
+  while (peek().kind != _END) {
+    try {
+      if (at("strings")) read_strings(prog);
+      else read_function(prog);
+    }
+    catch (syntaxError &) {
+      // skip up to the next function
+      while (peek().kind != _END and not at("function")) ++next;
+    }
+  }
+}
+
+/// parse the string constants, numbered in order
+void codeReader::read_strings(code &prog) {
+  startLine = peek().line;
+  expect("strings");
+  while (not at("endstrings")) {
+    if (peek().kind == _END or at("function")) {
+      report("missing 'endstrings'");
+      return;
+    }
+    if (peek().kind != _STRING) error("expecting STRING");
+    // a repeated one would take the number of the first
+    size_t n = prog.get_strings().size();
+    if (prog.add_string(peek().text) != n) report("repeated string");
+    ++next;
+  }
+  ++next;
+}
+
+/// parse one function
+void codeReader::read_function(code &prog) {
+  startLine = peek().line;
+  expect("function");
+  subroutine subr(expect(_ID, "function name").text);
+
+  if (at("params")) {
+    ++next;
+    while (not at("endparams")) subr.add_param(expect(_ID, "parameter name").text);
+    ++next;
+  }
+  if (at("vars")) {
+    ++next;
+    while (not at("endvars")) {
+      string name = expect(_ID, "variable name").text;
+      subr.add_var(name, stoul(expect(_INT, "variable size").text));
+    }
+    ++next;
+  }
+
+  while (not at("endfunction")) {
+    if (peek().kind == _END or at("function")) {
+      report("missing 'endfunction'");
+      return;
+    }
+    try {
+      read_instruction(subr);
+    }
+    catch (syntaxError &) {
+      // line already skipped, go on with the next instruction
+    }
+  }
+  ++next;
+  prog.add_subroutine(subr);
+}
+
+/// parse one instruction, and add it to the subroutine
+void codeReader::read_instruction(subroutine &subr) {
+  const token &t = peek();
+  startLine = t.line;
+  if (t.kind == _ID and t.text == "label") {
+    ++next;
+    string lab = expect(_ID, "label name").text;
+    expect(":");
+    subr.add_instruction(instruction::LABEL(lab));
+    return;
+  }
+  if (t.kind == _ID and t.text == "goto") {
+    ++next;
+    subr.add_instruction(instruction::UJUMP(expect(_ID, "label name").text));
+    return;
+  }
+  if (t.kind == _ID and t.text == "ifFalse") {
+    ++next;
+    string cond = expect_address();
+    for (auto &op : JUMPOPS)
+      if (at_same_line(op.text)) {   // ifFalse a1 <op> a2 goto a3
+        ++next;
+        string a2 = expect_address();
+        expect("goto");
+        subr.add_instruction(instruction(op.oper, cond, a2, expect(_ID, "label name").text));
+        return;
+      }
+    expect("goto");
+    subr.add_instruction(instruction::FJUMP(cond, expect(_ID, "label name").text));
+    return;
+  }
+  if (t.kind == _ID and (t.text == "pushparam" or t.text == "popparam")) {
+    bool push = (t.text == "pushparam");
+    ++next;
+    string addr;
+    if (at_address_same_line()) addr = expect_address();
+    subr.add_instruction(push ? instruction::PUSH(addr) : instruction::POP(addr));
+    return;
+  }
+  if (t.kind == _ID and t.text == "call") {   // call f [k]
+    ++next;
+    string f = expect(_ID, "subroutine name").text;
+    string k;
+    if (peek().kind == _INT and peek().line == tokens[next-1].line) k = expect(_INT, "INT").text;
+    subr.add_instruction(instruction::CALL(f, k));
+    return;
+  }
+  if (t.kind == _ID and t.text == "popn") {
+    ++next;
+    subr.add_instruction(instruction::POPN(expect(_INT, "INT").text));
+    return;
+  }
+  if (t.kind == _ID and (t.text == "return" or t.text == "writeln" or t.text == "noop")) {
+    ++next;
+    subr.add_instruction(t.text == "return" ? instruction::RETURN() :
+                         t.text == "writeln" ? instruction::WRITELN() : instruction::NOOP());
+    return;
+  }
+  if (t.kind == _ID and t.text == "writes") {
+    ++next;
+    subr.add_instruction(instruction::WRITES(expect(_INT, "INT").text));
+    return;
+  }
+  if (t.kind == _ID and t.text == "copyn") {   // copyn a1 a2 k
+    ++next;
+    string a1 = expect_address();
+    string a2 = expect_address();
+    subr.add_instruction(instruction::COPYN(a1, a2, expect(_INT, "INT").text));
+    return;
+  }
+  if (t.kind == _ID) {
+    for (auto &op : IOOPS)
+      if (t.text == op.text) {
+        ++next;
+        subr.add_instruction(instruction(op.oper, expect_address()));
+        return;
+      }
+  }
+  if (at("*")) {   // *a1 = a2
+    ++next;
+    string a1 = expect_address();
+    expect("=");
+    subr.add_instruction(instruction::CLOAD(a1, expect_address()));
+    return;
+  }
+
+  string dst = expect_address();
+  if (at("[")) {   // a1[a2] = a3
+    ++next;
+    string idx = expect_address();
+    expect("]");
+    expect("=");
+    subr.add_instruction(instruction::XLOAD(dst, idx, expect_address()));
+    return;
+  }
+  expect("=");
+  subr.add_instruction(read_assignment(dst));
+}
+
+/// parse the right hand side of "dst = ..."
+instruction codeReader::read_assignment(const std::string &dst) {
+  const token &t = peek();
+  switch (t.kind) {
+  case _INT : ++next; return instruction::ILOAD(dst, t.text);
+  case _FLOAT : ++next; return instruction::FLOAD(dst, t.text);
+  case _CHAR : ++next; return instruction::CHLOAD(dst, t.text);
+  default : break;
+  }
+  if (at("&")) { ++next; return instruction::ALOAD(dst, expect_address()); }
+  if (at("*")) { ++next; return instruction::LOADC(dst, expect_address()); }
+  if (at("not")) { ++next; return instruction::NOT(dst, expect_address()); }
+  if (at("float")) { ++next; return instruction::FLOAT(dst, expect_address()); }
+  if (at("-")) { ++next; return instruction::NEG(dst, expect_address()); }
+  if (at("-.")) { ++next; return instruction::FNEG(dst, expect_address()); }
+
+  string a2 = expect_address();
+  if (at_same_line("[")) {   // a1 = a2[a3]
+    ++next;
+    string idx = expect_address();
+    expect("]");
+    return instruction::LOADX(dst, a2, idx);
+  }
+  for (auto &op : BINOPS)
+    if (at_same_line(op.text)) {
+      ++next;
+      bool isFloat = op.immediate >= instruction::_FADDI;
+      if (op.immediate != instruction::_INVALID and
+          peek().kind == (isFloat ? _FLOAT : _INT))
+        return instruction(op.immediate, dst, a2, tokens[next++].text);
+      if (op.oper == instruction::_INVALID) error(isFloat ? "expecting FLOAT" : "expecting INT");
+      return instruction(op.oper, dst, a2, expect_address());
+    }
+  return instruction::LOAD(dst, a2);
+}
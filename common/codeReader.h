@@ -0,0 +1,97 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "code.h"
+
+////////////////////////////////////////////////////////////////////
+/// Class codeReader parses a program in t-code text format (the
+/// format written by code::dump, and read by tvm) into a 'code'
+/// object. Comments start with ';' and extend to the end of line.
+/// Syntax errors are reported on std::cerr as "line L:C message".
+
+class codeReader {
+public:
+  /// constructor
+  codeReader(std::istream &is);
+  /// destructor
+  ~codeReader();
+
+  /// parse the whole input, adding its subroutines to 'prog'
+  void read(code &prog);
+  /// number of syntax errors found while reading
+  std::size_t getNumberOfSyntaxErrors() const;
+
+private:
+  /// kinds of token
+  typedef enum {_ID, _TEMP, _INT, _FLOAT, _CHAR, _STRING, _SYMBOL, _END} TokenKind;
+
+  /// a token, with its position in the input
+  class token {
+  public:
+    TokenKind kind;
+    std::string text;
+    std::size_t line, col;
+  };
+
+  /// input tokens, and index of the next one to be consumed
+  std::vector<token> tokens;
+  std::size_t next;
+  /// line where the instruction being parsed starts
+  std::size_t startLine;
+  /// syntax errors found so far
+  std::size_t numErrors;
+
+  /// split input into tokens
+  void tokenize(std::istream &is);
+
+  /// parse each part of the program
+  void read_strings(code &prog);
+  void read_function(code &prog);
+  void read_instruction(subroutine &subr);
+  instruction read_assignment(const std::string &dst);
+
+  /// helpers to examine and consume tokens
+  const token & peek() const;
+  bool at(const std::string &text) const;
+  bool at_same_line(const std::string &text) const;
+  bool at_address_same_line() const;
+  token expect(TokenKind kind, const std::string &what);
+  void expect(const std::string &text);
+  std::string expect_address();
+  /// report a syntax error at the next token
+  void report(const std::string &msg);
+  /// report a syntax error at the next token and skip the rest of its line
+  void error(const std::string &msg);
+};
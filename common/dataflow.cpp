@@ -0,0 +1,221 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+
+#include <algorithm>
+
+#include "dataflow.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////
+/// Operands of the instructions
+
+/// true if the instruction writes its first operand
+bool defines(const instruction &inst) {
+  switch (inst.oper) {
+  case instruction::_LABEL : case instruction::_UJUMP : case instruction::_FJUMP :
+  case instruction::_FJEQ : case instruction::_FJNE : case instruction::_FJLT :
+  case instruction::_FJLE : case instruction::_FJFEQ : case instruction::_FJFNE :
+  case instruction::_FJFLT : case instruction::_FJFLE :
+  case instruction::_PUSH : case instruction::_CALL : case instruction::_RETURN :
+  case instruction::_XLOAD : case instruction::_CLOAD : case instruction::_COPYN :
+  case instruction::_WRITEI : case instruction::_WRITEF : case instruction::_WRITEC :
+  case instruction::_WRITELN : case instruction::_WRITES : case instruction::_POPN :
+  case instruction::_NOOP : case instruction::_INVALID :
+    return false;
+  case instruction::_POP :
+    return not inst.arg1.empty();
+  default :
+    return true;
+  }
+}
+
+/// operands whose value is read by the instruction
+void used_operands(const instruction &inst, vector<const operand *> &used) {
+  used.clear();
+  switch (inst.oper) {
+  case instruction::_FJUMP : case instruction::_WRITEI : case instruction::_WRITEF :
+  case instruction::_WRITEC :
+    used.push_back(&inst.arg1);
+    break;
+  case instruction::_PUSH :
+    if (not inst.arg1.empty()) used.push_back(&inst.arg1);
+    break;
+  case instruction::_LOAD : case instruction::_NEG : case instruction::_NOT :
+  case instruction::_FLOAT : case instruction::_FNEG : case instruction::_LOADC :
+    used.push_back(&inst.arg2);
+    break;
+  case instruction::_ADDI : case instruction::_SUBI : case instruction::_MULI :
+  case instruction::_DIVI : case instruction::_EQI : case instruction::_LTI :
+  case instruction::_LEI : case instruction::_GTI : case instruction::_GEI :
+  case instruction::_FADDI : case instruction::_FSUBI : case instruction::_FMULI :
+  case instruction::_FDIVI : case instruction::_FEQI : case instruction::_FLTI :
+  case instruction::_FLEI : case instruction::_FGTI : case instruction::_FGEI :
+    // a3 is a literal
+    used.push_back(&inst.arg2);
+    break;
+  case instruction::_ALOAD :
+    // the address of a name; a temporary there would still be read
+    if (inst.arg2.is_temp()) used.push_back(&inst.arg2);
+    break;
+  case instruction::_ADD : case instruction::_SUB : case instruction::_MUL :
+  case instruction::_DIV : case instruction::_EQ : case instruction::_LT :
+  case instruction::_LE : case instruction::_AND : case instruction::_OR :
+  case instruction::_FADD : case instruction::_FSUB : case instruction::_FMUL :
+  case instruction::_FDIV : case instruction::_FEQ : case instruction::_FLT :
+  case instruction::_FLE : case instruction::_LOADX :
+    used.push_back(&inst.arg2);
+    used.push_back(&inst.arg3);
+    break;
+  case instruction::_XLOAD :
+    used.push_back(&inst.arg1);
+    used.push_back(&inst.arg2);
+    used.push_back(&inst.arg3);
+    break;
+  case instruction::_CLOAD : case instruction::_FJEQ : case instruction::_FJNE :
+  case instruction::_FJLT : case instruction::_FJLE : case instruction::_FJFEQ :
+  case instruction::_FJFNE : case instruction::_FJFLT : case instruction::_FJFLE :
+  case instruction::_COPYN :
+    // the count of COPYN is a literal
+    used.push_back(&inst.arg1);
+    used.push_back(&inst.arg2);
+    break;
+  default :
+    break;
+  }
+}
+
+/// true if the instruction accesses memory other than its operands
+bool accesses_memory(const instruction &inst) {
+  switch (inst.oper) {
+  case instruction::_XLOAD : case instruction::_LOADX : case instruction::_LOADC :
+  case instruction::_CLOAD : case instruction::_CALL : case instruction::_PUSH :
+  case instruction::_POP : case instruction::_POPN : case instruction::_COPYN :
+    return true;
+  default :
+    return false;
+  }
+}
+
+////////////////////////////////////////////////////////////////////
+/// Class tempSet
+
+tempSet::tempSet(unsigned size) : bits((size + 63) / 64, 0) {}
+
+bool tempSet::contains(unsigned t) const {
+  return t / 64 < bits.size() and (bits[t / 64] >> (t % 64)) & 1;
+}
+
+void tempSet::insert(unsigned t) {
+  if (t / 64 >= bits.size()) bits.resize(t / 64 + 1, 0);
+  bits[t / 64] |= uint64_t(1) << (t % 64);
+}
+
+void tempSet::erase(unsigned t) {
+  if (t / 64 < bits.size()) bits[t / 64] &= ~(uint64_t(1) << (t % 64));
+}
+
+/// add all the elements of another set; true if any was new
+bool tempSet::merge(const tempSet &s) {
+  if (bits.size() < s.bits.size()) bits.resize(s.bits.size(), 0);
+  bool changed = false;
+  for (size_t k = 0; k < s.bits.size(); ++k) {
+    uint64_t w = bits[k] | s.bits[k];
+    changed = changed or w != bits[k];
+    bits[k] = w;
+  }
+  return changed;
+}
+
+/// the elements, in increasing order
+void tempSet::elements(vector<unsigned> &elems) const {
+  elems.clear();
+  for (size_t k = 0; k < bits.size(); ++k)
+    for (uint64_t w = bits[k]; w != 0; w &= w - 1)
+      elems.push_back(64 * k + __builtin_ctzll(w));
+}
+
+bool tempSet::operator==(const tempSet &s) const {
+  size_t n = max(bits.size(), s.bits.size());
+  for (size_t k = 0; k < n; ++k) {
+    uint64_t a = k < bits.size() ? bits[k] : 0;
+    uint64_t b = k < s.bits.size() ? s.bits[k] : 0;
+    if (a != b) return false;
+  }
+  return true;
+}
+
+bool tempSet::operator!=(const tempSet &s) const { return not (*this == s); }
+
+////////////////////////////////////////////////////////////////////
+/// Class liveness
+
+liveness::liveness(const cfg &graph, const vector<instruction> &insts) : numTemps(0) {
+  for (const auto &inst : insts)
+    for (const operand *op : {&inst.arg1, &inst.arg2, &inst.arg3})
+      if (op->is_temp()) numTemps = max(numTemps, op->temp_number() + 1);
+  unsigned nb = graph.num_blocks();
+  in.assign(nb, tempSet(numTemps));
+  out.assign(nb, tempSet(numTemps));
+
+  // blocks in postorder (reverse of the reverse postorder), so that
+  // successors are usually seen before their predecessors
+  cfg::range rpo = graph.reverse_postorder();
+  vector<unsigned> order(rpo.begin(), rpo.end());
+  reverse(order.begin(), order.end());
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (unsigned b : order) {
+      tempSet live(numTemps);
+      for (unsigned s : graph.successors(b)) live.merge(in[s]);
+      out[b] = live;
+      const cfg::block &blk = graph.get_block(b);
+      for (size_t pc = blk.end; pc > blk.first; --pc) step_back(insts[pc - 1], live);
+      if (live != in[b]) {
+        in[b] = live;
+        changed = true;
+      }
+    }
+  }
+}
+
+unsigned liveness::num_temps() const { return numTemps; }
+const tempSet & liveness::live_in(unsigned b) const { return in[b]; }
+const tempSet & liveness::live_out(unsigned b) const { return out[b]; }
+
+/// update a set of live temporaries from after an instruction to
+/// before it: the temporary written dies, the ones read become live
+void liveness::step_back(const instruction &inst, tempSet &live) {
+  if (defines(inst) and inst.arg1.is_temp()) live.erase(inst.arg1.temp_number());
+  vector<const operand *> used;
+  used_operands(inst, used);
+  for (const operand *op : used)
+    if (op->is_temp()) live.insert(op->temp_number());
+}
@@ -0,0 +1,93 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "code.h"
+#include "cfg.h"
+
+////////////////////////////////////////////////////////////////////
+/// Operands read and written by each instruction, for the analyses
+/// of the optimization passes.
+
+/// true if the instruction writes its first operand
+bool defines(const instruction &inst);
+/// operands whose value is read by the instruction (including the
+/// temporaries holding the address of an array or cell)
+void used_operands(const instruction &inst, std::vector<const operand *> &used);
+/// true if the instruction reads or writes memory other than its
+/// operands (through an address, or in a call)
+bool accesses_memory(const instruction &inst);
+
+////////////////////////////////////////////////////////////////////
+/// Class tempSet is a set of temporaries, as a bit vector indexed by
+/// temporary number.
+
+class tempSet {
+public:
+  explicit tempSet(unsigned size = 0);
+  bool contains(unsigned t) const;
+  void insert(unsigned t);
+  void erase(unsigned t);
+  /// add all the elements of another set; true if any was new
+  bool merge(const tempSet &s);
+  /// the elements, in increasing order
+  void elements(std::vector<unsigned> &elems) const;
+  bool operator==(const tempSet &s) const;
+  bool operator!=(const tempSet &s) const;
+
+private:
+  std::vector<std::uint64_t> bits;
+};
+
+////////////////////////////////////////////////////////////////////
+/// Class liveness computes the temporaries live at the entry and exit
+/// of each block of a graph (backwards, until a fixed point).
+
+class liveness {
+public:
+  liveness(const cfg &graph, const std::vector<instruction> &insts);
+
+  /// number of temporaries (1 + highest temporary number)
+  unsigned num_temps() const;
+  /// temporaries live at the entry / exit of a block
+  const tempSet & live_in(unsigned b) const;
+  const tempSet & live_out(unsigned b) const;
+  /// update a set of live temporaries from after an instruction to
+  /// before it
+  static void step_back(const instruction &inst, tempSet &live);
+
+private:
+  unsigned numTemps;
+  std::vector<tempSet> in, out;
+};
@@ -0,0 +1,85 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "passes.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////
+/// Class cleanupPass
+
+string cleanupPass::name() const { return "cleanup"; }
+
+/// remove noops, unreachable code, jumps to the next instruction and
+/// unused labels, until nothing changes
+bool cleanupPass::run_subroutine(subroutine &s) {
+  vector<instruction> insts = s.get_instructions();
+  size_t initial = insts.size();
+  // every step only removes instructions: stop when none is removed
+  for (size_t previous = insts.size() + 1; insts.size() < previous; ) {
+    previous = insts.size();
+    vector<instruction> out;
+    out.reserve(insts.size());
+    // noops, and code after 'goto' or 'return' up to the next label
+    bool reachable = true;
+    for (const auto &inst : insts) {
+      if (inst.oper == instruction::_LABEL) reachable = true;
+      if (not reachable or inst.oper == instruction::_NOOP) continue;
+      out.push_back(inst);
+      if (inst.oper == instruction::_UJUMP or inst.oper == instruction::_RETURN)
+        reachable = false;
+    }
+    // jumps whose target is one of the labels that follow them
+    for (size_t i = 0; i < out.size(); ++i) {
+      if (out[i].oper != instruction::_UJUMP) continue;
+      for (size_t j = i + 1; j < out.size() and out[j].oper == instruction::_LABEL; ++j)
+        if (out[j].arg1 == out[i].arg1) {
+          out[i].oper = instruction::_NOOP;
+          break;
+        }
+    }
+    // labels without any jump to them
+    set<string> used;
+    for (const auto &inst : out)
+      if (inst.is_jump()) used.insert(inst.jump_label().str());
+    insts.clear();
+    for (const auto &inst : out)
+      if (inst.oper != instruction::_NOOP and
+          (inst.oper != instruction::_LABEL or used.count(inst.arg1.str())))
+        insts.push_back(inst);
+  }
+  if (insts.size() == initial) return false;
+  s.set_instructions(insts);
+  return true;
+}
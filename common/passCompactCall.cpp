@@ -0,0 +1,85 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+#include <string>
+#include <vector>
+
+#include "passes.h"
+
+using namespace std;
+
+namespace {
+
+/// true for a "popparam" that discards the value
+bool is_drop(const instruction &inst) {
+  return inst.oper == instruction::_POP and inst.arg1.empty();
+}
+
+/// fold the runs of discarding pops into the call before them, or
+/// into a "popn"; true if anything changed
+bool compact_calls(vector<instruction> &insts) {
+  vector<instruction> result;
+  bool changed = false;
+  for (size_t pc = 0; pc < insts.size(); ) {
+    instruction inst = insts[pc++];
+    bool call = inst.oper == instruction::_CALL;
+    if (not call and not is_drop(inst)) {
+      result.push_back(inst);
+      continue;
+    }
+    size_t k = call ? (inst.arg2.empty() ? 0 : inst.arg2.int_value()) : 1;
+    size_t n = 0;
+    for (; pc < insts.size() and is_drop(insts[pc]); ++pc) ++n;
+    if (call and n > 0) {
+      result.push_back(instruction::CALL(inst.arg1.str(), to_string(k + n)));
+      changed = true;
+    }
+    else if (not call and n > 0) {
+      result.push_back(instruction::POPN(to_string(k + n)));
+      changed = true;
+    }
+    else result.push_back(inst);
+  }
+  if (changed) insts.swap(result);
+  return changed;
+}
+
+}  // namespace
+
+////////////////////////////////////////////////////////////////////
+/// Class compactCallPass
+
+string compactCallPass::name() const { return "compactcall"; }
+
+bool compactCallPass::run_subroutine(subroutine &s) {
+  vector<instruction> insts = s.get_instructions();
+  if (not compact_calls(insts)) return false;
+  s.set_instructions(insts);
+  return true;
+}
@@ -0,0 +1,529 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+
+#include <set>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+
+#include "passes.h"
+#include "cfg.h"
+#include "dataflow.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////
+/// Constant values of temporaries and scalar variables
+
+namespace {
+
+/// abstract value of a location: not yet known (UNDEF, optimistic),
+/// a constant, or VARYING (not a constant)
+class value {
+public:
+  typedef enum {UNDEF, CONST, VARYING} State;
+  /// how the constant was written, to write it back in the same way
+  typedef enum {INT, FLOAT, CHAR} Kind;
+  uint8_t state, kind;
+  uint32_t bits;
+
+  value() : state(UNDEF), kind(INT), bits(0) {}
+  static value undef() { return value(UNDEF, INT, 0); }
+  static value varying() { return value(VARYING, INT, 0); }
+  static value constant(Kind k, uint32_t b) { return value(CONST, k, b); }
+  bool is_const() const { return state == CONST; }
+  int32_t i() const { return int32_t(bits); }
+  float f() const { float x; memcpy(&x, &bits, sizeof(x)); return x; }
+
+  bool operator==(const value &v) const {
+    return state == v.state and (state != CONST or (kind == v.kind and bits == v.bits));
+  }
+  bool operator!=(const value &v) const { return not (*this == v); }
+  /// meet of the values coming from two paths
+  value meet(const value &v) const {
+    if (state == UNDEF) return v;
+    if (v.state == UNDEF) return *this;
+    if (*this == v) return *this;
+    return varying();
+  }
+
+private:
+  value(uint8_t s, uint8_t k, uint32_t b) : state(s), kind(k), bits(b) {}
+};
+
+value int_value(int32_t x) { return value::constant(value::INT, uint32_t(x)); }
+
+/// float results are only constant if they can be written back as a
+/// t-code literal: zero or a normal number
+value float_value(float x) {
+  int c = fpclassify(x);
+  if (c != FP_ZERO and c != FP_NORMAL) return value::varying();
+  uint32_t b;
+  memcpy(&b, &x, sizeof(b));
+  return value::constant(value::FLOAT, b);
+}
+
+/// value of a char constant, as the tVM reads it
+uint32_t char_value(const string &s) {
+  if (s == "\\n") return '\n';
+  if (s == "\\t") return '\t';
+  return s.empty() ? 0 : (unsigned char)s[0];
+}
+
+/// text of a non-negative float literal (digits.digits, as t-code
+/// has no exponents) that reads back as exactly the same float
+string float_text(float x) {
+  if (x == 0) return "0.0";
+  char buf[32];
+  for (int p = 0; p < 9; ++p) {
+    snprintf(buf, sizeof(buf), "%.*e", p, double(x));
+    if (strtof(buf, nullptr) == x) break;
+  }
+  // buf is d[.ddd]e<exp>: place the point in the digits
+  string s = buf, digits;
+  size_t e = s.find('e');
+  for (size_t k = 0; k < e; ++k)
+    if (s[k] != '.') digits += s[k];
+  long point = strtol(s.c_str() + e + 1, nullptr, 10) + 1;
+  if (point <= 0) return "0." + string(-point, '0') + digits;
+  if (point >= long(digits.size())) return digits + string(point - digits.size(), '0') + ".0";
+  return digits.substr(0, point) + "." + digits.substr(point);
+}
+
+/// result of an instruction on constant (or not) operands
+value evaluate(const instruction &inst, value a, value b) {
+  instruction::Operation op = inst.oper;
+  if (inst.is_immediate()) {
+    // as the form with two operands, on the literal (a > k is k < a)
+    static const instruction::Operation binary[] = {
+      instruction::_ADD, instruction::_SUB, instruction::_MUL, instruction::_DIV,
+      instruction::_EQ, instruction::_LT, instruction::_LE, instruction::_LT, instruction::_LE,
+      instruction::_FADD, instruction::_FSUB, instruction::_FMUL, instruction::_FDIV,
+      instruction::_FEQ, instruction::_FLT, instruction::_FLE, instruction::_FLT, instruction::_FLE
+    };
+    unsigned k = op - instruction::_ADDI;
+    string text = inst.arg3.str();
+    value lit = op >= instruction::_FADDI ? float_value(strtof(text.c_str(), nullptr))
+                                          : int_value(int32_t(strtol(text.c_str(), nullptr, 10)));
+    instruction i(binary[k]);
+    return k % 9 >= 7 ? evaluate(i, lit, a) : evaluate(i, a, lit);
+  }
+  switch (op) {
+  case instruction::_ILOAD :
+    return int_value(int32_t(strtol(inst.arg2.str().c_str(), nullptr, 10)));
+  case instruction::_FLOAD : {
+    uint32_t bits;
+    float x = strtof(inst.arg2.str().c_str(), nullptr);
+    memcpy(&bits, &x, sizeof(bits));
+    return value::constant(value::FLOAT, bits);
+  }
+  case instruction::_CHLOAD :
+    return value::constant(value::CHAR, char_value(inst.arg2.str()));
+  case instruction::_LOAD :
+    return a;
+  case instruction::_NEG : case instruction::_NOT :
+  case instruction::_FLOAT : case instruction::_FNEG :
+    b = int_value(0);
+    break;
+  case instruction::_ADD : case instruction::_SUB : case instruction::_MUL :
+  case instruction::_DIV : case instruction::_EQ : case instruction::_LT :
+  case instruction::_LE : case instruction::_AND : case instruction::_OR :
+  case instruction::_FADD : case instruction::_FSUB : case instruction::_FMUL :
+  case instruction::_FDIV : case instruction::_FEQ : case instruction::_FLT :
+  case instruction::_FLE :
+    break;
+  default :
+    return value::varying();
+  }
+  if (a.state == value::VARYING or b.state == value::VARYING) return value::varying();
+  if (a.state == value::UNDEF or b.state == value::UNDEF) return value::undef();
+
+  uint32_t x = a.bits, y = b.bits;
+  switch (op) {
+  case instruction::_ADD : return int_value(int32_t(x + y));
+  case instruction::_SUB : return int_value(int32_t(x - y));
+  case instruction::_MUL : return int_value(int32_t(x * y));
+  case instruction::_DIV :
+    // division by zero (or overflowing) is left to run time
+    if (y == 0 or (a.i() == INT32_MIN and b.i() == -1)) return value::varying();
+    return int_value(a.i() / b.i());
+  case instruction::_EQ : return int_value(x == y);
+  case instruction::_LT : return int_value(a.i() < b.i());
+  case instruction::_LE : return int_value(a.i() <= b.i());
+  case instruction::_AND : return int_value(x and y);
+  case instruction::_OR : return int_value(x or y);
+  case instruction::_NOT : return int_value(not x);
+  case instruction::_NEG : return int_value(int32_t(0u - x));
+  case instruction::_FLOAT : return float_value(float(a.i()));
+  case instruction::_FADD : return float_value(a.f() + b.f());
+  case instruction::_FSUB : return float_value(a.f() - b.f());
+  case instruction::_FMUL : return float_value(a.f() * b.f());
+  case instruction::_FDIV : return float_value(a.f() / b.f());
+  case instruction::_FEQ : return int_value(a.f() == b.f());
+  case instruction::_FLT : return int_value(a.f() < b.f());
+  case instruction::_FLE : return int_value(a.f() <= b.f());
+  case instruction::_FNEG : return float_value(-a.f());
+  default : return value::varying();
+  }
+}
+
+/// operands read by an instruction as values (not as addresses)
+void value_operands(const instruction &inst, const operand *&a, const operand *&b) {
+  a = b = nullptr;
+  switch (inst.oper) {
+  case instruction::_LOAD : case instruction::_NEG : case instruction::_NOT :
+  case instruction::_FLOAT : case instruction::_FNEG :
+  case instruction::_ADDI : case instruction::_SUBI : case instruction::_MULI :
+  case instruction::_DIVI : case instruction::_EQI : case instruction::_LTI :
+  case instruction::_LEI : case instruction::_GTI : case instruction::_GEI :
+  case instruction::_FADDI : case instruction::_FSUBI : case instruction::_FMULI :
+  case instruction::_FDIVI : case instruction::_FEQI : case instruction::_FLTI :
+  case instruction::_FLEI : case instruction::_FGTI : case instruction::_FGEI :
+    a = &inst.arg2;
+    break;
+  case instruction::_ADD : case instruction::_SUB : case instruction::_MUL :
+  case instruction::_DIV : case instruction::_EQ : case instruction::_LT :
+  case instruction::_LE : case instruction::_AND : case instruction::_OR :
+  case instruction::_FADD : case instruction::_FSUB : case instruction::_FMUL :
+  case instruction::_FDIV : case instruction::_FEQ : case instruction::_FLT :
+  case instruction::_FLE :
+    a = &inst.arg2;
+    b = &inst.arg3;
+    break;
+  case instruction::_FJUMP :
+    a = &inst.arg1;
+    break;
+  case instruction::_FJEQ : case instruction::_FJNE : case instruction::_FJLT :
+  case instruction::_FJLE : case instruction::_FJFEQ : case instruction::_FJFNE :
+  case instruction::_FJFLT : case instruction::_FJFLE :
+    a = &inst.arg1;
+    b = &inst.arg2;
+    break;
+  default :
+    break;
+  }
+}
+
+/// condition of a conditional jump (it jumps when it is false)
+value condition(const instruction &inst, value a, value b) {
+  static const instruction::Operation compare[] = {
+    instruction::_EQ, instruction::_EQ, instruction::_LT, instruction::_LE,
+    instruction::_FEQ, instruction::_FEQ, instruction::_FLT, instruction::_FLE
+  };
+  if (inst.oper == instruction::_FJUMP) return a;
+  unsigned k = inst.oper - instruction::_FJEQ;
+  value c = evaluate(instruction(compare[k]), a, b);
+  // the != forms jump when the operands are equal
+  if (c.is_const() and k % 4 == 1) c = int_value(not c.bits);
+  return c;
+}
+
+/// instruction loading a constant into 'dst', if it can be written
+/// as a single t-code instruction (literals are never negative)
+bool constant_load(const string &dst, const value &v, instruction &inst) {
+  switch (v.kind) {
+  case value::INT :
+    if (v.i() < 0) return false;
+    inst = instruction::ILOAD(dst, to_string(v.i()));
+    return true;
+  case value::FLOAT :
+    if (signbit(v.f())) return false;
+    inst = instruction::FLOAD(dst, float_text(v.f()));
+    return true;
+  default : {
+    unsigned char c = v.bits;
+    string text;
+    if (c == '\n') text = "\\n";
+    else if (c == '\t') text = "\\t";
+    else if (c > ' ' and c < 127 and c != '\'' and c != '\\') text = string(1, c);
+    else text = "";
+    if (text.empty() or char_value(text) != v.bits)
+      inst = instruction::ILOAD(dst, to_string(v.bits));
+    else
+      inst = instruction::CHLOAD(dst, text);
+    return true;
+  }
+  }
+}
+
+////////////////////////////////////////////////////////////////////
+/// the analysis of one subroutine
+
+class constantAnalysis {
+public:
+  constantAnalysis(const subroutine &s, const vector<instruction> &insts);
+  /// rewrite the instructions; return true if anything changed
+  bool rewrite(vector<instruction> &out);
+
+private:
+  /// most locations tracked at every block entry (blocks x locations)
+  static const size_t MAX_FACTS = 1 << 22;
+
+  const subroutine &sub;
+  const vector<instruction> &insts;
+  cfg graph;
+  /// location number of each temporary and of each scalar name that
+  /// can only be accessed directly (never through its address)
+  vector<unsigned> tempLocation;
+  vector<pair<uint32_t, unsigned>> nameLocation;
+  /// temporaries with a single definition: its pc, and value
+  vector<size_t> singleDef;
+  vector<value> singleValue;
+  /// other locations are tracked by the dataflow: their number in the
+  /// state vectors, and the value at the entry of each block
+  vector<unsigned> tracked;
+  size_t numTracked;
+  bool global;
+  vector<value> entryState;
+  vector<value> in;
+
+  unsigned location(const operand &op) const;
+  value get(const operand &op, size_t pc, const vector<value> &state) const;
+  /// evaluate one instruction on a state; return the value it defines
+  value transfer(size_t pc, vector<value> &state, bool &changed);
+  void run();
+};
+
+constantAnalysis::constantAnalysis(const subroutine &s, const vector<instruction> &insts)
+  : sub(s), insts(insts), graph(insts) {
+  // names whose address is taken (or used as an array) are not tracked
+  set<string> addressed;
+  for (const auto &inst : insts) {
+    if (inst.oper == instruction::_ALOAD or inst.oper == instruction::_LOADX)
+      addressed.insert(inst.arg2.str());
+    if (inst.oper == instruction::_XLOAD) addressed.insert(inst.arg1.str());
+    if (inst.oper == instruction::_COPYN) {
+      addressed.insert(inst.arg1.str());
+      addressed.insert(inst.arg2.str());
+    }
+  }
+  unsigned n = 0;
+  vector<value> entry;
+  for (const auto &p : s.params)
+    if (not addressed.count(p.name)) {
+      nameLocation.push_back(make_pair(operand(p.name).handle(), n++));
+      entry.push_back(value::varying());
+    }
+  for (const auto &v : s.vars)
+    if (v.size == 1 and not addressed.count(v.name)) {
+      // vars start as zero in the tVM
+      nameLocation.push_back(make_pair(operand(v.name).handle(), n++));
+      entry.push_back(int_value(0));
+    }
+  sort(nameLocation.begin(), nameLocation.end());
+  for (const auto &inst : insts)
+    for (const operand *op : {&inst.arg1, &inst.arg2, &inst.arg3})
+      if (op->is_temp()) {
+        if (tempLocation.size() <= op->temp_number())
+          tempLocation.resize(op->temp_number() + 1, cfg::NONE);
+        if (tempLocation[op->temp_number()] == cfg::NONE) {
+          tempLocation[op->temp_number()] = n++;
+          // an undefined temporary is not a constant
+          entry.push_back(value::varying());
+        }
+      }
+
+  // temporaries defined once are tracked apart
+  vector<unsigned> defs(n, 0);
+  singleDef.assign(n, SIZE_MAX);
+  for (size_t pc = 0; pc < insts.size(); ++pc)
+    if (defines(insts[pc])) {
+      unsigned loc = location(insts[pc].arg1);
+      if (loc == cfg::NONE) continue;
+      ++defs[loc];
+      singleDef[loc] = pc;
+    }
+  singleValue.assign(n, value::undef());
+  tracked.assign(n, cfg::NONE);
+  numTracked = 0;
+  for (unsigned loc = 0; loc < n; ++loc) {
+    bool isTemp = loc >= nameLocation.size();
+    if (isTemp and defs[loc] == 1) continue;
+    singleDef[loc] = SIZE_MAX;
+    tracked[loc] = numTracked++;
+    entryState.push_back(entry[loc]);
+  }
+  global = size_t(graph.num_blocks()) * numTracked <= MAX_FACTS;
+  run();
+}
+
+unsigned constantAnalysis::location(const operand &op) const {
+  if (op.is_temp())
+    return op.temp_number() < tempLocation.size() ? tempLocation[op.temp_number()] : cfg::NONE;
+  auto it = lower_bound(nameLocation.begin(), nameLocation.end(), make_pair(op.handle(), 0u));
+  return it != nameLocation.end() and it->first == op.handle() ? it->second : cfg::NONE;
+}
+
+value constantAnalysis::get(const operand &op, size_t pc, const vector<value> &state) const {
+  unsigned loc = location(op);
+  if (loc == cfg::NONE) return value::varying();
+  if (tracked[loc] != cfg::NONE) return state[tracked[loc]];
+  // a single definition is only seen where it dominates the use
+  size_t def = singleDef[loc];
+  unsigned bd = graph.block_of(def), bu = graph.block_of(pc);
+  bool dominates = bd == bu ? def < pc : graph.dominates(bd, bu);
+  return dominates ? singleValue[loc] : value::varying();
+}
+
+value constantAnalysis::transfer(size_t pc, vector<value> &state, bool &changed) {
+  const instruction &inst = insts[pc];
+  if (not defines(inst)) return value::varying();
+  const operand *a, *b;
+  value_operands(inst, a, b);
+  value va = a ? get(*a, pc, state) : value::varying();
+  value vb = b ? get(*b, pc, state) : value::varying();
+  value r = evaluate(inst, va, vb);
+  unsigned loc = location(inst.arg1);
+  if (loc == cfg::NONE) return r;
+  if (tracked[loc] != cfg::NONE) state[tracked[loc]] = r;
+  else {
+    value m = singleValue[loc].meet(r);
+    if (m != singleValue[loc]) {
+      singleValue[loc] = m;
+      changed = true;
+    }
+  }
+  return r;
+}
+
+/// iterate over the blocks in reverse postorder until nothing changes
+void constantAnalysis::run() {
+  unsigned nb = graph.num_blocks();
+  if (nb == 0) return;
+  // state at the exit of each block, as computed so far
+  vector<value> out;
+  if (global) {
+    in.assign(size_t(nb) * numTracked, value::undef());
+    out.assign(size_t(nb) * numTracked, value::undef());
+  }
+  vector<value> state(numTracked);
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (unsigned b : graph.reverse_postorder()) {
+      // state at the block entry: the meet of its predecessors
+      if (not global) state.assign(numTracked, value::varying());
+      else {
+        if (b == 0) state = entryState;
+        else state.assign(numTracked, value::undef());
+        for (unsigned p : graph.predecessors(b))
+          for (size_t k = 0; k < numTracked; ++k)
+            state[k] = state[k].meet(out[size_t(p) * numTracked + k]);
+        copy(state.begin(), state.end(), in.begin() + size_t(b) * numTracked);
+      }
+      for (size_t pc = graph.get_block(b).first; pc < graph.get_block(b).end; ++pc)
+        transfer(pc, state, changed);
+      if (global)
+        for (size_t k = 0; k < numTracked; ++k)
+          if (out[size_t(b) * numTracked + k] != state[k]) {
+            out[size_t(b) * numTracked + k] = state[k];
+            changed = true;
+          }
+    }
+  }
+}
+
+/// rewrite the instructions with the constants found
+bool constantAnalysis::rewrite(vector<instruction> &out) {
+  bool changed = false;
+  out.clear();
+  out.reserve(insts.size());
+  vector<value> state;
+  for (unsigned b = 0; b < graph.num_blocks(); ++b) {
+    const cfg::block &blk = graph.get_block(b);
+    bool reachable = graph.is_reachable(b);
+    if (global and reachable) state.assign(in.begin() + size_t(b) * numTracked,
+                                           in.begin() + size_t(b + 1) * numTracked);
+    else state.assign(numTracked, value::varying());
+    for (size_t pc = blk.first; pc < blk.end; ++pc) {
+      const instruction &inst = insts[pc];
+      if (not reachable) {
+        out.push_back(inst);
+        continue;
+      }
+      if (inst.is_conditional_jump()) {
+        const operand *a, *b;
+        value_operands(inst, a, b);
+        value c = condition(inst, get(*a, pc, state),
+                            b ? get(*b, pc, state) : value::varying());
+        if (c.is_const()) {
+          // always taken: unconditional jump; never taken: removed
+          if (c.bits == 0) out.push_back(instruction::UJUMP(inst.jump_label().str()));
+          changed = true;
+          continue;
+        }
+      }
+      bool dummy = false;
+      value r = transfer(pc, state, dummy);
+      instruction folded(instruction::_NOOP);
+      bool isLiteral = inst.oper == instruction::_ILOAD or inst.oper == instruction::_FLOAD or
+                       inst.oper == instruction::_CHLOAD;
+      if (r.is_const() and not isLiteral and constant_load(inst.arg1.str(), r, folded)) {
+        out.push_back(folded);
+        changed = true;
+      }
+      else out.push_back(inst);
+    }
+  }
+  return changed;
+}
+
+}  // namespace
+
+
+////////////////////////////////////////////////////////////////////
+/// Class constPropPass
+
+string constPropPass::name() const { return "constprop"; }
+
+/// fold constants until no conditional jump is folded (each folded
+/// jump may make some path unreachable, and more values constant)
+bool constPropPass::run_subroutine(subroutine &s) {
+  bool changed = false;
+  vector<instruction> insts = s.get_instructions(), out;
+  for (bool again = true; again; ) {
+    size_t jumps = 0;
+    for (const auto &inst : insts) jumps += inst.is_conditional_jump();
+    constantAnalysis analysis(s, insts);
+    if (not analysis.rewrite(out)) break;
+    changed = true;
+    size_t left = 0;
+    for (const auto &inst : out) left += inst.is_conditional_jump();
+    again = left < jumps;
+    insts.swap(out);
+  }
+  if (changed) s.set_instructions(insts);
+  return changed;
+}
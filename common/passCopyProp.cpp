@@ -0,0 +1,237 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+
+#include <string>
+#include <vector>
+
+#include "passes.h"
+#include "cfg.h"
+#include "dataflow.h"
+
+using namespace std;
+
+namespace {
+
+/// true if the operand names a variable or a parameter
+bool is_name(const operand &op) { return op.kind() == operand::_SYMBOL; }
+
+/// true if the instruction uses the operand at position 'k' (1..3) as
+/// the address of an array or a cell, not as a value
+bool address_position(const instruction &inst, int k) {
+  switch (inst.oper) {
+  case instruction::_XLOAD : case instruction::_CLOAD : return k == 1;
+  case instruction::_COPYN : return k == 1 or k == 2;
+  case instruction::_LOADX : case instruction::_LOADC : case instruction::_ALOAD : return k == 2;
+  default : return false;
+  }
+}
+
+/// true if the instruction may change the value of name 'x' (directly,
+/// or through its address if 'x' is address-taken)
+bool may_write(const instruction &inst, const operand &x, bool addressTaken) {
+  if (defines(inst) and inst.arg1 == x) return true;
+  if ((inst.oper == instruction::_XLOAD or inst.oper == instruction::_COPYN) and
+      inst.arg1 == x) return true;
+  return addressTaken and (inst.oper == instruction::_XLOAD or
+                           inst.oper == instruction::_CLOAD or
+                           inst.oper == instruction::_COPYN or
+                           inst.oper == instruction::_CALL);
+}
+
+/// true if the instruction may read the value of 'x' (directly, or
+/// through its address if 'x' is address-taken)
+bool may_read(const instruction &inst, const operand &x, bool addressTaken) {
+  vector<const operand *> used;
+  used_operands(inst, used);
+  for (const operand *op : used)
+    if (*op == x) return true;
+  if (inst.oper == instruction::_ALOAD and inst.arg2 == x) return true;
+  return addressTaken and accesses_memory(inst);
+}
+
+/// true if the instruction can be deleted when the temporary it
+/// writes is never read. Reads have effects on the input, and integer
+/// divisions may fail at run time.
+bool removable(const instruction &inst) {
+  switch (inst.oper) {
+  case instruction::_READI : case instruction::_READF : case instruction::_READC :
+  case instruction::_DIV : case instruction::_DIVI : case instruction::_POP :
+    return false;
+  default :
+    return defines(inst);
+  }
+}
+
+////////////////////////////////////////////////////////////////////
+/// Class copyPropagation rewrites one subroutine
+
+class copyPropagation {
+public:
+  explicit copyPropagation(vector<instruction> &insts);
+  /// one round of propagation and elimination; true if anything changed
+  bool run();
+
+private:
+  vector<instruction> &insts;
+  /// names whose address is taken somewhere in the subroutine
+  vector<operand> addressTaken;
+  bool is_address_taken(const operand &x) const;
+
+  bool forward_copies(const cfg &g);
+  bool eliminate(const cfg &g);
+};
+
+copyPropagation::copyPropagation(vector<instruction> &insts) : insts(insts) {
+  for (const auto &inst : insts)
+    if (inst.oper == instruction::_ALOAD) addressTaken.push_back(inst.arg2);
+}
+
+bool copyPropagation::is_address_taken(const operand &x) const {
+  for (const auto &op : addressTaken)
+    if (op == x) return true;
+  return false;
+}
+
+/// one round of propagation and elimination
+bool copyPropagation::run() {
+  bool changed = false;
+  {
+    cfg g(insts);
+    changed = forward_copies(g);
+  }
+  cfg g(insts);
+  changed = eliminate(g) or changed;
+  return changed;
+}
+
+/// replace, in each block, the uses of a temporary that holds a copy
+/// ("%t = y") by the original, while neither of them changes
+bool copyPropagation::forward_copies(const cfg &g) {
+  bool changed = false;
+  for (unsigned b = 0; b < g.num_blocks(); ++b) {
+    const cfg::block &blk = g.get_block(b);
+    for (size_t pc = blk.first; pc < blk.end; ++pc) {
+      const instruction &copy = insts[pc];
+      if (copy.oper != instruction::_LOAD or not copy.arg1.is_temp() or
+          copy.arg1 == copy.arg2 or not (copy.arg2.is_temp() or is_name(copy.arg2)))
+        continue;
+      operand t = copy.arg1, y = copy.arg2;
+      bool taken = is_name(y) and is_address_taken(y);
+      for (size_t k = pc + 1; k < blk.end; ++k) {
+        instruction &inst = insts[k];
+        vector<const operand *> used;
+        used_operands(inst, used);
+        for (const operand *op : used) {
+          if (*op != t) continue;
+          int pos = op == &inst.arg1 ? 1 : op == &inst.arg2 ? 2 : 3;
+          // a name in an address position means the name's own storage
+          if (is_name(y) and address_position(inst, pos)) continue;
+          (pos == 1 ? inst.arg1 : pos == 2 ? inst.arg2 : inst.arg3) = y;
+          changed = true;
+        }
+        if ((defines(inst) and inst.arg1 == t) or may_write(inst, y, taken)) break;
+      }
+    }
+  }
+  return changed;
+}
+
+/// walk each block backwards with the live temporaries: delete the
+/// instructions that write a dead temporary, and fold the copies
+/// "x = %t" of a dead temporary into the instruction computing %t
+bool copyPropagation::eliminate(const cfg &g) {
+  liveness live(g, insts);
+  vector<bool> deleted(insts.size(), false);
+  bool changed = false;
+  for (unsigned b = 0; b < g.num_blocks(); ++b) {
+    const cfg::block &blk = g.get_block(b);
+    tempSet alive = live.live_out(b);
+    for (size_t pc = blk.end; pc > blk.first; --pc) {
+      instruction &inst = insts[pc - 1];
+      bool dead = defines(inst) and inst.arg1.is_temp() and
+                  not alive.contains(inst.arg1.temp_number());
+      if (dead and removable(inst)) {
+        deleted[pc - 1] = changed = true;
+        continue;
+      }
+      if (dead and inst.oper == instruction::_POP) {
+        // the value is still popped, but not stored
+        inst.arg1 = operand();
+        changed = true;
+      }
+      if (inst.oper == instruction::_LOAD and inst.arg2.is_temp() and inst.arg1 != inst.arg2 and
+          not alive.contains(inst.arg2.temp_number())) {
+        // look for the instruction computing the temporary, with no
+        // access to the destination in between
+        operand t = inst.arg2, x = inst.arg1;
+        bool taken = is_name(x) and is_address_taken(x);
+        size_t k = pc - 1;
+        while (k > blk.first) {
+          const instruction &prev = insts[--k];
+          if (deleted[k]) continue;
+          if (defines(prev) and prev.arg1 == t) {
+            // the address of a name is wider than a variable
+            if (prev.oper != instruction::_ALOAD or x.is_temp()) {
+              insts[k].arg1 = x;
+              deleted[pc - 1] = changed = true;
+            }
+            break;
+          }
+          if (may_read(prev, t, false) or may_read(prev, x, taken) or may_write(prev, x, taken)) break;
+        }
+        if (deleted[pc - 1]) continue;
+      }
+      liveness::step_back(inst, alive);
+    }
+  }
+  if (changed) {
+    vector<instruction> kept;
+    for (size_t pc = 0; pc < insts.size(); ++pc)
+      if (not deleted[pc]) kept.push_back(insts[pc]);
+    insts.swap(kept);
+  }
+  return changed;
+}
+
+}  // namespace
+
+////////////////////////////////////////////////////////////////////
+/// Class copyPropPass
+
+string copyPropPass::name() const { return "copyprop"; }
+
+bool copyPropPass::run_subroutine(subroutine &s) {
+  vector<instruction> insts = s.get_instructions();
+  copyPropagation cp(insts);
+  bool changed = false;
+  while (cp.run()) changed = true;
+  if (changed) s.set_instructions(insts);
+  return changed;
+}
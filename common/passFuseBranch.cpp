@@ -0,0 +1,117 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+
+#include <string>
+#include <vector>
+
+#include "passes.h"
+#include "cfg.h"
+#include "dataflow.h"
+
+using namespace std;
+
+namespace {
+
+/// fused jump taken when "a1 <cmp> a2" is false, and the one taken
+/// when it is true (with the operands swapped if 'swap' is set), or
+/// _INVALID if there is none: "not (a <. b)" can not be written with
+/// the float jumps, since NaN makes both false
+instruction::Operation fused(instruction::Operation cmp, bool negated, bool &swap) {
+  swap = false;
+  switch (cmp) {
+  case instruction::_EQ : return negated ? instruction::_FJNE : instruction::_FJEQ;
+  case instruction::_FEQ : return negated ? instruction::_FJFNE : instruction::_FJFEQ;
+  case instruction::_FLT : return negated ? instruction::_INVALID : instruction::_FJFLT;
+  case instruction::_FLE : return negated ? instruction::_INVALID : instruction::_FJFLE;
+  // not (a < b) is b <= a, and not (a <= b) is b < a
+  case instruction::_LT : swap = negated; return negated ? instruction::_FJLE : instruction::_FJLT;
+  case instruction::_LE : swap = negated; return negated ? instruction::_FJLT : instruction::_FJLE;
+  default : return instruction::_INVALID;
+  }
+}
+
+/// fuse the comparisons whose result is only used by the 'ifFalse'
+/// ending their block (maybe through a 'not'); true if any was fused
+bool fuse_branches(vector<instruction> &insts) {
+  cfg g(insts);
+  liveness live(g, insts);
+  vector<bool> removed(insts.size(), false);
+  bool changed = false;
+  for (unsigned b = 0; b < g.num_blocks(); ++b) {
+    const cfg::block &blk = g.get_block(b);
+    size_t last = blk.end - 1;
+    const instruction &jump = insts[last];
+    if (jump.oper != instruction::_FJUMP or not jump.arg1.is_temp()) continue;
+    const tempSet &after = live.live_out(b);
+    if (after.contains(jump.arg1.temp_number())) continue;
+    size_t pc = last;
+    operand tested = jump.arg1;
+    bool negated = false;
+    if (pc > blk.first and insts[pc-1].oper == instruction::_NOT and insts[pc-1].arg1 == tested and
+        insts[pc-1].arg2.is_temp() and not after.contains(insts[pc-1].arg2.temp_number())) {
+      --pc;
+      tested = insts[pc].arg2;
+      negated = true;
+    }
+    if (pc == blk.first or not (insts[pc-1].arg1 == tested)) continue;
+    const instruction &cmp = insts[pc-1];
+    bool swap;
+    instruction::Operation op = fused(cmp.oper, negated, swap);
+    if (op == instruction::_INVALID) continue;
+    // the fused jump goes where the comparison was, reading the same
+    // values; the temporaries it leaves unwritten are dead
+    instruction j(op, (swap ? cmp.arg3 : cmp.arg2).str(), (swap ? cmp.arg2 : cmp.arg3).str(),
+                  jump.arg2.str());
+    insts[pc-1] = j;
+    for (size_t k = pc; k <= last; ++k) removed[k] = true;
+    changed = true;
+  }
+  if (changed) {
+    vector<instruction> result;
+    for (size_t pc = 0; pc < insts.size(); ++pc)
+      if (not removed[pc]) result.push_back(insts[pc]);
+    insts.swap(result);
+  }
+  return changed;
+}
+
+}  // namespace
+
+////////////////////////////////////////////////////////////////////
+/// Class fuseBranchPass
+
+string fuseBranchPass::name() const { return "fusebranch"; }
+
+bool fuseBranchPass::run_subroutine(subroutine &s) {
+  vector<instruction> insts = s.get_instructions();
+  if (not fuse_branches(insts)) return false;
+  s.set_instructions(insts);
+  return true;
+}
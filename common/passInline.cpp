@@ -0,0 +1,291 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "passes.h"
+
+using namespace std;
+
+namespace {
+
+/// true if operand k (1..3) of the instruction is a literal or a
+/// label, and not a name or a temporary
+bool not_address(const instruction &inst, int k) {
+  switch (inst.oper) {
+  case instruction::_LABEL : case instruction::_WRITES : case instruction::_POPN :
+    return k == 1;
+  case instruction::_ILOAD : case instruction::_FLOAD : case instruction::_CHLOAD :
+    return k == 2;
+  case instruction::_COPYN :
+    return k == 3;
+  case instruction::_CALL :
+    return true;
+  default :
+    if (inst.is_jump() and &inst.jump_label() == (k == 1 ? &inst.arg1 : k == 2 ? &inst.arg2 : &inst.arg3))
+      return true;
+    return k == 3 and inst.is_immediate();
+  }
+}
+
+/// true if operand k of the instruction is used as an array (or its
+/// address is taken), so it must be a name
+bool array_use(const instruction &inst, int k) {
+  switch (inst.oper) {
+  case instruction::_XLOAD : return k == 1;
+  case instruction::_LOADX : case instruction::_ALOAD : return k == 2;
+  case instruction::_COPYN : return k == 1 or k == 2;
+  default : return false;
+  }
+}
+
+/// a call to inline: the instructions from 'first' to 'end' (not
+/// included) push the params, call, and pop them
+class callSite {
+public:
+  size_t first, call, end;
+  /// the "pushparam" of the result (if any, first) and the params
+  vector<size_t> pushes;
+  /// where the result goes ('popparam x'), if anywhere
+  operand result;
+};
+
+class inliner {
+public:
+  inliner(code &prog, unsigned limit);
+  /// inline the calls of a subroutine; number of calls inlined
+  size_t run(subroutine &s);
+  /// one round of it, with no call inside the params of another one
+  size_t run_once(subroutine &s);
+
+private:
+  code &prog;
+  unsigned limit;
+  /// the subroutines that can be inlined
+  map<string, const subroutine *> candidates;
+
+  /// whether a subroutine ends with a 'return', makes no calls, has
+  /// no arrays (of its own, or as params), and inlining a call to it
+  /// grows the code by 'limit' instructions at most (its body, less
+  /// the pushes, pops, call and return it saves)
+  bool inlinable(const subroutine &s) const;
+  /// whether the call at 'pc' passes the params as a call to 'callee'
+  /// should (the pushes and pops around it can be found)
+  bool match(const vector<instruction> &insts, size_t pc, const subroutine &callee,
+             callSite &cs) const;
+};
+
+inliner::inliner(code &p, unsigned lim) : prog(p), limit(lim) {
+  for (const auto &s : prog.get_subroutines())
+    if (s.get_name() != "main" and inlinable(s)) candidates[s.get_name()] = &s;
+}
+
+bool inliner::inlinable(const subroutine &s) const {
+  set<string> names;
+  for (const auto &p : s.params) names.insert(p.name);
+  for (const auto &v : s.vars) {
+    if (v.size != 1) return false;
+    names.insert(v.name);
+  }
+  // running past the end is an error to keep
+  const vector<instruction> &body = s.get_instructions();
+  if (body.empty() or body.back().oper != instruction::_RETURN) return false;
+  unsigned size = 0;
+  for (const auto &inst : body) {
+    if (inst.oper == instruction::_CALL or inst.oper == instruction::_PUSH or
+        inst.oper == instruction::_POP or inst.oper == instruction::_POPN) return false;
+    if (inst.oper != instruction::_LABEL and inst.oper != instruction::_RETURN) ++size;
+    const operand *ops[] = {&inst.arg1, &inst.arg2, &inst.arg3};
+    for (int k = 1; k <= 3; ++k)
+      if (array_use(inst, k) and names.count(ops[k-1]->str())) return false;
+  }
+  long growth = long(size) - long(2 * s.params.size() + 2);
+  return growth <= long(limit);
+}
+
+bool inliner::match(const vector<instruction> &insts, size_t pc, const subroutine &callee,
+                    callSite &cs) const {
+  size_t params = callee.params.size();
+  bool function = params > 0 and callee.params.front().name == "_result";
+  cs.call = pc;
+  cs.result = operand();
+  // the cells popped after the call: the params, and the result
+  // (the last one) into some place, or discarded
+  size_t popped = popped_cells(insts[pc]);
+  size_t k = pc + 1;
+  while (popped < params and k < insts.size()) {
+    const instruction &inst = insts[k];
+    if (inst.oper == instruction::_POP and not inst.arg1.empty()) {
+      if (not function or popped != params - 1) return false;
+      cs.result = inst.arg1;
+    }
+    else if (inst.oper != instruction::_POP and inst.oper != instruction::_POPN) return false;
+    popped += popped_cells(inst);
+    ++k;
+  }
+  if (popped != params) return false;
+  cs.end = k;
+
+  if (not find_pushes(insts, pc, params, cs.pushes)) return false;
+  cs.first = params > 0 ? cs.pushes[0] : pc;
+  return true;
+}
+
+size_t inliner::run(subroutine &s) {
+  size_t n = 0;
+  // every round removes some calls, and adds none
+  for (size_t k = run_once(s); k > 0; k = run_once(s)) n += k;
+  return n;
+}
+
+size_t inliner::run_once(subroutine &s) {
+  const vector<instruction> &insts = s.get_instructions();
+  vector<pair<callSite, const subroutine *>> sites;
+  for (size_t pc = 0; pc < insts.size(); ++pc) {
+    if (insts[pc].oper != instruction::_CALL) continue;
+    auto c = candidates.find(insts[pc].arg1.str());
+    callSite cs;
+    // a subroutine is never inlined into itself. A call made to
+    // compute a param of another one goes first (and the other one,
+    // in the next round)
+    if (c != candidates.end() and c->second != &s and match(insts, pc, *c->second, cs) and
+        (sites.empty() or sites.back().first.end <= cs.first)) {
+      sites.push_back(make_pair(cs, c->second));
+      pc = cs.end - 1;
+    }
+  }
+  if (sites.empty()) return 0;
+
+  unsigned nextTemp = temps_used(insts);
+  set<string> labels;
+  for (const auto &inst : insts)
+    if (inst.oper == instruction::_LABEL) labels.insert(inst.arg1.str());
+  unsigned nextPrefix = 1;
+
+  vector<instruction> result;
+  size_t pc = 0;
+  for (const auto &site : sites) {
+    const callSite &cs = site.first;
+    const subroutine &callee = *site.second;
+    const vector<instruction> &body = callee.get_instructions();
+
+    // the params, the result and the local vars of the callee become
+    // new temporaries of the caller, and its temporaries are renumbered
+    map<string, string> rename;
+    for (const auto &p : callee.params) rename[p.name] = "%" + to_string(nextTemp++);
+    for (const auto &v : callee.vars) rename[v.name] = "%" + to_string(nextTemp++);
+    unsigned tempBase = nextTemp;
+    nextTemp += temps_used(body);
+    // and its labels get a prefix of their own
+    string prefix;
+    for (bool clash = true; clash; ++nextPrefix) {
+      prefix = "inline" + to_string(nextPrefix) + "_";
+      clash = false;
+      for (const auto &inst : body)
+        if (inst.oper == instruction::_LABEL and labels.count(prefix + inst.arg1.str())) clash = true;
+      clash = clash or labels.count(prefix + "end");
+    }
+    string end = prefix + "end";
+
+    // the params are computed where they were pushed
+    for (; pc < cs.first; ++pc) result.push_back(insts[pc]);
+    auto param = callee.params.begin();
+    size_t p = 0;
+    for (; pc < cs.call; ++pc) {
+      const instruction &inst = insts[pc];
+      if (p < cs.pushes.size() and pc == cs.pushes[p]) {
+        string t = rename[(param++)->name];
+        if (inst.arg1.empty()) result.push_back(instruction::ILOAD(t, "0"));
+        else result.push_back(instruction::LOAD(t, inst.arg1.str()));
+        ++p;
+      }
+      else result.push_back(inst);
+    }
+    // the body, with the local vars zeroed as in a new activation
+    for (const auto &v : callee.vars) result.push_back(instruction::ILOAD(rename[v.name], "0"));
+    bool jumpsToEnd = false;
+    for (size_t i = 0; i < body.size(); ++i) {
+      instruction inst = body[i];
+      if (inst.oper == instruction::_RETURN) {
+        if (i + 1 < body.size()) {
+          result.push_back(instruction::UJUMP(end));
+          jumpsToEnd = true;
+        }
+        continue;
+      }
+      operand *ops[] = {&inst.arg1, &inst.arg2, &inst.arg3};
+      for (int k = 1; k <= 3; ++k) {
+        operand &op = *ops[k-1];
+        if (op.empty() or not_address(inst, k)) continue;
+        if (op.is_temp()) op = operand("%" + to_string(tempBase + op.temp_number()));
+        else if (rename.count(op.str())) op = operand(rename[op.str()]);
+      }
+      if (inst.oper == instruction::_LABEL) inst.arg1 = operand(prefix + inst.arg1.str());
+      else if (inst.is_jump()) inst.jump_label() = operand(prefix + inst.jump_label().str());
+      result.push_back(inst);
+    }
+    if (jumpsToEnd) result.push_back(instruction::LABEL(end));
+    if (not cs.result.empty())
+      result.push_back(instruction::LOAD(cs.result.str(), rename["_result"]));
+    pc = cs.end;
+  }
+  for (; pc < insts.size(); ++pc) result.push_back(insts[pc]);
+  s.set_instructions(result);
+  return sites.size();
+}
+
+}  // namespace
+
+////////////////////////////////////////////////////////////////////
+/// Class inlinePass
+
+inlinePass::inlinePass() : limit(DEFAULT_LIMIT) {}
+
+string inlinePass::name() const { return "inline"; }
+
+bool inlinePass::run(code &prog) {
+  inliner in(prog, limit);
+  bool changed = false;
+  for (auto &s : prog.get_subroutines())
+    changed = in.run(s) > 0 or changed;
+  return changed;
+}
+
+bool inlinePass::parse_option(const string &arg) {
+  if (arg.compare(0, 15, "--inline-limit=") != 0 or arg.size() == 15) return false;
+  char *rest;
+  unsigned long n = strtoul(arg.c_str() + 15, &rest, 10);
+  if (*rest != '\0') return false;
+  limit = n;
+  return true;
+}
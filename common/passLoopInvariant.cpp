@@ -0,0 +1,270 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "passes.h"
+#include "cfg.h"
+#include "dataflow.h"
+
+using namespace std;
+
+namespace {
+
+/// true if the instruction may be executed before its loop without
+/// changing anything but its destination, even when the loop body
+/// would not have run. Integer divisions may fail, and are never
+/// moved; loads from memory are handled apart.
+bool is_movable(instruction::Operation op) {
+  switch (op) {
+  case instruction::_ADD : case instruction::_SUB : case instruction::_MUL :
+  case instruction::_EQ : case instruction::_LT : case instruction::_LE :
+  case instruction::_NEG : case instruction::_NOT : case instruction::_AND :
+  case instruction::_OR : case instruction::_FLOAT : case instruction::_FADD :
+  case instruction::_FSUB : case instruction::_FMUL : case instruction::_FDIV :
+  case instruction::_FEQ : case instruction::_FLT : case instruction::_FLE :
+  case instruction::_FNEG : case instruction::_LOAD : case instruction::_ILOAD :
+  case instruction::_FLOAD : case instruction::_CHLOAD : case instruction::_ALOAD :
+  case instruction::_ADDI : case instruction::_SUBI : case instruction::_MULI :
+  case instruction::_EQI : case instruction::_LTI : case instruction::_LEI :
+  case instruction::_GTI : case instruction::_GEI : case instruction::_FADDI :
+  case instruction::_FSUBI : case instruction::_FMULI : case instruction::_FDIVI :
+  case instruction::_FEQI : case instruction::_FLTI : case instruction::_FLEI :
+  case instruction::_FGTI : case instruction::_FGEI :
+    return true;
+  default :
+    return false;
+  }
+}
+
+////////////////////////////////////////////////////////////////////
+/// Class loopMotion moves the invariant instructions of one loop of a
+/// subroutine into a preheader: a block placed just before the loop
+/// header, entered from every predecessor of the header outside the
+/// loop and from nowhere else.
+
+class loopMotion {
+public:
+  loopMotion(vector<instruction> &insts, const cfg &g, const liveness &live, unsigned l);
+  /// move the invariant instructions; false if there were none
+  bool run();
+
+private:
+  vector<instruction> &insts;
+  const cfg &g;
+  const liveness &live;
+  unsigned l;
+
+  /// number of definitions of each temporary/name inside the loop
+  vector<unsigned> tempDefs;
+  set<uint32_t> namesDefined;
+  /// the loop stores into memory or calls (so loads are not invariant,
+  /// nor the names whose address is taken)
+  bool writesMemory;
+  set<uint32_t> addressTaken;
+  /// instructions found invariant, and whether each pc is one of them
+  vector<size_t> invariant;
+  vector<bool> isInvariant;
+
+  bool is_invariant_operand(const operand &op) const;
+  bool is_invariant(size_t pc) const;
+  bool executed_every_iteration(unsigned b) const;
+  bool falls_into_header() const;
+  void build_preheader();
+};
+
+loopMotion::loopMotion(vector<instruction> &insts, const cfg &g, const liveness &live, unsigned l)
+  : insts(insts), g(g), live(live), l(l), tempDefs(live.num_temps(), 0),
+    writesMemory(false), isInvariant(insts.size(), false) {
+  for (const auto &inst : insts)
+    if (inst.oper == instruction::_ALOAD) addressTaken.insert(inst.arg2.handle());
+  for (unsigned b : g.loop_blocks(l)) {
+    const cfg::block &blk = g.get_block(b);
+    for (size_t pc = blk.first; pc < blk.end; ++pc) {
+      const instruction &inst = insts[pc];
+      if (inst.oper == instruction::_XLOAD or inst.oper == instruction::_CLOAD or
+          inst.oper == instruction::_COPYN or inst.oper == instruction::_CALL)
+        writesMemory = true;
+      if (inst.oper == instruction::_XLOAD or inst.oper == instruction::_COPYN)
+        namesDefined.insert(inst.arg1.handle());
+      if (not defines(inst)) continue;
+      if (inst.arg1.is_temp()) ++tempDefs[inst.arg1.temp_number()];
+      else namesDefined.insert(inst.arg1.handle());
+    }
+  }
+}
+
+/// true if the operand has the same value in every iteration: it is
+/// not written in the loop, or only by an invariant instruction
+bool loopMotion::is_invariant_operand(const operand &op) const {
+  if (op.is_temp()) {
+    unsigned t = op.temp_number();
+    if (tempDefs[t] == 0) return true;
+    for (size_t pc : invariant)
+      if (insts[pc].arg1 == op) return true;
+    return false;
+  }
+  if (op.kind() != operand::_SYMBOL) return true;
+  if (namesDefined.count(op.handle())) return false;
+  return not (writesMemory and addressTaken.count(op.handle()));
+}
+
+/// true if the block runs in every iteration that ends leaving the
+/// loop (it dominates all the blocks with an exit)
+bool loopMotion::executed_every_iteration(unsigned b) const {
+  for (unsigned x : g.loop_blocks(l))
+    for (unsigned s : g.successors(x))
+      if (not g.in_loop(s, l) and not g.dominates(b, x)) return false;
+  return true;
+}
+
+/// true if the instruction at 'pc' can be moved before the loop
+bool loopMotion::is_invariant(size_t pc) const {
+  const instruction &inst = insts[pc];
+  bool memoryLoad = inst.oper == instruction::_LOADX or inst.oper == instruction::_LOADC;
+  if (not (is_movable(inst.oper) or memoryLoad) or not inst.arg1.is_temp()) return false;
+  // a load must see the same memory in every iteration, and must be
+  // done anyway (an invalid address would fail in the original too)
+  if (memoryLoad and (writesMemory or not executed_every_iteration(g.block_of(pc))))
+    return false;
+  // the only definition of a temporary that has no value coming from
+  // before the loop or going out of it
+  unsigned t = inst.arg1.temp_number();
+  if (tempDefs[t] != 1 or live.live_in(g.get_loop(l).header).contains(t)) return false;
+  for (unsigned b : g.loop_blocks(l))
+    for (unsigned s : g.successors(b))
+      if (not g.in_loop(s, l) and live.live_in(s).contains(t)) return false;
+  // (the address of a name never changes)
+  vector<const operand *> used;
+  used_operands(inst, used);
+  for (const operand *op : used)
+    if (not is_invariant_operand(*op)) return false;
+  return true;
+}
+
+/// true if a block of the loop falls into the header, which would
+/// then run into the preheader
+bool loopMotion::falls_into_header() const {
+  size_t first = g.get_block(g.get_loop(l).header).first;
+  if (first == 0 or not g.in_loop(g.block_of(first - 1), l)) return false;
+  const instruction &last = insts[first - 1];
+  return last.oper != instruction::_UJUMP and last.oper != instruction::_RETURN;
+}
+
+/// move the invariant instructions
+bool loopMotion::run() {
+  // jumping over the preheader needs a label on the header
+  size_t first = g.get_block(g.get_loop(l).header).first;
+  if (falls_into_header() and insts[first].oper != instruction::_LABEL) return false;
+  // an instruction is invariant once the ones defining its operands
+  // are, so they are found (and later placed) in dependence order
+  for (bool found = true; found; ) {
+    found = false;
+    for (unsigned b : g.loop_blocks(l)) {
+      const cfg::block &blk = g.get_block(b);
+      for (size_t pc = blk.first; pc < blk.end; ++pc)
+        if (not isInvariant[pc] and is_invariant(pc)) {
+          isInvariant[pc] = found = true;
+          invariant.push_back(pc);
+        }
+    }
+  }
+  if (invariant.empty()) return false;
+  build_preheader();
+  return true;
+}
+
+/// rewrite the instructions with the invariant ones in a preheader
+void loopMotion::build_preheader() {
+  unsigned h = g.get_loop(l).header;
+  size_t first = g.get_block(h).first;
+  set<uint32_t> headerLabels;
+  for (size_t pc = first; pc < insts.size() and insts[pc].oper == instruction::_LABEL; ++pc)
+    headerLabels.insert(insts[pc].arg1.handle());
+
+  // predecessors outside the loop that jump to the header go to the
+  // preheader instead, which needs a label of its own
+  vector<size_t> retarget;
+  for (unsigned p : g.predecessors(h)) {
+    if (g.in_loop(p, l)) continue;
+    size_t last = g.get_block(p).end - 1;
+    if (insts[last].is_jump() and headerLabels.count(insts[last].jump_label().handle()))
+      retarget.push_back(last);
+  }
+  string label;
+  if (not retarget.empty()) {
+    set<string> used;
+    for (const auto &inst : insts)
+      if (inst.oper == instruction::_LABEL) used.insert(inst.arg1.str());
+    for (unsigned n = 1; label.empty() or used.count(label); ++n)
+      label = "preheader" + to_string(n);
+    for (size_t pc : retarget) {
+      instruction &j = insts[pc];
+      j.jump_label() = operand(label);
+    }
+  }
+  // a block of the loop falling into the header must now jump over
+  // the preheader
+  vector<instruction> result(insts.begin(), insts.begin() + first);
+  if (falls_into_header()) result.push_back(instruction::UJUMP(insts[first].arg1.str()));
+  if (not label.empty()) result.push_back(instruction::LABEL(label));
+  for (size_t pc : invariant) result.push_back(insts[pc]);
+  for (size_t pc = first; pc < insts.size(); ++pc)
+    if (not isInvariant[pc]) result.push_back(insts[pc]);
+  insts.swap(result);
+}
+
+}  // namespace
+
+////////////////////////////////////////////////////////////////////
+/// Class loopInvariantPass
+
+string loopInvariantPass::name() const { return "licm"; }
+
+bool loopInvariantPass::run_subroutine(subroutine &s) {
+  vector<instruction> insts = s.get_instructions();
+  bool changed = false;
+  // one loop at a time (the graph changes), innermost loops first so
+  // that what leaves a loop may leave the enclosing ones too
+  for (bool moved = true; moved; ) {
+    moved = false;
+    cfg g(insts);
+    liveness live(g, insts);
+    for (unsigned l = g.num_loops(); l-- > 0 and not moved; ) {
+      loopMotion m(insts, g, live, l);
+      moved = m.run();
+    }
+    changed = changed or moved;
+  }
+  if (changed) s.set_instructions(insts);
+  return changed;
+}
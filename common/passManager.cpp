@@ -0,0 +1,226 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <map>
+
+#include "passManager.h"
+#include "passes.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////
+/// Class pass
+
+pass::~pass() {}
+
+void pass::print_notes(ostream &) const {}
+
+bool pass::parse_option(const string &) { return false; }
+
+////////////////////////////////////////////////////////////////////
+/// Class subroutinePass
+
+/// run the pass on every subroutine of the program
+bool subroutinePass::run(code &prog) {
+  bool changed = false;
+  for (auto &s : prog.get_subroutines())
+    changed = run_subroutine(s) or changed;
+  return changed;
+}
+
+////////////////////////////////////////////////////////////////////
+/// Class passManager
+
+passManager::passManager() : level(0), report(false), stats(false) {}
+
+/// pipeline with all the standard passes
+passManager passManager::standard() {
+  passManager pm;
+  pm.add(unique_ptr<pass>(new inlinePass), 2);
+  pm.add(unique_ptr<pass>(new tailCallPass), 2);
+  pm.add(unique_ptr<pass>(new deadFunctionPass), 1);
+  pm.add(unique_ptr<pass>(new constPropPass), 1);
+  pm.add(unique_ptr<pass>(new valueNumberingPass), 1);
+  pm.add(unique_ptr<pass>(new loopInvariantPass), 2);
+  pm.add(unique_ptr<pass>(new copyPropPass), 1);
+  pm.add(unique_ptr<pass>(new cleanupPass), 1);
+  pm.add(unique_ptr<pass>(new fuseBranchPass), MAX_LEVEL + 1);
+  pm.add(unique_ptr<pass>(new compactCallPass), MAX_LEVEL + 1);
+  pm.add(unique_ptr<pass>(new tempAllocationPass), 1);
+  return pm;
+}
+
+/// append a pass to the pipeline
+void passManager::add(unique_ptr<pass> p, int lev) {
+  entry e;
+  e.p = move(p);
+  e.level = lev;
+  e.forced = -1;
+  e.seconds = 0;
+  e.before = e.after = 0;
+  e.changed = false;
+  passes.push_back(move(e));
+}
+
+/// set the optimization level
+void passManager::set_level(int lev) { level = lev; }
+
+/// enable or disable a pass by name
+bool passManager::set_enabled(const string &name, bool on) {
+  for (auto &e : passes)
+    if (e.p->name() == name) {
+      e.forced = on ? 1 : 0;
+      return true;
+    }
+  return false;
+}
+
+/// whether a pass is enabled at the current level/settings
+bool passManager::is_enabled(const string &name) const {
+  for (const auto &e : passes)
+    if (e.p->name() == name) return enabled(e);
+  return false;
+}
+
+bool passManager::enabled(const entry &e) const {
+  return e.forced >= 0 ? e.forced == 1 : e.level <= level;
+}
+
+/// print a report of the passes after running
+void passManager::set_report(bool r) { report = r; }
+
+/// print the instructions eliminated in each subroutine
+void passManager::set_stats(bool s) { stats = s; }
+
+/// handle a command-line option
+bool passManager::parse_option(const string &arg) {
+  if (arg.size() == 3 and arg[0] == '-' and arg[1] == 'O' and
+      arg[2] >= '0' and arg[2] <= '0' + MAX_LEVEL) {
+    set_level(arg[2] - '0');
+    return true;
+  }
+  if (arg.compare(0, 7, "--pass=") == 0) return set_enabled(arg.substr(7), true);
+  if (arg.compare(0, 10, "--no-pass=") == 0) return set_enabled(arg.substr(10), false);
+  if (arg == "--time-passes") {
+    set_report(true);
+    return true;
+  }
+  if (arg == "--stats") {
+    set_stats(true);
+    return true;
+  }
+  for (auto &e : passes)
+    if (e.p->parse_option(arg)) return true;
+  return false;
+}
+
+/// usage text of the options handled by parse_option
+string passManager::usage() {
+  return "[-O0|-O1|-O2] [--pass=<name>] [--no-pass=<name>] [--time-passes] [--stats] "
+         "[--inline-limit=<n>]";
+}
+
+/// run the enabled passes, in order, on the program
+void passManager::run(code &prog, ostream &os) {
+  vector<subroutineStats> st;
+  map<string, size_t> index;
+  if (stats)
+    for (const auto &s : prog.get_subroutines()) {
+      index[s.get_name()] = st.size();
+      st.push_back(subroutineStats{s.get_name(), s.get_instructions().size(),
+                                   vector<long>(passes.size(), 0)});
+    }
+
+  for (size_t k = 0; k < passes.size(); ++k) {
+    entry &e = passes[k];
+    if (not enabled(e)) continue;
+    e.before = count_instructions(prog);
+    vector<long> sizes(st.size(), 0);
+    for (const auto &s : prog.get_subroutines())
+      if (index.count(s.get_name())) sizes[index[s.get_name()]] = s.get_instructions().size();
+    auto start = chrono::steady_clock::now();
+    e.changed = e.p->run(prog);
+    auto end = chrono::steady_clock::now();
+    e.seconds = chrono::duration<double>(end - start).count();
+    e.after = count_instructions(prog);
+    // a subroutine removed by the pass has all its instructions eliminated
+    for (auto &x : st) x.eliminated[k] = sizes[index[x.name]];
+    for (const auto &s : prog.get_subroutines())
+      if (index.count(s.get_name()))
+        st[index[s.get_name()]].eliminated[k] -= s.get_instructions().size();
+  }
+  if (stats) {
+    print_stats(st, os);
+    for (const auto &e : passes)
+      if (enabled(e)) e.p->print_notes(os);
+  }
+  if (not report) return;
+
+  char line[128];
+  snprintf(line, sizeof(line), "%-20s %8s %12s %10s %10s", "pass", "enabled", "time (ms)", "before", "after");
+  os << line << endl;
+  for (const auto &e : passes) {
+    if (enabled(e))
+      snprintf(line, sizeof(line), "%-20s %8s %12.3f %10zu %10zu", e.p->name().c_str(), "yes",
+               e.seconds * 1000, e.before, e.after);
+    else
+      snprintf(line, sizeof(line), "%-20s %8s", e.p->name().c_str(), "no");
+    os << line << endl;
+  }
+}
+
+/// print the instructions eliminated by each pass in each subroutine
+void passManager::print_stats(const vector<subroutineStats> &st, ostream &os) const {
+  char line[128];
+  snprintf(line, sizeof(line), "%-20s %-20s %10s %10s", "subroutine", "pass", "eliminated", "remaining");
+  os << line << endl;
+  for (const auto &x : st) {
+    long remaining = x.generated;
+    snprintf(line, sizeof(line), "%-20s %-20s %10s %10ld", x.name.c_str(), "(generated)", "", remaining);
+    os << line << endl;
+    for (size_t k = 0; k < passes.size(); ++k) {
+      if (not enabled(passes[k])) continue;
+      remaining -= x.eliminated[k];
+      snprintf(line, sizeof(line), "%-20s %-20s %10ld %10ld", x.name.c_str(),
+               passes[k].p->name().c_str(), x.eliminated[k], remaining);
+      os << line << endl;
+    }
+  }
+}
+
+/// number of instructions in a program
+size_t count_instructions(const code &prog) {
+  size_t n = 0;
+  for (const auto &s : prog.get_subroutines()) n += s.get_instructions().size();
+  return n;
+}
@@ -0,0 +1,146 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <ostream>
+
+#include "code.h"
+
+////////////////////////////////////////////////////////////////////
+/// Class pass is an optimization (or any transformation) applied to
+/// the t-code of a program between code generation and emission.
+
+class pass {
+public:
+  virtual ~pass();
+  /// name of the pass, as used in --pass=<name> and in the reports
+  virtual std::string name() const = 0;
+  /// transform the program; return true if anything changed
+  virtual bool run(code &prog) = 0;
+  /// notes of the last run about each subroutine, printed with the
+  /// statistics (none by default)
+  virtual void print_notes(std::ostream &os) const;
+  /// handle a command-line option of the pass; false if 'arg' is not
+  /// one of them (none by default)
+  virtual bool parse_option(const std::string &arg);
+};
+
+////////////////////////////////////////////////////////////////////
+/// Class subroutinePass is a pass that transforms each subroutine
+/// independently of the others.
+
+class subroutinePass : public pass {
+public:
+  /// run the pass on every subroutine of the program
+  bool run(code &prog);
+  /// transform one subroutine; return true if anything changed
+  virtual bool run_subroutine(subroutine &s) = 0;
+};
+
+////////////////////////////////////////////////////////////////////
+/// Class passManager keeps an ordered pipeline of passes, each of
+/// them enabled from some optimization level on (-O<n>). Every pass
+/// can also be enabled or disabled by name. When running, it measures
+/// the time spent in each pass and the number of instructions of the
+/// program before and after it. At -O0 no pass is enabled, so the
+/// program is left exactly as generated.
+
+class passManager {
+public:
+  /// highest optimization level
+  static const int MAX_LEVEL = 2;
+
+  /// constructor: an empty pipeline at -O0
+  passManager();
+  /// pipeline with all the standard passes (see passes.h)
+  static passManager standard();
+
+  /// append a pass to the pipeline, enabled from level 'level' on
+  void add(std::unique_ptr<pass> p, int level);
+  /// set the optimization level
+  void set_level(int level);
+  /// enable or disable a pass by name; false if there is no such pass
+  bool set_enabled(const std::string &name, bool enabled);
+  /// whether a pass is enabled at the current level/settings
+  bool is_enabled(const std::string &name) const;
+  /// print a report of the passes (time, instruction counts) after running
+  void set_report(bool report);
+  /// print, for each subroutine, the instructions eliminated by each
+  /// pass (and the notes of the passes)
+  void set_stats(bool stats);
+
+  /// handle a command-line option: -O<n>, --pass=<name>,
+  /// --no-pass=<name>, --time-passes, --stats, or an option of some
+  /// pass. Return false if 'arg' is not one of them (or names an
+  /// unknown pass)
+  bool parse_option(const std::string &arg);
+  /// usage text of the options handled by parse_option
+  static std::string usage();
+
+  /// run the enabled passes, in order, on the program. The report
+  /// and the statistics (if requested) are written into 'os'
+  void run(code &prog, std::ostream &os);
+
+private:
+  class entry {
+  public:
+    std::unique_ptr<pass> p;
+    /// lowest level that enables the pass
+    int level;
+    /// explicit setting: -1 none, 0 disabled, 1 enabled
+    int forced;
+    /// statistics of the last run
+    double seconds;
+    std::size_t before, after;
+    bool changed;
+  };
+  std::vector<entry> passes;
+  int level;
+  bool report, stats;
+
+  /// instructions of a subroutine before the passes, and the ones
+  /// eliminated by each pass (negative if it added some)
+  class subroutineStats {
+  public:
+    std::string name;
+    std::size_t generated;
+    std::vector<long> eliminated;
+  };
+
+  bool enabled(const entry &e) const;
+  void print_stats(const std::vector<subroutineStats> &st, std::ostream &os) const;
+};
+
+/// number of instructions in a program
+std::size_t count_instructions(const code &prog);
@@ -0,0 +1,204 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "passes.h"
+
+using namespace std;
+
+namespace {
+
+/// a self call in tail position: the instructions from 'first' to
+/// 'end' (not included) push the params, call, and store the result
+class tailCall {
+public:
+  size_t first, call, end;
+  /// the "pushparam" of each param (and of the result, if any, first)
+  vector<size_t> pushes;
+};
+
+class tailCallElimination {
+public:
+  explicit tailCallElimination(subroutine &s);
+  /// why the subroutine can not be transformed, if so
+  string unsuitable() const;
+  /// rewrite the self calls in tail position; number of them
+  size_t run();
+
+private:
+  subroutine &s;
+  const vector<instruction> &insts;
+  bool function;
+  vector<string> params;
+
+  /// whether the code from pc on gets to a 'return' with nothing
+  /// else than labels and 'goto' on the way
+  bool reaches_return(size_t pc) const;
+  /// whether the call at 'pc' is a self call in tail position
+  bool match(size_t pc, tailCall &tc) const;
+};
+
+tailCallElimination::tailCallElimination(subroutine &sub) :
+  s(sub), insts(sub.get_instructions()), function(false) {
+  for (const auto &p : s.params) {
+    if (p.name == "_result") function = true;
+    else params.push_back(p.name);
+  }
+}
+
+string tailCallElimination::unsuitable() const {
+  // a new activation would have them zeroed: clearing an array is
+  // not worth it
+  for (const auto &v : s.vars)
+    if (v.size != 1) return "local array " + v.name;
+  return "";
+}
+
+bool tailCallElimination::reaches_return(size_t pc) const {
+  set<size_t> seen;
+  while (pc < insts.size() and seen.insert(pc).second) {
+    const instruction &inst = insts[pc];
+    if (inst.oper == instruction::_RETURN) return true;
+    if (inst.oper == instruction::_LABEL) ++pc;
+    else if (inst.oper == instruction::_UJUMP) {
+      auto l = s.get_labels().find(inst.arg1.str());
+      if (l == s.get_labels().end()) return false;
+      pc = l->second;
+    }
+    else return false;
+  }
+  return false;
+}
+
+bool tailCallElimination::match(size_t pc, tailCall &tc) const {
+  tc.call = pc;
+  // the params are popped, and then the result is stored
+  size_t popped = popped_cells(insts[pc]);
+  size_t k = pc + 1;
+  for (; k < insts.size() and (insts[k].oper == instruction::_POPN or
+                               (insts[k].oper == instruction::_POP and insts[k].arg1.empty())); ++k)
+    popped += popped_cells(insts[k]);
+  if (popped != params.size()) return false;
+  if (function) {
+    if (k == insts.size() or insts[k].oper != instruction::_POP) return false;
+    const operand &r = insts[k++].arg1;
+    if (r.is_temp()) {
+      if (k == insts.size() or insts[k].oper != instruction::_LOAD or
+          insts[k].arg1.str() != "_result" or not (insts[k].arg2 == r)) return false;
+      ++k;
+    }
+    else if (r.str() != "_result") return false;
+  }
+  tc.end = k;
+  if (not reaches_return(k)) return false;
+
+  if (not find_pushes(insts, pc, params.size() + (function ? 1 : 0), tc.pushes)) return false;
+  if (function and not insts[tc.pushes[0]].arg1.empty()) return false;
+  tc.first = tc.pushes.empty() ? pc : tc.pushes[0];
+  return true;
+}
+
+size_t tailCallElimination::run() {
+  vector<tailCall> calls;
+  for (size_t pc = 0; pc < insts.size(); ++pc) {
+    tailCall tc;
+    if (insts[pc].oper == instruction::_CALL and insts[pc].arg1.str() == s.get_name() and
+        match(pc, tc))
+      calls.push_back(tc);
+  }
+  if (calls.empty()) return 0;
+
+  unsigned nextTemp = temps_used(insts);
+  set<string> labels;
+  for (const auto &inst : insts)
+    if (inst.oper == instruction::_LABEL) labels.insert(inst.arg1.str());
+  string entry;
+  for (unsigned n = 1; entry.empty() or labels.count(entry); ++n)
+    entry = "tailcall" + to_string(n);
+
+  // the params are computed into new temporaries where they were
+  // pushed, and set all together before jumping back to the entry.
+  // The result and the local vars are zeroed, as in a new activation
+  vector<instruction> result;
+  result.push_back(instruction::LABEL(entry));
+  size_t pc = 0;
+  for (const auto &tc : calls) {
+    for (; pc < tc.first; ++pc) result.push_back(insts[pc]);
+    vector<string> temps;
+    size_t p = function ? 1 : 0;
+    for (; pc < tc.call; ++pc) {
+      const instruction &inst = insts[pc];
+      if (p < tc.pushes.size() and pc == tc.pushes[p]) {
+        temps.push_back("%" + to_string(nextTemp++));
+        if (inst.arg1.empty()) result.push_back(instruction::ILOAD(temps.back(), "0"));
+        else result.push_back(instruction::LOAD(temps.back(), inst.arg1.str()));
+        ++p;
+      }
+      else if (not (function and pc == tc.pushes[0])) result.push_back(inst);
+    }
+    for (size_t i = 0; i < params.size(); ++i) result.push_back(instruction::LOAD(params[i], temps[i]));
+    if (function) result.push_back(instruction::ILOAD("_result", "0"));
+    for (const auto &v : s.vars) result.push_back(instruction::ILOAD(v.name, "0"));
+    result.push_back(instruction::UJUMP(entry));
+    pc = tc.end;
+  }
+  for (; pc < insts.size(); ++pc) result.push_back(insts[pc]);
+  s.set_instructions(result);
+  return calls.size();
+}
+
+}  // namespace
+
+////////////////////////////////////////////////////////////////////
+/// Class tailCallPass
+
+string tailCallPass::name() const { return "tailcall"; }
+
+bool tailCallPass::run(code &prog) {
+  notes.clear();
+  return subroutinePass::run(prog);
+}
+
+bool tailCallPass::run_subroutine(subroutine &s) {
+  tailCallElimination tce(s);
+  string why = tce.unsuitable();
+  size_t n = why.empty() ? tce.run() : 0;
+  if (n > 0) notes.push_back(s.get_name() + ": " + to_string(n) + " self call(s) in tail position eliminated");
+  else if (not why.empty()) notes.push_back(s.get_name() + ": not applied (" + why + ")");
+  else notes.push_back(s.get_name() + ": not applied");
+  return n > 0;
+}
+
+void tailCallPass::print_notes(ostream &os) const {
+  for (const auto &n : notes) os << name() << ": " << n << endl;
+}
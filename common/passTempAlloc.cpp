@@ -0,0 +1,169 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+
+#include <set>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "passes.h"
+#include "cfg.h"
+#include "dataflow.h"
+
+using namespace std;
+
+namespace {
+
+////////////////////////////////////////////////////////////////////
+/// Class tempAllocation assigns new numbers to the temporaries of a
+/// subroutine: two temporaries interfere when one of them is written
+/// while the other is live, and interfering temporaries get different
+/// numbers (a greedy coloring of the interference graph, in order of
+/// first appearance). A copy "%a = %b" does not make %a and %b
+/// interfere, and they get the same number when possible, which turns
+/// the copy into nothing.
+
+class tempAllocation {
+public:
+  explicit tempAllocation(vector<instruction> &insts);
+  /// renumber the temporaries; true if anything changed
+  bool run();
+
+private:
+  vector<instruction> &insts;
+  unsigned numTemps;
+  /// interference graph, and the temporaries related by copies
+  vector<set<unsigned>> interferes, copies;
+
+  void build_graph();
+};
+
+tempAllocation::tempAllocation(vector<instruction> &insts) : insts(insts), numTemps(0) {}
+
+/// interference graph, from the live temporaries after each write
+void tempAllocation::build_graph() {
+  cfg g(insts);
+  liveness live(g, insts);
+  numTemps = live.num_temps();
+  interferes.assign(numTemps, set<unsigned>());
+  copies.assign(numTemps, set<unsigned>());
+  vector<unsigned> alive;
+  for (unsigned b = 0; b < g.num_blocks(); ++b) {
+    const cfg::block &blk = g.get_block(b);
+    tempSet after = live.live_out(b);
+    for (size_t pc = blk.end; pc > blk.first; --pc) {
+      const instruction &inst = insts[pc - 1];
+      if (defines(inst) and inst.arg1.is_temp()) {
+        unsigned d = inst.arg1.temp_number();
+        bool copy = inst.oper == instruction::_LOAD and inst.arg2.is_temp();
+        if (copy) {
+          copies[d].insert(inst.arg2.temp_number());
+          copies[inst.arg2.temp_number()].insert(d);
+        }
+        after.elements(alive);
+        for (unsigned u : alive)
+          if (u != d and not (copy and u == inst.arg2.temp_number())) {
+            interferes[d].insert(u);
+            interferes[u].insert(d);
+          }
+      }
+      liveness::step_back(inst, after);
+    }
+  }
+}
+
+/// renumber the temporaries
+bool tempAllocation::run() {
+  build_graph();
+  if (numTemps == 0) return false;
+
+  // temporaries in order of first appearance
+  vector<unsigned> order;
+  vector<bool> seen(numTemps, false);
+  for (const auto &inst : insts)
+    for (const operand *op : {&inst.arg1, &inst.arg2, &inst.arg3})
+      if (op->is_temp() and not seen[op->temp_number()]) {
+        seen[op->temp_number()] = true;
+        order.push_back(op->temp_number());
+      }
+
+  const unsigned NONE = numTemps;
+  vector<unsigned> color(numTemps, NONE);
+  vector<unsigned> taken;
+  for (unsigned t : order) {
+    taken.clear();
+    for (unsigned u : interferes[t])
+      if (color[u] != NONE) taken.push_back(color[u]);
+    sort(taken.begin(), taken.end());
+    // the number of a copy-related temporary, or the lowest free one
+    for (unsigned u : copies[t])
+      if (color[u] != NONE and not binary_search(taken.begin(), taken.end(), color[u])) {
+        color[t] = color[u];
+        break;
+      }
+    if (color[t] != NONE) continue;
+    color[t] = 0;
+    for (unsigned c : taken)
+      if (c == color[t]) ++color[t];
+      else if (c > color[t]) break;
+  }
+
+  bool changed = false;
+  vector<instruction> result;
+  for (auto inst : insts) {
+    for (operand *op : {&inst.arg1, &inst.arg2, &inst.arg3})
+      if (op->is_temp() and color[op->temp_number()] != op->temp_number()) {
+        *op = operand("%" + to_string(color[op->temp_number()]));
+        changed = true;
+      }
+    if (inst.oper == instruction::_LOAD and inst.arg1 == inst.arg2) {
+      changed = true;
+      continue;
+    }
+    result.push_back(inst);
+  }
+  insts.swap(result);
+  return changed;
+}
+
+}  // namespace
+
+////////////////////////////////////////////////////////////////////
+/// Class tempAllocationPass
+
+string tempAllocationPass::name() const { return "regalloc"; }
+
+bool tempAllocationPass::run_subroutine(subroutine &s) {
+  vector<instruction> insts = s.get_instructions();
+  tempAllocation ta(insts);
+  if (not ta.run()) return false;
+  s.set_instructions(insts);
+  return true;
+}
@@ -0,0 +1,255 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+
+#include <map>
+#include <tuple>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+
+#include "passes.h"
+#include "cfg.h"
+#include "dataflow.h"
+
+using namespace std;
+
+namespace {
+
+/// true if the instruction computes a value from its operands only
+bool is_pure(instruction::Operation op) {
+  switch (op) {
+  case instruction::_ADD : case instruction::_SUB : case instruction::_MUL :
+  case instruction::_DIV : case instruction::_EQ : case instruction::_LT :
+  case instruction::_LE : case instruction::_NEG : case instruction::_NOT :
+  case instruction::_AND : case instruction::_OR : case instruction::_FLOAT :
+  case instruction::_FADD : case instruction::_FSUB : case instruction::_FMUL :
+  case instruction::_FDIV : case instruction::_FEQ : case instruction::_FLT :
+  case instruction::_FLE : case instruction::_FNEG : case instruction::_LOADX :
+  case instruction::_ADDI : case instruction::_SUBI : case instruction::_MULI :
+  case instruction::_DIVI : case instruction::_EQI : case instruction::_LTI :
+  case instruction::_LEI : case instruction::_GTI : case instruction::_GEI :
+  case instruction::_FADDI : case instruction::_FSUBI : case instruction::_FMULI :
+  case instruction::_FDIVI : case instruction::_FEQI : case instruction::_FLTI :
+  case instruction::_FLEI : case instruction::_FGTI : case instruction::_FGEI :
+    return true;
+  default :
+    return false;
+  }
+}
+
+bool is_commutative(instruction::Operation op) {
+  switch (op) {
+  case instruction::_ADD : case instruction::_MUL : case instruction::_EQ :
+  case instruction::_AND : case instruction::_OR : case instruction::_FADD :
+  case instruction::_FMUL : case instruction::_FEQ :
+    return true;
+  default :
+    return false;
+  }
+}
+
+bool is_literal_load(instruction::Operation op) {
+  return op == instruction::_ILOAD or op == instruction::_FLOAD or op == instruction::_CHLOAD;
+}
+
+////////////////////////////////////////////////////////////////////
+/// Class valueNumbering numbers the values computed in a basic block:
+/// two expressions with the same operator and the same numbers for
+/// their operands compute the same value, so the second one can reuse
+/// the operand still holding the first one.
+
+class valueNumbering {
+public:
+  valueNumbering(const subroutine &s, vector<instruction> &insts);
+  /// number the values of the block [first, end); true if anything
+  /// was rewritten
+  bool run_block(size_t first, size_t end);
+
+private:
+  typedef tuple<int, unsigned, unsigned> expression;
+
+  vector<instruction> &insts;
+  /// local arrays, and names whose address is taken
+  vector<operand> localArrays, addressTaken;
+
+  unsigned nextNumber;
+  /// current value number of each operand
+  unordered_map<uint32_t, unsigned> numberOf;
+  /// value number of each expression, and the operands that got it
+  map<expression, unsigned> numberOfExpr;
+  unordered_map<unsigned, vector<operand>> holders;
+  /// the array loads, with the number of their base
+  vector<pair<expression, unsigned>> arrayLoads;
+
+  unsigned number(const operand &op);
+  void assign(const operand &op, unsigned vn);
+  /// an operand still holding value 'vn', if any
+  bool find_holder(unsigned vn, operand &h);
+  /// forget what the memory may have changed
+  void clobber_memory(const instruction &inst);
+  bool contains(const vector<operand> &v, const operand &op) const;
+};
+
+valueNumbering::valueNumbering(const subroutine &s, vector<instruction> &insts)
+  : insts(insts), nextNumber(0) {
+  for (const auto &v : s.vars)
+    if (v.size > 1) localArrays.push_back(operand(v.name));
+  for (const auto &inst : insts)
+    if (inst.oper == instruction::_ALOAD) addressTaken.push_back(inst.arg2);
+}
+
+bool valueNumbering::contains(const vector<operand> &v, const operand &op) const {
+  return find(v.begin(), v.end(), op) != v.end();
+}
+
+/// current value number of an operand (a new one if it has none)
+unsigned valueNumbering::number(const operand &op) {
+  auto it = numberOf.find(op.handle());
+  if (it != numberOf.end()) return it->second;
+  unsigned vn = nextNumber++;
+  assign(op, vn);
+  return vn;
+}
+
+void valueNumbering::assign(const operand &op, unsigned vn) {
+  numberOf[op.handle()] = vn;
+  holders[vn].push_back(op);
+}
+
+/// an operand still holding value 'vn', if any
+bool valueNumbering::find_holder(unsigned vn, operand &h) {
+  auto it = holders.find(vn);
+  if (it == holders.end()) return false;
+  for (const auto &op : it->second)
+    if (numberOf[op.handle()] == vn) {
+      h = op;
+      return true;
+    }
+  return false;
+}
+
+/// forget the values that a write to memory (or a call) may change:
+/// the array loads, and the names whose address is taken. A store into
+/// a local array whose address is never taken only changes the loads
+/// from that array.
+void valueNumbering::clobber_memory(const instruction &inst) {
+  if ((inst.oper == instruction::_XLOAD or inst.oper == instruction::_COPYN) and
+      contains(localArrays, inst.arg1) and not contains(addressTaken, inst.arg1)) {
+    unsigned base = number(inst.arg1);
+    vector<pair<expression, unsigned>> kept;
+    for (const auto &l : arrayLoads)
+      if (l.second == base) numberOfExpr.erase(l.first);
+      else kept.push_back(l);
+    arrayLoads.swap(kept);
+    return;
+  }
+  for (const auto &l : arrayLoads) numberOfExpr.erase(l.first);
+  arrayLoads.clear();
+  for (const auto &x : addressTaken) assign(x, nextNumber++);
+}
+
+/// number the values of the block [first, end)
+bool valueNumbering::run_block(size_t first, size_t end) {
+  numberOf.clear();
+  numberOfExpr.clear();
+  holders.clear();
+  arrayLoads.clear();
+  bool changed = false;
+  for (size_t pc = first; pc < end; ++pc) {
+    instruction &inst = insts[pc];
+    if (inst.oper == instruction::_XLOAD or inst.oper == instruction::_CLOAD or
+        inst.oper == instruction::_COPYN or inst.oper == instruction::_CALL) {
+      clobber_memory(inst);
+      continue;
+    }
+    if (not defines(inst)) continue;
+    if (inst.oper == instruction::_LOAD) {
+      // a copy gets the number of its source (but a local array name
+      // stands for its storage, not for the value of its first cell)
+      if (inst.arg1 == inst.arg2) continue;
+      assign(inst.arg1, contains(localArrays, inst.arg2) ? nextNumber++ : number(inst.arg2));
+      continue;
+    }
+    if (not is_pure(inst.oper) and not is_literal_load(inst.oper)) {
+      assign(inst.arg1, nextNumber++);
+      continue;
+    }
+
+    expression e;
+    if (is_literal_load(inst.oper))
+      e = expression(inst.oper, inst.arg2.handle(), 0);
+    else if (inst.is_immediate())
+      e = expression(inst.oper, number(inst.arg2), inst.arg3.handle());
+    else {
+      unsigned a = number(inst.arg2);
+      unsigned b = inst.arg3.empty() ? 0 : number(inst.arg3);
+      if (is_commutative(inst.oper) and b < a) swap(a, b);
+      e = expression(inst.oper, a, b);
+    }
+    auto it = numberOfExpr.find(e);
+    operand h;
+    if (it != numberOfExpr.end() and find_holder(it->second, h)) {
+      // computed before, and still held by 'h'
+      operand dst = inst.arg1;
+      if (h == dst) inst = instruction::NOOP();
+      else {
+        inst = instruction::LOAD(dst.str(), h.str());
+        assign(dst, it->second);
+      }
+      changed = true;
+      continue;
+    }
+    unsigned vn = nextNumber++;
+    numberOfExpr[e] = vn;
+    if (inst.oper == instruction::_LOADX) arrayLoads.push_back(make_pair(e, number(inst.arg2)));
+    assign(inst.arg1, vn);
+  }
+  return changed;
+}
+
+}  // namespace
+
+////////////////////////////////////////////////////////////////////
+/// Class valueNumberingPass
+
+string valueNumberingPass::name() const { return "cse"; }
+
+bool valueNumberingPass::run_subroutine(subroutine &s) {
+  vector<instruction> insts = s.get_instructions();
+  cfg g(insts);
+  valueNumbering vn(s, insts);
+  bool changed = false;
+  for (unsigned b = 0; b < g.num_blocks(); ++b)
+    changed = vn.run_block(g.get_block(b).first, g.get_block(b).end) or changed;
+  if (changed) s.set_instructions(insts);
+  return changed;
+}
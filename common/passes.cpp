@@ -0,0 +1,72 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+
+#include <string>
+#include <vector>
+
+#include "passes.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////
+/// Helpers shared by the passes
+
+size_t popped_cells(const instruction &inst) {
+  switch (inst.oper) {
+  case instruction::_POP : return 1;
+  case instruction::_POPN : return inst.arg1.int_value();
+  case instruction::_CALL : return inst.arg2.empty() ? 0 : inst.arg2.int_value();
+  default : return 0;
+  }
+}
+
+unsigned temps_used(const vector<instruction> &insts) {
+  unsigned n = 0;
+  for (const auto &inst : insts)
+    for (const operand *op : {&inst.arg1, &inst.arg2, &inst.arg3})
+      if (op->is_temp()) n = max(n, op->temp_number() + 1);
+  return n;
+}
+
+bool find_pushes(const vector<instruction> &insts, size_t pc, size_t n, vector<size_t> &pushes) {
+  size_t inner = 0;
+  pushes.clear();
+  for (size_t k = pc; k > 0 and pushes.size() < n; ) {
+    const instruction &inst = insts[--k];
+    if (inst.oper == instruction::_LABEL or inst.is_jump() or inst.oper == instruction::_RETURN)
+      return false;
+    if (inst.oper == instruction::_PUSH) {
+      if (inner > 0) --inner;
+      else pushes.insert(pushes.begin(), k);
+    }
+    else inner += popped_cells(inst);
+  }
+  return pushes.size() == n;
+}
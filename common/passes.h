@@ -0,0 +1,190 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+#include "passManager.h"
+
+////////////////////////////////////////////////////////////////////
+/// The optimization passes. passManager::standard() puts them in a
+/// pipeline, in this order, with the level that enables each one.
+
+/// inline (-O2): the calls to small subroutines that make no calls
+/// themselves, and have no arrays, are replaced by their body. Its
+/// params, result and local vars become temporaries of the caller,
+/// its temporaries are renumbered and its labels renamed, and each
+/// 'return' jumps to the end of the body. A call is inlined when it
+/// grows the code (the body, less the pushes, pops, call and return
+/// it saves) by --inline-limit=<n> instructions at most (8 by
+/// default). Since the inlined subroutines make no calls, recursive
+/// ones never are.
+class inlinePass : public pass {
+public:
+  static const unsigned DEFAULT_LIMIT = 8;
+  inlinePass();
+  std::string name() const;
+  bool run(code &prog);
+  bool parse_option(const std::string &arg);
+
+private:
+  unsigned limit;
+};
+
+/// tailcall (-O2): a call of a subroutine to itself whose result
+/// goes right into '_result' (or, in a procedure, with nothing else
+/// after it), on the way to a 'return', becomes the assignment of the
+/// new params and a jump to the entry. The result and the local vars
+/// are zeroed, as in a new activation, so subroutines with local
+/// arrays are left as they are. Its notes tell, for each subroutine,
+/// whether it was applied.
+class tailCallPass : public subroutinePass {
+public:
+  std::string name() const;
+  bool run(code &prog);
+  bool run_subroutine(subroutine &s);
+  void print_notes(std::ostream &os) const;
+
+private:
+  std::vector<std::string> notes;
+};
+
+/// deadfunc (-O1): the subroutines that no chain of calls from
+/// 'main' reaches are removed. It goes after inline and tailcall,
+/// that may leave some without callers.
+class deadFunctionPass : public pass {
+public:
+  std::string name() const;
+  bool run(code &prog);
+};
+
+/// constprop (-O1): propagate the constants loaded into temporaries
+/// and scalar variables, fold the instructions that compute constants
+/// into literal loads, and the conditional jumps on constants into
+/// unconditional jumps (or nothing). Integer divisions by zero are
+/// not folded, so that they still fail at run time.
+class constPropPass : public subroutinePass {
+public:
+  std::string name() const;
+  bool run_subroutine(subroutine &s);
+};
+
+/// cleanup (-O1): remove noops, code that can not be reached after
+/// a 'goto' or a 'return', jumps to the next instruction, and labels
+/// that no jump refers to.
+class cleanupPass : public subroutinePass {
+public:
+  std::string name() const;
+  bool run_subroutine(subroutine &s);
+};
+
+/// copyprop (-O1): replace the uses of a temporary holding a copy of
+/// another temporary or variable by the original, fold the copies
+/// "x = %t" into the instruction computing %t, and delete the
+/// instructions writing temporaries that are never read (with the
+/// live temporaries of each point). Reads and integer divisions are
+/// never deleted.
+class copyPropPass : public subroutinePass {
+public:
+  std::string name() const;
+  bool run_subroutine(subroutine &s);
+};
+
+/// cse (-O1): local value numbering. Inside each basic block, an
+/// arithmetic, relational or logical operation, a conversion, a
+/// literal load or an array load that computes again a value still
+/// held by some temporary or variable becomes a copy of it (which
+/// copyprop then forwards). Array loads are forgotten at the stores
+/// that may change them, and at calls.
+class valueNumberingPass : public subroutinePass {
+public:
+  std::string name() const;
+  bool run_subroutine(subroutine &s);
+};
+
+/// licm (-O2): loop-invariant code motion. The instructions of a
+/// natural loop that compute the same temporary in every iteration
+/// (from literals, names not written in the loop, and other invariant
+/// temporaries) are moved into a preheader, run once before entering
+/// the loop. Loads from memory are moved only out of loops with no
+/// stores or calls, and only if they run in every iteration; integer
+/// divisions never move.
+class loopInvariantPass : public subroutinePass {
+public:
+  std::string name() const;
+  bool run_subroutine(subroutine &s);
+};
+
+/// fusebranch (no level: only with --pass=fusebranch, since it needs
+/// a machine with the fused compare-and-branch instructions, as ctvm):
+/// a comparison whose result is only tested by the 'ifFalse' after it,
+/// directly or negated with a 'not', becomes a single "ifFalse a < b
+/// goto L". A negated float < or <= is left as it is, since with NaN
+/// it is not the opposite comparison.
+class fuseBranchPass : public subroutinePass {
+public:
+  std::string name() const;
+  bool run_subroutine(subroutine &s);
+};
+
+/// compactcall (no level: only with --pass=compactcall, since it
+/// needs a machine with "popn" and "call f k", as ctvm): the
+/// "popparam" with no operand after a call are folded into it as
+/// "call f k", and other runs of them into a "popn k".
+class compactCallPass : public subroutinePass {
+public:
+  std::string name() const;
+  bool run_subroutine(subroutine &s);
+};
+
+/// regalloc (-O1): renumber the temporaries from %0, so that the ones
+/// whose lifetimes do not overlap share a number (and a slot in the
+/// frame). Copies between temporaries that end up with the same
+/// number are removed. It goes last, since it makes temporaries
+/// written more than once.
+class tempAllocationPass : public subroutinePass {
+public:
+  std::string name() const;
+  bool run_subroutine(subroutine &s);
+};
+
+////////////////////////////////////////////////////////////////////
+/// Helpers shared by the passes that rewrite call sequences (inline
+/// and tailcall).
+
+/// cells popped by an instruction (after a call, for "call f k")
+std::size_t popped_cells(const instruction &inst);
+/// largest temporary number used in some instructions, plus one
+unsigned temps_used(const std::vector<instruction> &insts);
+/// the last 'n' "pushparam" before the call at 'pc', in order,
+/// skipping the ones of the calls made to compute them (that pop
+/// them). False if there are fewer, or if the code from the first
+/// one to the call is not straight
+bool find_pushes(const std::vector<instruction> &insts, std::size_t pc, std::size_t n,
+                 std::vector<std::size_t> &pushes);
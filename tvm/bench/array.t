@@ -0,0 +1,94 @@
+;;; Benchmark: array accesses. Fills an array of 600
+;;; pseudo-random numbers and bubble-sorts it, 10 times,
+;;; then prints a checksum of the sorted array
+
+function main
+  vars
+   k 1            ;;; int k, i, j, n, r, t, s
+   i 1
+   j 1
+   n 1
+   r 1
+   t 1
+   s 1
+   a 600          ;;; int a[600]
+  endvars
+
+  n = 600
+  s = 0
+  k = 0
+  label while1 :           ;;; while (k<10)
+  %1 = 10
+  %1 = k < %1
+  ifFalse %1 goto endwhile1
+
+  ;;; fill: r = (r*1103 + 12345) % 65536
+  r = k
+  i = 0
+  label while2 :           ;;; while (i<n)
+  %1 = i < n
+  ifFalse %1 goto endwhile2
+  %2 = 1103
+  %2 = r * %2
+  %3 = 12345
+  %2 = %2 + %3
+  %3 = 65536
+  %4 = %2 / %3
+  %4 = %4 * %3
+  r = %2 - %4
+  a[i] = r
+  %5 = 1
+  i = i + %5
+  goto while2
+  label endwhile2 :
+
+  ;;; bubble sort
+  i = 0
+  label while3 :           ;;; while (i<n)
+  %1 = i < n
+  ifFalse %1 goto endwhile3
+  j = 1
+  label while4 :           ;;; while (j<n-i)
+  %2 = n - i
+  %2 = j < %2
+  ifFalse %2 goto endwhile4
+  %3 = 1
+  %3 = j - %3
+  %4 = a[%3]
+  %5 = a[j]
+  %6 = %5 < %4             ;;; if (a[j]<a[j-1]) swap
+  ifFalse %6 goto endif1
+  a[%3] = %5
+  a[j] = %4
+  label endif1 :
+  %7 = 1
+  j = j + %7
+  goto while4
+  label endwhile4 :
+  %7 = 1
+  i = i + %7
+  goto while3
+  label endwhile3 :
+
+  ;;; checksum: s = s*31 + a[i]
+  i = 0
+  label while5 :
+  %1 = i < n
+  ifFalse %1 goto endwhile5
+  %2 = 31
+  %2 = s * %2
+  %3 = a[i]
+  s = %2 + %3
+  %4 = 1
+  i = i + %4
+  goto while5
+  label endwhile5 :
+
+  %1 = 1
+  k = k + %1
+  goto while1
+  label endwhile1 :
+  writei s
+  writeln
+  return
+endfunction
@@ -0,0 +1,60 @@
+;;; Benchmark: calls. Computes fact(12) recursively
+;;; 200000 times and prints the sum of the results
+
+function main
+  vars
+   i 1            ;;; int i, s, y
+   s 1
+   y 1
+  endvars
+
+  i = 0                   ;;; i=0, s=0
+  s = 0
+  label while1 :           ;;; while (i<200000)
+  %1 = 200000
+  %2 = i < %1
+  ifFalse %2 goto endwhile1
+  pushparam               ;;; y = fact(12)
+  %3 = 12
+  pushparam %3
+  call fact
+  popparam
+  popparam y
+  s = s + y               ;;; s = s + y
+  %4 = 1                  ;;; i = i + 1
+  i = i + %4
+  goto while1
+  label endwhile1 :
+  writei s
+  writeln
+  return
+endfunction
+
+function fact
+  params
+    _result
+    n
+  endparams
+
+  vars
+    f 1
+  endvars
+
+  %1 = 0
+  %1 = n == %1             ;;; if (n==0)
+  ifFalse %1 goto else1
+  f = 1                    ;;; f=1
+  goto endif1
+  label else1 :             ;;; f = n*fact(n-1)
+  pushparam
+  %2 = 1
+  %2 = n - %2
+  pushparam %2
+  call fact
+  popparam
+  popparam f
+  f = n * f
+  label endif1 :
+  _result = f
+  return
+endfunction
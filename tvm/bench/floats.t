@@ -0,0 +1,68 @@
+;;; Benchmark: float arithmetic. Approximates pi with
+;;; 1000000 terms of the Leibniz series, and e with the
+;;; series of 1/i!, 100000 times
+
+function main
+  vars
+   i 1            ;;; int i, k
+   k 1
+   p 1            ;;; float p, sign, d, e, f
+   sign 1
+   d 1
+   e 1
+   f 1
+  endvars
+
+  p = 0.0
+  sign = 1.0
+  i = 0
+  label while1 :           ;;; while (i<1000000)
+  %1 = 1000000
+  %1 = i < %1
+  ifFalse %1 goto endwhile1
+  %2 = 2
+  %2 = %2 * i              ;;; d = 2*i+1
+  %3 = 1
+  %2 = %2 + %3
+  d = float %2
+  %4 = sign /. d           ;;; p = p + sign/d
+  p = p +. %4
+  sign = -. sign
+  %3 = 1
+  i = i + %3
+  goto while1
+  label endwhile1 :
+  %5 = 4.0
+  p = %5 *. p
+  writef p
+  writeln
+
+  k = 0
+  label while2 :           ;;; while (k<100000)
+  %1 = 100000
+  %1 = k < %1
+  ifFalse %1 goto endwhile2
+  e = 1.0
+  f = 1.0
+  i = 1
+  label while3 :           ;;; while (i<12)
+  %1 = 12
+  %1 = i < %1
+  ifFalse %1 goto endwhile3
+  %2 = float i             ;;; f = f*i
+  f = f *. %2
+  %3 = 1.0                 ;;; e = e + 1/f
+  %3 = %3 /. f
+  e = e +. %3
+  %4 = 1
+  i = i + %4
+  goto while3
+  label endwhile3 :
+  %4 = 1
+  k = k + %4
+  goto while2
+  label endwhile2 :
+  writef e
+  writeln
+  return
+endfunction
@@ -0,0 +1,115 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////
+//
+//    ctvm - runs t-code programs, like tvm does:
+//
+//       ./ctvm myprogram.t [--debug] [--engine=switch|threaded|jit]
+//                          [--jit-threshold=<n>]
+//       ./ctvm myprogram.tb [--debug]    (binary format, see tconv)
+//
+//    Programs are read (or mapped) and pre-decoded before running.
+//    By default they run as threaded code; --engine=switch selects
+//    the plain switch loop (always used in debug mode), and
+//    --engine=jit compiles subroutines to native code once they have
+//    been called, or have looped, <n> times (100 by default).
+//
+////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdlib>    // EXIT_FAILURE, EXIT_SUCCESS
+
+#include "code.h"
+#include "codeReader.h"
+#include "codeBinary.h"
+#include "machine.h"
+
+
+int main(int argc, const char* argv[]) {
+  std::ios::sync_with_stdio(false);
+
+  std::string file;
+  bool debug = false;
+  machine::Engine engine = machine::THREADED;
+  int threshold = machine::JIT_THRESHOLD;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--debug") debug = true;
+    else if (arg == "--engine=switch") engine = machine::SWITCH;
+    else if (arg == "--engine=threaded") engine = machine::THREADED;
+    else if (arg == "--engine=jit") engine = machine::JIT;
+    else if (arg.compare(0, 16, "--jit-threshold=") == 0) threshold = std::atoi(arg.c_str() + 16);
+    else if (file.empty()) file = arg;
+    else file.clear(), i = argc;
+  }
+  if (file.empty()) {
+    std::cerr << "Error: No program specified." << std::endl;
+    std::cerr << "Usage:" << std::endl;
+    std::cerr << "    " << argv[0] << " myprogram.t [--debug] [--engine=switch|threaded|jit] [--jit-threshold=<n>]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  machine vm;
+  vm.set_engine(engine);
+  vm.set_jit_threshold(threshold);
+  bool loaded;
+  binaryCode bin;
+  if (binaryCode::is_binary(file)) {
+    std::string err;
+    if (not bin.map(file, err)) {
+      std::cerr << "ERROR - " << err << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (debug) bin.to_code().dump(std::cerr);
+    loaded = vm.load(bin);
+  }
+  else {
+    std::ifstream in(file);
+    if (not in) {
+      std::cerr << "ERROR - cannot open file " << file << std::endl;
+      return EXIT_FAILURE;
+    }
+    codeReader reader(in);
+    code prog;
+    reader.read(prog);
+    if (reader.getNumberOfSyntaxErrors() > 0) {
+      std::cerr << "There are syntax errors." << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (debug) prog.dump(std::cerr);
+    loaded = vm.load(prog);
+  }
+  if (not loaded) {
+    std::cerr << "Can not execute." << std::endl;
+    return EXIT_FAILURE;
+  }
+  return vm.run(debug);
+}
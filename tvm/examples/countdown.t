@@ -0,0 +1,26 @@
+;;; This program reads and writes integers until it reads a 0,
+;;; using a recursive procedure with no parameters. Its self call
+;;; is in tail position: tconv --pass=tailcall turns it into a loop
+
+function main
+  call countdown  ;;; countdown()
+  return
+endfunction
+
+function countdown
+  vars
+    n 1           ;;; local variable
+  endvars
+
+  readi n                  ;;; read n
+  %1 = 0
+  %1 = n == %1             ;;; compute %1 = (n==0)
+  ifFalse %1 goto else1
+  return                   ;;; n==0, so stop
+
+  label else1 :
+  writei n                 ;;; print n
+  writeln
+  call countdown           ;;; countdown(), with nothing after it
+  return
+endfunction
@@ -0,0 +1,783 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+#include <iostream>
+#include <map>
+#include <cstring>
+#include <cstddef>
+
+#include "jit.h"
+#include "machine.h"
+
+#ifdef MACHINE_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+
+////////////////////////////////////////////////////////////////////
+/// Class executableMemory
+
+/// constructor
+executableMemory::executableMemory() : addr(nullptr), size(0) {}
+
+/// destructor
+executableMemory::~executableMemory() {
+#ifdef MACHINE_JIT
+  if (addr) munmap(addr, size);
+#endif
+}
+
+/// copy given code to new executable pages
+bool executableMemory::assign(const std::vector<std::uint8_t> &code) {
+#ifdef MACHINE_JIT
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t len = (code.size() + page - 1) / page * page;
+  void *p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+  if (p == MAP_FAILED) return false;
+  memcpy(p, code.data(), code.size());
+  if (mprotect(p, len, PROT_READ | PROT_EXEC) != 0) {
+    munmap(p, len);
+    return false;
+  }
+  if (addr) munmap(addr, size);
+  addr = p;
+  size = len;
+  return true;
+#else
+  return false;
+#endif
+}
+
+/// start of the code
+const std::uint8_t * executableMemory::data() const {
+  return static_cast<const uint8_t *>(addr);
+}
+
+
+////////////////////////////////////////////////////////////////////
+/// Class x86Assembler
+
+/// generated code
+const std::vector<std::uint8_t> & x86Assembler::code() const { return buf; }
+/// current position in generated code
+std::size_t x86Assembler::position() const { return buf.size(); }
+
+void x86Assembler::byte(std::uint8_t b) { buf.push_back(b); }
+void x86Assembler::dword(std::uint32_t d) {
+  for (int i = 0; i < 4; ++i) byte(uint8_t(d >> (8 * i)));
+}
+
+/// REX prefix, if needed (64-bit operand, or extended registers)
+void x86Assembler::rex(bool w, int reg, int index, int base) {
+  uint8_t r = 0x40 | (w << 3) | (((reg >> 3) & 1) << 2) | (((index >> 3) & 1) << 1) | ((base >> 3) & 1);
+  if (r != 0x40) byte(r);
+}
+
+/// operand [base + disp32]
+void x86Assembler::modrm_mem(int reg, Reg base, std::int32_t disp) {
+  byte(0x80 | ((reg & 7) << 3) | (base & 7));
+  if ((base & 7) == RSP) byte(0x24);
+  dword(disp);
+}
+
+/// operand [base + index*4]
+void x86Assembler::modrm_cell(int reg, Reg base, Reg index) {
+  if ((base & 7) == RBP) {
+    byte(0x44 | ((reg & 7) << 3));
+    byte(0x80 | ((index & 7) << 3) | (base & 7));
+    byte(0);
+  }
+  else {
+    byte(0x04 | ((reg & 7) << 3));
+    byte(0x80 | ((index & 7) << 3) | (base & 7));
+  }
+}
+
+/// register operand
+void x86Assembler::modrm_reg(int reg, int rm) {
+  byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+void x86Assembler::load32(Reg dst, Reg base, std::int32_t disp) {
+  rex(false, dst, 0, base); byte(0x8B); modrm_mem(dst, base, disp);
+}
+void x86Assembler::store32(Reg base, std::int32_t disp, Reg src) {
+  rex(false, src, 0, base); byte(0x89); modrm_mem(src, base, disp);
+}
+void x86Assembler::load64(Reg dst, Reg base, std::int32_t disp) {
+  rex(true, dst, 0, base); byte(0x8B); modrm_mem(dst, base, disp);
+}
+void x86Assembler::store64(Reg base, std::int32_t disp, Reg src) {
+  rex(true, src, 0, base); byte(0x89); modrm_mem(src, base, disp);
+}
+void x86Assembler::load_cell(Reg dst, Reg base, Reg index) {
+  rex(false, dst, index, base); byte(0x8B); modrm_cell(dst, base, index);
+}
+void x86Assembler::store_cell(Reg base, Reg index, Reg src) {
+  rex(false, src, index, base); byte(0x89); modrm_cell(src, base, index);
+}
+void x86Assembler::store_byte(Reg base, std::int32_t disp, std::uint8_t imm) {
+  rex(false, 0, 0, base); byte(0xC6); modrm_mem(0, base, disp); byte(imm);
+}
+void x86Assembler::mov_imm32(Reg dst, std::uint32_t imm) {
+  rex(false, 0, 0, dst); byte(0xB8 + (dst & 7)); dword(imm);
+}
+void x86Assembler::mov_imm64(Reg dst, std::uint64_t imm) {
+  rex(true, 0, 0, dst); byte(0xB8 + (dst & 7)); dword(uint32_t(imm)); dword(uint32_t(imm >> 32));
+}
+void x86Assembler::mov64(Reg dst, Reg src) {
+  rex(true, src, 0, dst); byte(0x89); modrm_reg(src, dst);
+}
+void x86Assembler::movsxd(Reg dst, Reg src) {
+  rex(true, dst, 0, src); byte(0x63); modrm_reg(dst, src);
+}
+void x86Assembler::movzx8(Reg dst, Reg src) {
+  rex(false, dst, 0, src); byte(0x0F); byte(0xB6); modrm_reg(dst, src);
+}
+void x86Assembler::alu32(AluOp op, Reg dst, Reg src) {
+  rex(false, src, 0, dst); byte(op); modrm_reg(src, dst);
+}
+void x86Assembler::alu64(AluOp op, Reg dst, Reg src) {
+  rex(true, src, 0, dst); byte(op); modrm_reg(src, dst);
+}
+void x86Assembler::alu32_imm(AluImm op, Reg dst, std::int32_t imm) {
+  rex(false, 0, 0, dst); byte(0x81); modrm_reg(op, dst); dword(imm);
+}
+void x86Assembler::alu64_imm(AluImm op, Reg dst, std::int32_t imm) {
+  rex(true, 0, 0, dst); byte(0x81); modrm_reg(op, dst); dword(imm);
+}
+void x86Assembler::cmp_byte(Reg base, std::int32_t disp, std::uint8_t imm) {
+  rex(false, 0, 0, base); byte(0x80); modrm_mem(7, base, disp); byte(imm);
+}
+void x86Assembler::imul32(Reg dst, Reg src) {
+  rex(false, dst, 0, src); byte(0x0F); byte(0xAF); modrm_reg(dst, src);
+}
+void x86Assembler::neg32(Reg r) {
+  rex(false, 0, 0, r); byte(0xF7); modrm_reg(3, r);
+}
+void x86Assembler::cdq() { byte(0x99); }
+void x86Assembler::idiv32(Reg r) {
+  rex(false, 0, 0, r); byte(0xF7); modrm_reg(7, r);
+}
+/// set low byte of r (only AL, CL, DL, BL) to condition c
+void x86Assembler::setcc(Cond c, Reg r) {
+  byte(0x0F); byte(0x90 + c); modrm_reg(0, r);
+}
+void x86Assembler::movd_to_xmm(int xmm, Reg src) {
+  byte(0x66); rex(false, xmm, 0, src); byte(0x0F); byte(0x6E); modrm_reg(xmm, src);
+}
+void x86Assembler::movd_from_xmm(Reg dst, int xmm) {
+  byte(0x66); rex(false, xmm, 0, dst); byte(0x0F); byte(0x7E); modrm_reg(xmm, dst);
+}
+void x86Assembler::sse(SseOp op, int dst, int src) {
+  byte(0xF3); rex(false, dst, 0, src); byte(0x0F); byte(op); modrm_reg(dst, src);
+}
+void x86Assembler::cvtsi2ss(int xmm, Reg src) {
+  byte(0xF3); rex(false, xmm, 0, src); byte(0x0F); byte(0x2A); modrm_reg(xmm, src);
+}
+void x86Assembler::ucomiss(int a, int b) {
+  rex(false, a, 0, b); byte(0x0F); byte(0x2E); modrm_reg(a, b);
+}
+std::size_t x86Assembler::jmp() {
+  byte(0xE9);
+  size_t at = position();
+  dword(0);
+  return at;
+}
+std::size_t x86Assembler::jcc(Cond c) {
+  byte(0x0F); byte(0x80 + c);
+  size_t at = position();
+  dword(0);
+  return at;
+}
+void x86Assembler::patch(std::size_t at, std::size_t target) {
+  uint32_t rel = uint32_t(int32_t(int64_t(target) - int64_t(at + 4)));
+  for (int i = 0; i < 4; ++i) buf[at + i] = uint8_t(rel >> (8 * i));
+}
+void x86Assembler::jmp_reg(Reg r) {
+  rex(false, 0, 0, r); byte(0xFF); modrm_reg(4, r);
+}
+/// call a function (through RAX)
+void x86Assembler::call(const void *fn) {
+  mov_imm64(RAX, reinterpret_cast<uint64_t>(fn));
+  byte(0xFF); modrm_reg(2, RAX);
+}
+void x86Assembler::push(Reg r) { rex(false, 0, 0, r); byte(0x50 + (r & 7)); }
+void x86Assembler::pop(Reg r) { rex(false, 0, 0, r); byte(0x58 + (r & 7)); }
+void x86Assembler::ret() { byte(0xC3); }
+
+
+////////////////////////////////////////////////////////////////////
+/// JIT engine of class machine
+///
+/// Native code runs inside the frame set up by a trampoline, with
+/// fixed registers:
+///    RBX  frame slots of current frame      R12  temporaries
+///    R13  'defined' flags of temporaries    R14  jitContext
+///    R15  memory
+/// and RAX, RCX, RDX, XMM0, XMM1 as scratch registers. Calls, returns
+/// and I/O go through helper functions, after which RBX, R12 and R13
+/// are reloaded from the context. Native code leaves returning a
+/// status in RAX.
+
+// I/O helpers called from native code
+static void jit_writei(uint32_t v) { cout << int32_t(v); }
+static void jit_writef(uint32_t v) { float f; memcpy(&f, &v, sizeof(f)); cout << f; }
+static void jit_writec(uint32_t v) { cout << char(v); }
+static void jit_writeln() { cout << '\n'; }
+static void jit_writes(const string *s) { cout << *s; }
+static uint32_t jit_readi() { int v = 0; cin >> v; return v; }
+static uint32_t jit_readf() { float f = 0; cin >> f; uint32_t v; memcpy(&v, &f, sizeof(v)); return v; }
+static uint32_t jit_readc() { char v = 0; cin >> v; return (unsigned char)v; }
+// COPYN helper: 0 (and nothing copied) if a range is out of memory
+static uint32_t jit_copyn(uint32_t *mem, int64_t dst, int64_t src, uint32_t n) {
+  const int64_t size = machine::MEMORY_SIZE;
+  if (n == 0) return 1;
+  if (dst < 0 or src < 0 or dst + n > size or src + n > size) return 0;
+  memmove(mem + dst, mem + src, size_t(n) * sizeof(uint32_t));
+  return 1;
+}
+
+typedef x86Assembler X;
+
+/// run the JIT engine from given pc of the current frame
+std::size_t machine::run_jit(std::size_t pc) {
+  bool enter = tier_up(frames.back().sub - subs.data());
+  while (true) {
+    if (enter) {
+      uint64_t status = run_native(native_entry(frames.back().sub - subs.data(), pc));
+      if (status == NATIVE_DONE) return 0;
+      pc = status;
+    }
+    pc = run_threaded(pc);
+    if (frames.empty() or not hot) return pc;
+    enter = true;
+  }
+}
+
+/// count a call or back-edge of subroutine s
+bool machine::tier_up(std::size_t s) {
+  nativeSubroutine &ns = native[s];
+  if (ns.code) return true;
+  if (ns.failed or ++ns.hotness < jitThreshold) return false;
+  return jit_compile(s);
+}
+
+/// address of native code for a pc of subroutine s
+const void * machine::native_entry(std::size_t s, std::size_t pc) const {
+  return native[s].code->data() + native[s].offsets[subs[s].threadedIndex[pc]];
+}
+
+/// update the context with the current frame
+void machine::sync_context() {
+  const frame &f = frames.back();
+  context.fp = mem.data() + f.base;
+  context.tp = temps.data() + f.tempBase;
+  context.td = tempDefined.data() + f.tempBase;
+  context.mem = mem.data();
+  context.sp = &sp;
+  context.base = f.base;
+  context.vm = this;
+}
+
+/// run native code until it leaves
+std::uint64_t machine::run_native(const void *entry) {
+  typedef uint64_t (*trampolineFunction)(jitContext *, const void *);
+  sync_context();
+  trampolineFunction f = reinterpret_cast<trampolineFunction>(const_cast<uint8_t *>(trampoline->data()));
+  return f(&context, entry);
+}
+
+/// helper for 'call': enter the callee, returning its native code
+/// (or null, with the pc where the interpreter goes on as status)
+const void * machine::jit_call(jitContext *ctx, std::uint32_t callee, std::uint32_t pc,
+                               std::uint32_t argCells) {
+  machine &vm = *ctx->vm;
+  const decodedSubroutine &ds = vm.subs[callee];
+  if (vm.sp < ds.params.size() or vm.sp + ds.varCells > MEMORY_SIZE or vm.frames.size() >= MAX_FRAMES) {
+    // the interpreter will run the call (and fail, or go on slowly)
+    ctx->status = pc;
+    return nullptr;
+  }
+  vm.push_frame(callee, pc + 1, argCells);
+  vm.sync_context();
+  if (vm.tier_up(callee)) return vm.native_entry(callee, 0);
+  ctx->status = 0;
+  return nullptr;
+}
+
+/// helper for 'return': leave the subroutine, returning the native
+/// code of the caller (or null, with the status)
+const void * machine::jit_return(jitContext *ctx, std::uint32_t pc) {
+  machine &vm = *ctx->vm;
+  const frame &f = vm.frames.back();
+  if (uint64_t(f.sub->varCells) + f.argCells > vm.sp) {
+    ctx->status = pc;
+    return nullptr;
+  }
+  size_t returnPc = vm.pop_frame();
+  if (vm.frames.empty()) {
+    ctx->status = NATIVE_DONE;
+    return nullptr;
+  }
+  vm.sync_context();
+  size_t s = vm.frames.back().sub - vm.subs.data();
+  if (vm.native[s].code) return vm.native_entry(s, returnPc);
+  ctx->status = returnPc;
+  return nullptr;
+}
+
+/// compile subroutine s to native code
+bool machine::jit_compile(std::size_t s) {
+  nativeSubroutine &ns = native[s];
+  ns.failed = true;
+#ifndef MACHINE_JIT
+  return false;
+#else
+  const int32_t FP = offsetof(jitContext, fp), TP = offsetof(jitContext, tp), TD = offsetof(jitContext, td);
+  const int32_t MEM = offsetof(jitContext, mem), SP = offsetof(jitContext, sp);
+  const int32_t BASE = offsetof(jitContext, base), STATUS = offsetof(jitContext, status);
+
+  if (not trampoline) {
+    // enter native code: save callee-saved registers, keeping the
+    // stack aligned, set the fixed registers, and jump to the code
+    X a;
+    a.push(X::RBP);
+    a.mov64(X::RBP, X::RSP);
+    a.push(X::RBX); a.push(X::R12); a.push(X::R13); a.push(X::R14); a.push(X::R15);
+    a.alu64_imm(X::ADD_IMM, X::RSP, -8);
+    a.mov64(X::R14, X::RDI);
+    a.load64(X::R15, X::R14, MEM);
+    a.load64(X::RBX, X::R14, FP);
+    a.load64(X::R12, X::R14, TP);
+    a.load64(X::R13, X::R14, TD);
+    a.jmp_reg(X::RSI);
+    std::unique_ptr<executableMemory> m(new executableMemory);
+    if (not m->assign(a.code())) return false;
+    trampoline = std::move(m);
+  }
+
+  const decodedSubroutine &ds = subs[s];
+  X a;
+  vector<uint32_t> offsets(ds.threaded.size());
+  vector<pair<size_t, size_t>> jumps;   // displacement, threaded index
+  map<uint32_t, vector<size_t>> deopts; // pc, displacements
+  vector<size_t> statusExits;          // leave with the status in the context
+
+  for (const auto &ti : ds.threaded)
+    for (const slot *sl : {&ti.a1, &ti.a2, &ti.a3})
+      if (sl->index >= (1u << 28)) return false;
+
+  // leave to the interpreter at pc, if the jump at 'at' is taken
+  auto deopt = [&](size_t at, uint32_t pc) { deopts[pc].push_back(at); };
+  // load a slot into a register (leaving if the temporary is undefined)
+  auto load = [&](X::Reg r, const slot &sl, uint32_t pc) {
+    switch (sl.base) {
+    case FRAME_SLOT : a.load32(r, X::RBX, 4 * sl.index); break;
+    case TEMP_SLOT :
+      if (sl.check == CHECK_TEMP) {
+        a.cmp_byte(X::R13, sl.index, 0);
+        deopt(a.jcc(X::E), pc);
+      }
+      a.load32(r, X::R12, 4 * sl.index);
+      break;
+    default : a.mov_imm32(r, ds.constants[sl.index]); break;
+    }
+  };
+  // store a register into a slot
+  auto store = [&](const slot &sl, X::Reg r) {
+    if (sl.base == FRAME_SLOT) a.store32(X::RBX, 4 * sl.index, r);
+    else {
+      a.store32(X::R12, 4 * sl.index, r);
+      a.store_byte(X::R13, sl.index, 1);
+    }
+  };
+  // reload the fixed registers after a helper changed the frame
+  auto reload = [&]() {
+    a.load64(X::RBX, X::R14, FP);
+    a.load64(X::R12, X::R14, TP);
+    a.load64(X::R13, X::R14, TD);
+  };
+  // check RCX is a valid memory address
+  auto check_address = [&](uint32_t pc) {
+    a.alu64_imm(X::CMP_IMM, X::RCX, MEMORY_SIZE);
+    deopt(a.jcc(X::AE), pc);
+  };
+  // RAX = RAX <op> RCX, with 0/1 result of a comparison
+  auto compare = [&](X::Cond c) {
+    a.alu32(X::CMP, X::RAX, X::RCX);
+    a.setcc(c, X::RAX);
+    a.movzx8(X::RAX, X::RAX);
+  };
+  // RAX = bool(RAX) <op> bool(RCX)
+  auto logical = [&](X::AluOp op) {
+    a.alu32(X::TEST, X::RAX, X::RAX);
+    a.setcc(X::NE, X::RAX);
+    a.movzx8(X::RAX, X::RAX);
+    a.alu32(X::TEST, X::RCX, X::RCX);
+    a.setcc(X::NE, X::RCX);
+    a.movzx8(X::RCX, X::RCX);
+    a.alu32(op, X::RAX, X::RCX);
+  };
+  // XMM0 = float(RAX) <op> float(RCX)
+  auto float_op = [&](X::SseOp op) {
+    a.movd_to_xmm(0, X::RAX);
+    a.movd_to_xmm(1, X::RCX);
+    a.sse(op, 0, 1);
+    a.movd_from_xmm(X::RAX, 0);
+  };
+
+  for (size_t i = 0; i < ds.threaded.size(); ++i) {
+    const threadedInstruction &ti = ds.threaded[i];
+    uint32_t pc = ti.pc;
+    offsets[i] = a.position();
+    if (ti.a1.check == UNDEFINED_ID or ti.a2.check == UNDEFINED_ID or ti.a3.check == UNDEFINED_ID) {
+      deopt(a.jmp(), pc);
+      continue;
+    }
+
+    switch (ti.op) {
+    case T_NOOP : break;
+    case T_UJUMP : jumps.push_back(make_pair(a.jmp(), ti.target - ds.threaded.data())); break;
+    case T_FJUMP :
+      load(X::RAX, ti.a1, pc);
+      a.alu32(X::TEST, X::RAX, X::RAX);
+      jumps.push_back(make_pair(a.jcc(X::E), ti.target - ds.threaded.data()));
+      break;
+    case T_FJEQ : case T_FJNE : case T_FJLT : case T_FJLE : {
+      // jump when the comparison is false
+      static const X::Cond negated[] = {X::NE, X::E, X::GE, X::G};
+      load(X::RAX, ti.a1, pc);
+      load(X::RCX, ti.a2, pc);
+      a.alu32(X::CMP, X::RAX, X::RCX);
+      jumps.push_back(make_pair(a.jcc(negated[ti.op - T_FJEQ]), ti.target - ds.threaded.data()));
+      break;
+    }
+    case T_FJFEQ : case T_FJFNE : case T_FJFLT : case T_FJFLE : {
+      size_t target = ti.target - ds.threaded.data();
+      load(X::RAX, ti.a1, pc);
+      load(X::RCX, ti.a2, pc);
+      a.movd_to_xmm(0, X::RAX);
+      a.movd_to_xmm(1, X::RCX);
+      if (ti.op == T_FJFEQ) {
+        // not equal, or unordered
+        a.ucomiss(0, 1);
+        jumps.push_back(make_pair(a.jcc(X::NE), target));
+        jumps.push_back(make_pair(a.jcc(X::P), target));
+      }
+      else if (ti.op == T_FJFNE) {
+        // equal, and not unordered
+        a.ucomiss(0, 1);
+        size_t unordered = a.jcc(X::P);
+        jumps.push_back(make_pair(a.jcc(X::E), target));
+        a.patch(unordered, a.position());
+      }
+      else {
+        // not (b > a), and so for <=
+        a.ucomiss(1, 0);
+        jumps.push_back(make_pair(a.jcc(ti.op == T_FJFLT ? X::BE : X::B), target));
+      }
+      break;
+    }
+    case T_PUSH :
+      load(X::RAX, ti.a1, pc);
+      a.load64(X::RCX, X::R14, SP);
+      a.load64(X::RDX, X::RCX, 0);
+      a.alu64_imm(X::CMP_IMM, X::RDX, MEMORY_SIZE);
+      deopt(a.jcc(X::AE), pc);
+      a.store_cell(X::R15, X::RDX, X::RAX);
+      a.alu64_imm(X::ADD_IMM, X::RDX, 1);
+      a.store64(X::RCX, 0, X::RDX);
+      break;
+    case T_POP :
+    case T_DROP :
+      a.load64(X::RCX, X::R14, SP);
+      a.load64(X::RDX, X::RCX, 0);
+      a.alu64(X::TEST, X::RDX, X::RDX);
+      deopt(a.jcc(X::E), pc);
+      a.alu64_imm(X::ADD_IMM, X::RDX, -1);
+      a.store64(X::RCX, 0, X::RDX);
+      if (ti.op == T_POP) {
+        a.load_cell(X::RAX, X::R15, X::RDX);
+        store(ti.a1, X::RAX);
+      }
+      break;
+    case T_POPN : {
+      int32_t k = int32_t(ds.constants[ti.a1.index]);
+      a.load64(X::RCX, X::R14, SP);
+      a.load64(X::RDX, X::RCX, 0);
+      a.alu64_imm(X::CMP_IMM, X::RDX, k);
+      deopt(a.jcc(X::B), pc);
+      a.alu64_imm(X::ADD_IMM, X::RDX, -k);
+      a.store64(X::RCX, 0, X::RDX);
+      break;
+    }
+    case T_CALL :
+    case T_RETURN :
+      a.mov64(X::RDI, X::R14);
+      if (ti.op == T_CALL) {
+        a.mov_imm32(X::RSI, ti.callee);
+        a.mov_imm32(X::RDX, pc);
+        a.mov_imm32(X::RCX, ds.constants[ti.a1.index]);
+        a.call(reinterpret_cast<const void *>(&machine::jit_call));
+      }
+      else {
+        a.mov_imm32(X::RSI, pc);
+        a.call(reinterpret_cast<const void *>(&machine::jit_return));
+      }
+      reload();
+      a.alu64(X::TEST, X::RAX, X::RAX);
+      statusExits.push_back(a.jcc(X::E));
+      a.jmp_reg(X::RAX);
+      break;
+
+    case T_ADD : case T_SUB : case T_MUL :
+      load(X::RAX, ti.a2, pc);
+      load(X::RCX, ti.a3, pc);
+      if (ti.op == T_MUL) a.imul32(X::RAX, X::RCX);
+      else a.alu32(ti.op == T_ADD ? X::ADD : X::SUB, X::RAX, X::RCX);
+      store(ti.a1, X::RAX);
+      break;
+    case T_DIV : {
+      load(X::RAX, ti.a2, pc);
+      load(X::RCX, ti.a3, pc);
+      a.alu32(X::TEST, X::RCX, X::RCX);
+      deopt(a.jcc(X::E), pc);
+      a.alu32_imm(X::CMP_IMM, X::RCX, -1);
+      size_t notMinusOne = a.jcc(X::NE);
+      a.alu32_imm(X::CMP_IMM, X::RAX, INT32_MIN);
+      deopt(a.jcc(X::E), pc);
+      a.patch(notMinusOne, a.position());
+      a.cdq();
+      a.idiv32(X::RCX);
+      store(ti.a1, X::RAX);
+      break;
+    }
+    case T_EQ : case T_LT : case T_LE :
+      load(X::RAX, ti.a2, pc);
+      load(X::RCX, ti.a3, pc);
+      compare(ti.op == T_EQ ? X::E : ti.op == T_LT ? X::L : X::LE);
+      store(ti.a1, X::RAX);
+      break;
+    case T_AND : case T_OR :
+      load(X::RAX, ti.a2, pc);
+      load(X::RCX, ti.a3, pc);
+      logical(ti.op == T_AND ? X::AND : X::OR);
+      store(ti.a1, X::RAX);
+      break;
+    case T_NEG :
+      load(X::RAX, ti.a2, pc);
+      a.neg32(X::RAX);
+      store(ti.a1, X::RAX);
+      break;
+    case T_NOT :
+      load(X::RAX, ti.a2, pc);
+      a.alu32(X::TEST, X::RAX, X::RAX);
+      a.setcc(X::E, X::RAX);
+      a.movzx8(X::RAX, X::RAX);
+      store(ti.a1, X::RAX);
+      break;
+    case T_FLOAT :
+      load(X::RAX, ti.a2, pc);
+      a.cvtsi2ss(0, X::RAX);
+      a.movd_from_xmm(X::RAX, 0);
+      store(ti.a1, X::RAX);
+      break;
+
+    case T_FADD : case T_FSUB : case T_FMUL : case T_FDIV :
+      load(X::RAX, ti.a2, pc);
+      load(X::RCX, ti.a3, pc);
+      float_op(ti.op == T_FADD ? X::ADDSS : ti.op == T_FSUB ? X::SUBSS : ti.op == T_FMUL ? X::MULSS : X::DIVSS);
+      store(ti.a1, X::RAX);
+      break;
+    case T_FEQ : case T_FLT : case T_FLE :
+      load(X::RAX, ti.a2, pc);
+      load(X::RCX, ti.a3, pc);
+      a.movd_to_xmm(0, X::RAX);
+      a.movd_to_xmm(1, X::RCX);
+      if (ti.op == T_FEQ) {
+        // equal, and not unordered
+        a.ucomiss(0, 1);
+        a.setcc(X::E, X::RAX);
+        a.setcc(X::NP, X::RCX);
+        a.movzx8(X::RAX, X::RAX);
+        a.movzx8(X::RCX, X::RCX);
+        a.alu32(X::AND, X::RAX, X::RCX);
+      }
+      else {
+        // a < b as b > a (false if unordered), and so for <=
+        a.ucomiss(1, 0);
+        a.setcc(ti.op == T_FLT ? X::A : X::AE, X::RAX);
+        a.movzx8(X::RAX, X::RAX);
+      }
+      store(ti.a1, X::RAX);
+      break;
+    case T_FNEG :
+      load(X::RAX, ti.a2, pc);
+      a.alu32_imm(X::XOR_IMM, X::RAX, INT32_MIN);
+      store(ti.a1, X::RAX);
+      break;
+
+    case T_LOAD :
+      load(X::RAX, ti.a2, pc);
+      store(ti.a1, X::RAX);
+      break;
+    case T_XLOAD_VAR :
+    case T_XLOAD_PTR :
+      if (ti.op == T_XLOAD_VAR) {
+        load(X::RAX, ti.a2, pc);
+        a.movsxd(X::RCX, X::RAX);
+        a.load64(X::RAX, X::R14, BASE);
+        a.alu64(X::ADD, X::RCX, X::RAX);
+        a.alu64_imm(X::ADD_IMM, X::RCX, ti.a1.index);
+      }
+      else {
+        load(X::RAX, ti.a1, pc);
+        load(X::RCX, ti.a2, pc);
+        a.movsxd(X::RAX, X::RAX);
+        a.movsxd(X::RCX, X::RCX);
+        a.alu64(X::ADD, X::RCX, X::RAX);
+      }
+      load(X::RDX, ti.a3, pc);
+      check_address(pc);
+      a.store_cell(X::R15, X::RCX, X::RDX);
+      break;
+    case T_LOADX_VAR :
+    case T_LOADX_PTR :
+      if (ti.op == T_LOADX_VAR) {
+        load(X::RAX, ti.a3, pc);
+        a.movsxd(X::RCX, X::RAX);
+        a.load64(X::RAX, X::R14, BASE);
+        a.alu64(X::ADD, X::RCX, X::RAX);
+        a.alu64_imm(X::ADD_IMM, X::RCX, ti.a2.index);
+      }
+      else {
+        load(X::RAX, ti.a2, pc);
+        load(X::RCX, ti.a3, pc);
+        a.movsxd(X::RAX, X::RAX);
+        a.movsxd(X::RCX, X::RCX);
+        a.alu64(X::ADD, X::RCX, X::RAX);
+      }
+      check_address(pc);
+      a.load_cell(X::RAX, X::R15, X::RCX);
+      store(ti.a1, X::RAX);
+      break;
+    case T_ALOAD :
+      a.load64(X::RAX, X::R14, BASE);
+      a.alu64_imm(X::ADD_IMM, X::RAX, ti.a2.index);
+      store(ti.a1, X::RAX);
+      break;
+    case T_LOADC :
+      load(X::RAX, ti.a2, pc);
+      a.movsxd(X::RCX, X::RAX);
+      check_address(pc);
+      a.load_cell(X::RAX, X::R15, X::RCX);
+      store(ti.a1, X::RAX);
+      break;
+    case T_CLOAD :
+      load(X::RAX, ti.a1, pc);
+      load(X::RDX, ti.a2, pc);
+      a.movsxd(X::RCX, X::RAX);
+      check_address(pc);
+      a.store_cell(X::R15, X::RCX, X::RDX);
+      break;
+    case T_COPYN :
+      // RSI, RDX = addresses of the arrays (a var is a frame slot, a
+      // temporary holds an address); the interpreter reports a range
+      // out of memory
+      for (const slot *sl : {&ti.a1, &ti.a2}) {
+        X::Reg r = sl == &ti.a1 ? X::RSI : X::RDX;
+        if (sl->base == FRAME_SLOT) {
+          a.load64(r, X::R14, BASE);
+          a.alu64_imm(X::ADD_IMM, r, sl->index);
+        }
+        else {
+          load(X::RAX, *sl, pc);
+          a.movsxd(r, X::RAX);
+        }
+      }
+      load(X::RCX, ti.a3, pc);
+      a.mov64(X::RDI, X::R15);
+      a.call(reinterpret_cast<const void *>(&jit_copyn));
+      a.alu32(X::TEST, X::RAX, X::RAX);
+      deopt(a.jcc(X::E), pc);
+      break;
+
+    case T_READI : case T_READF : case T_READC :
+      a.call(reinterpret_cast<const void *>(ti.op == T_READI ? &jit_readi : ti.op == T_READF ? &jit_readf : &jit_readc));
+      store(ti.a1, X::RAX);
+      break;
+    case T_WRITEI : case T_WRITEF : case T_WRITEC :
+      load(X::RDI, ti.a1, pc);
+      a.call(reinterpret_cast<const void *>(ti.op == T_WRITEI ? &jit_writei : ti.op == T_WRITEF ? &jit_writef : &jit_writec));
+      break;
+    case T_WRITELN :
+      a.call(reinterpret_cast<const void *>(&jit_writeln));
+      break;
+    case T_WRITES :
+      // the strings do not move once the program is loaded
+      a.mov_imm64(X::RDI, reinterpret_cast<uint64_t>(&strings[ds.constants[ti.a1.index]]));
+      a.call(reinterpret_cast<const void *>(&jit_writes));
+      break;
+
+    default :
+      // T_UNDEFINED, T_END, T_INVALID: the interpreter reports them
+      deopt(a.jmp(), pc);
+      break;
+    }
+  }
+
+  for (const auto &j : jumps) a.patch(j.first, offsets[j.second]);
+  // leave to the interpreter: the status is the pc
+  vector<size_t> exits;
+  for (const auto &d : deopts) {
+    for (size_t at : d.second) a.patch(at, a.position());
+    a.mov_imm32(X::RAX, d.first);
+    exits.push_back(a.jmp());
+  }
+  // leave with the status in the context
+  for (size_t at : statusExits) a.patch(at, a.position());
+  a.load64(X::RAX, X::R14, STATUS);
+  // restore the registers saved by the trampoline
+  for (size_t at : exits) a.patch(at, a.position());
+  a.alu64_imm(X::ADD_IMM, X::RSP, 8);
+  a.pop(X::R15); a.pop(X::R14); a.pop(X::R13); a.pop(X::R12); a.pop(X::RBX); a.pop(X::RBP);
+  a.ret();
+
+  std::unique_ptr<executableMemory> m(new executableMemory);
+  if (not m->assign(a.code())) return false;
+  ns.code = std::move(m);
+  ns.offsets = std::move(offsets);
+  ns.failed = false;
+  return true;
+#endif
+}
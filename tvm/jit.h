@@ -0,0 +1,140 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// The JIT compiler is available on x86-64, where pages can be mapped
+// executable with mmap
+#if defined(__x86_64__) and (defined(__linux__) or defined(__APPLE__) or defined(__FreeBSD__))
+#define MACHINE_JIT 1
+#endif
+
+
+////////////////////////////////////////////////////////////////////
+/// Class executableMemory holds machine code in pages mapped with
+/// mmap. Code is copied while pages are writable, and then they are
+/// made executable (and not writable).
+
+class executableMemory {
+public:
+  /// constructor and destructor (unmaps the pages, if any)
+  executableMemory();
+  ~executableMemory();
+  executableMemory(const executableMemory &) = delete;
+  executableMemory & operator=(const executableMemory &) = delete;
+
+  /// copy given code to new executable pages. Returns false on error
+  bool assign(const std::vector<std::uint8_t> &code);
+  /// start of the code
+  const std::uint8_t * data() const;
+
+private:
+  void *addr;
+  std::size_t size;
+};
+
+
+////////////////////////////////////////////////////////////////////
+/// Class x86Assembler encodes the x86-64 instructions used by the
+/// JIT compiler. Memory operands are always [base + disp32], or
+/// [base + index*4] for memory cells.
+
+class x86Assembler {
+public:
+  /// registers (general purpose, and xmm by number)
+  typedef enum {RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+                R8, R9, R10, R11, R12, R13, R14, R15} Reg;
+  /// condition codes
+  typedef enum {O, NO, B, AE, E, NE, BE, A, S, NS, P, NP, L, GE, LE, G} Cond;
+  /// arithmetic-logic operations (opcode of the "r/m, reg" form), and
+  /// the opcode extensions of the immediate form
+  typedef enum {ADD = 0x01, OR = 0x09, AND = 0x21, SUB = 0x29, XOR = 0x31, CMP = 0x39, TEST = 0x85} AluOp;
+  typedef enum {ADD_IMM = 0, XOR_IMM = 6, CMP_IMM = 7} AluImm;
+  /// scalar single precision operations
+  typedef enum {ADDSS = 0x58, MULSS = 0x59, SUBSS = 0x5C, DIVSS = 0x5E} SseOp;
+
+  /// generated code, and current position in it
+  const std::vector<std::uint8_t> & code() const;
+  std::size_t position() const;
+
+  // moves
+  void load32(Reg dst, Reg base, std::int32_t disp);
+  void store32(Reg base, std::int32_t disp, Reg src);
+  void load64(Reg dst, Reg base, std::int32_t disp);
+  void store64(Reg base, std::int32_t disp, Reg src);
+  void load_cell(Reg dst, Reg base, Reg index);
+  void store_cell(Reg base, Reg index, Reg src);
+  void store_byte(Reg base, std::int32_t disp, std::uint8_t imm);
+  void mov_imm32(Reg dst, std::uint32_t imm);
+  void mov_imm64(Reg dst, std::uint64_t imm);
+  void mov64(Reg dst, Reg src);
+  void movsxd(Reg dst, Reg src);
+  void movzx8(Reg dst, Reg src);
+  // arithmetic and comparisons
+  void alu32(AluOp op, Reg dst, Reg src);
+  void alu64(AluOp op, Reg dst, Reg src);
+  void alu32_imm(AluImm op, Reg dst, std::int32_t imm);
+  void alu64_imm(AluImm op, Reg dst, std::int32_t imm);
+  void cmp_byte(Reg base, std::int32_t disp, std::uint8_t imm);
+  void imul32(Reg dst, Reg src);
+  void neg32(Reg r);
+  void cdq();
+  void idiv32(Reg r);
+  void setcc(Cond c, Reg r);
+  // floating point (xmm registers by number)
+  void movd_to_xmm(int xmm, Reg src);
+  void movd_from_xmm(Reg dst, int xmm);
+  void sse(SseOp op, int dst, int src);
+  void cvtsi2ss(int xmm, Reg src);
+  void ucomiss(int a, int b);
+  // control. Jumps return the position of their displacement, to be
+  // set later with 'patch'
+  std::size_t jmp();
+  std::size_t jcc(Cond c);
+  void patch(std::size_t at, std::size_t target);
+  void jmp_reg(Reg r);
+  void call(const void *fn);
+  void push(Reg r);
+  void pop(Reg r);
+  void ret();
+
+private:
+  std::vector<std::uint8_t> buf;
+
+  void byte(std::uint8_t b);
+  void dword(std::uint32_t d);
+  void rex(bool w, int reg, int index, int base);
+  void modrm_mem(int reg, Reg base, std::int32_t disp);
+  void modrm_cell(int reg, Reg base, Reg index);
+  void modrm_reg(int reg, int rm);
+};
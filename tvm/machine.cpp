@@ -0,0 +1,588 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+#include <iostream>
+#include <algorithm>
+#include <map>
+#include <cstdlib>
+#include <cstring>
+
+#include "machine.h"
+
+using namespace std;
+
+/// value of a char constant, as tvm reads it: '\n' and '\t' are
+/// the only escapes, otherwise the first character is taken
+static uint32_t char_value(const string &s) {
+  if (s == "\\n") return '\n';
+  if (s == "\\t") return '\t';
+  return s.empty() ? 0 : (unsigned char)s[0];
+}
+
+
+/// constructor
+machine::machine() : mainIndex(0), engine(THREADED), threadedLinked(false),
+                     jitThreshold(JIT_THRESHOLD), hot(false), sp(0) {}
+/// destructor
+machine::~machine() {}
+
+/// select the execution engine
+void machine::set_engine(Engine e) { engine = e; }
+
+/// set the number of calls and back-edges to compile a subroutine
+void machine::set_jit_threshold(unsigned n) { jitThreshold = n; }
+
+
+////////////////////////////////////////////////////////////////////
+/// Loading
+
+/// create a decoded subroutine, laying out its params and vars
+machine::decodedSubroutine machine::new_subroutine(const std::string &name,
+                                                   const std::vector<var> &params,
+                                                   const std::vector<var> &vars) {
+  decodedSubroutine ds;
+  ds.name = name;
+  ds.params = params;
+  ds.vars = vars;
+  ds.varCells = 0;
+  ds.numTemps = 0;
+  uint32_t offset = 0;
+  for (const auto &p : params) ds.offsets.insert(make_pair(operand(p.name).handle(), offset++));
+  for (const auto &v : vars) {
+    ds.offsets.insert(make_pair(operand(v.name).handle(), offset));
+    offset += v.size;
+    ds.varCells += v.size;
+  }
+  return ds;
+}
+
+/// decode one instruction
+machine::decodedInstruction machine::decode(const instruction &inst, decodedSubroutine &ds) {
+  decodedInstruction di;
+  di.oper = inst.oper;
+  di.arg1 = inst.arg1;
+  di.arg2 = inst.arg2;
+  di.arg3 = inst.arg3;
+  di.target = 0;
+  di.imm = 0;
+  switch (inst.oper) {
+  case instruction::_ILOAD :
+    di.imm = inst.arg2.kind() == operand::_INTEGER ? inst.arg2.int_value()
+                                                   : uint32_t(strtol(inst.arg2.str().c_str(), nullptr, 10));
+    break;
+  case instruction::_FLOAD : di.imm = float_bits(strtof(inst.arg2.str().c_str(), nullptr)); break;
+  case instruction::_CHLOAD : di.imm = char_value(inst.arg2.str()); break;
+  case instruction::_COPYN :
+    di.imm = inst.arg3.kind() == operand::_INTEGER ? inst.arg3.int_value()
+                                                   : uint32_t(strtoul(inst.arg3.str().c_str(), nullptr, 10));
+    break;
+  case instruction::_CALL :
+    if (inst.arg2.empty()) break;
+    di.imm = inst.arg2.kind() == operand::_INTEGER ? inst.arg2.int_value()
+                                                   : uint32_t(strtoul(inst.arg2.str().c_str(), nullptr, 10));
+    break;
+  case instruction::_WRITES :
+  case instruction::_POPN :
+    di.imm = inst.arg1.kind() == operand::_INTEGER ? inst.arg1.int_value()
+                                                   : uint32_t(strtoul(inst.arg1.str().c_str(), nullptr, 10));
+    break;
+  default :
+    if (inst.is_immediate() and inst.oper >= instruction::_FADDI)
+      di.imm = float_bits(strtof(inst.arg3.str().c_str(), nullptr));
+    else if (inst.is_immediate())
+      di.imm = inst.arg3.kind() == operand::_INTEGER ? inst.arg3.int_value()
+                                                     : uint32_t(strtol(inst.arg3.str().c_str(), nullptr, 10));
+    break;
+  }
+  for (const operand *op : {&inst.arg1, &inst.arg2, &inst.arg3})
+    if (op->is_temp()) ds.numTemps = max<uint32_t>(ds.numTemps, op->temp_number()+1);
+  return di;
+}
+
+/// check the loaded subroutines can be run
+bool machine::check_subroutines() {
+  map<string, size_t> seen;
+  bool ok = true;
+  for (size_t s = 0; s < subs.size(); ++s) {
+    if (not seen.insert(make_pair(subs[s].name, s)).second) {
+      cerr << "ERROR - function '" << subs[s].name << "' declared more than once" << endl;
+      ok = false;
+    }
+  }
+  auto m = seen.find("main");
+  if (m == seen.end()) {
+    cerr << "ERROR - 'main' function not declared" << endl;
+    return false;
+  }
+  mainIndex = m->second;
+  if (not subs[mainIndex].params.empty()) {
+    cerr << "ERROR - 'main' function does not admit parameters" << endl;
+    ok = false;
+  }
+  return ok;
+}
+
+/// load a program from a 'code' object
+bool machine::load(const code &prog) {
+  threadedLinked = false;
+  native.clear();
+  const vector<subroutine> &psubs = prog.get_subroutines();
+  strings = prog.get_strings();
+  map<string, size_t> index;
+  for (size_t s = 0; s < psubs.size(); ++s) index.insert(make_pair(psubs[s].get_name(), s));
+
+  subs.clear();
+  bool ok = true;
+  for (const auto &s : psubs) {
+    decodedSubroutine ds = new_subroutine(s.get_name(), vector<var>(s.params.begin(), s.params.end()),
+                                          vector<var>(s.vars.begin(), s.vars.end()));
+    const std::map<string, size_t> &labels = s.get_labels();
+    for (const auto &inst : s.get_instructions()) {
+      decodedInstruction di = decode(inst, ds);
+      if (inst.is_jump()) {
+        string lab = inst.jump_label().str();
+        auto l = labels.find(lab);
+        if (l == labels.end()) {
+          cerr << "ERROR - Jump to undeclared label " << lab << endl;
+          ok = false;
+        }
+        else di.target = l->second;
+      }
+      else if (inst.oper == instruction::_CALL) {
+        auto f = index.find(inst.arg1.str());
+        if (f == index.end()) {
+          cerr << "ERROR - Calling undeclared subroutine " << inst.arg1.str() << endl;
+          ok = false;
+        }
+        else di.target = f->second;
+      }
+      else if (inst.oper == instruction::_WRITES and di.imm >= strings.size()) {
+        cerr << "ERROR - Writing undeclared string " << inst.arg1.str() << endl;
+        ok = false;
+      }
+      ds.code.push_back(di);
+      ds.source.push_back(inst);
+    }
+    thread(ds);
+    subs.push_back(std::move(ds));
+  }
+  native.resize(subs.size());
+  return check_subroutines() and ok;
+}
+
+/// load a program from a mapped binary file: tables are used as they
+/// are, and jump/call targets come already resolved
+bool machine::load(const binaryCode &bin) {
+  const binaryCode::header &hdr = bin.get_header();
+  const binaryCode::subroutineEntry *bsubs = bin.get_subroutines();
+  const binaryCode::varEntry *bvars = bin.get_vars();
+  const binaryCode::instructionEntry *binstrs = bin.get_instructions();
+
+  // operand for each encoded operand (each one is translated once)
+  unordered_map<uint32_t, operand> operands;
+  auto translate = [&](uint32_t arg) {
+    auto it = operands.find(arg);
+    if (it == operands.end()) it = operands.insert(make_pair(arg, operand(bin.get_operand_text(arg)))).first;
+    return it->second;
+  };
+
+  threadedLinked = false;
+  native.clear();
+  subs.clear();
+  strings.clear();
+  for (uint32_t i = 0; i < hdr.numConstants; ++i) strings.push_back(bin.get_constant(i));
+  bool ok = true;
+  for (uint32_t s = 0; s < hdr.numSubroutines; ++s) {
+    const binaryCode::subroutineEntry &se = bsubs[s];
+    vector<var> params, vars;
+    for (uint32_t p = se.firstParam; p < se.firstParam + se.numParams; ++p)
+      params.push_back(var(bin.get_string(bvars[p].name), 0));
+    for (uint32_t v = se.firstVar; v < se.firstVar + se.numVars; ++v)
+      vars.push_back(var(bin.get_string(bvars[v].name), bvars[v].size));
+    decodedSubroutine ds = new_subroutine(bin.get_string(se.name), params, vars);
+    for (uint32_t i = se.firstInstruction; i < se.firstInstruction + se.numInstructions; ++i) {
+      instruction inst(instruction::Operation(binstrs[i].oper));
+      inst.arg1 = translate(binstrs[i].arg1);
+      inst.arg2 = translate(binstrs[i].arg2);
+      inst.arg3 = translate(binstrs[i].arg3);
+      decodedInstruction di = decode(inst, ds);
+      if (inst.is_jump() or inst.oper == instruction::_CALL) {
+        if (binstrs[i].target == binaryCode::NO_TARGET) {
+          if (inst.oper == instruction::_CALL)
+            cerr << "ERROR - Calling undeclared subroutine " << inst.arg1.str() << endl;
+          else
+            cerr << "ERROR - Jump to undeclared label " << inst.jump_label().str() << endl;
+          ok = false;
+        }
+        else di.target = binstrs[i].target;
+      }
+      else if (inst.oper == instruction::_WRITES and di.imm >= strings.size()) {
+        cerr << "ERROR - Writing undeclared string " << inst.arg1.str() << endl;
+        ok = false;
+      }
+      ds.code.push_back(di);
+      ds.source.push_back(inst);
+    }
+    thread(ds);
+    subs.push_back(std::move(ds));
+  }
+  native.resize(subs.size());
+  return check_subroutines() and ok;
+}
+
+
+////////////////////////////////////////////////////////////////////
+/// Memory and frames
+
+/// memory cell at given address
+uint32_t & machine::cell(std::int64_t addr) {
+  if (addr < 0 or addr >= int64_t(MEMORY_SIZE)) throw crash("Invalid memory reference.");
+  return mem[addr];
+}
+
+/// copy n cells from src to dst (the ranges may overlap)
+void machine::copy_cells(std::int64_t dst, std::int64_t src, std::uint32_t n) {
+  if (n == 0) return;
+  if (dst < 0 or src < 0 or dst + n > int64_t(MEMORY_SIZE) or src + n > int64_t(MEMORY_SIZE))
+    throw crash("Invalid memory reference.");
+  memmove(&mem[dst], &mem[src], n * sizeof(uint32_t));
+}
+
+/// address of a param or var of the current frame
+std::int64_t machine::address_of(const operand &op) {
+  const frame &f = frames.back();
+  auto it = f.sub->offsets.find(op.handle());
+  if (it == f.sub->offsets.end()) throw crash("Undefined ID " + op.str());
+  return f.base + it->second;
+}
+
+/// temporary of the current frame
+uint32_t & machine::temp(const operand &op) {
+  return temps[frames.back().tempBase + op.temp_number()];
+}
+
+/// value of an operand (temporary or variable)
+uint32_t machine::read(const operand &op) {
+  if (op.is_temp()) {
+    if (not tempDefined[frames.back().tempBase + op.temp_number()]) throw crash("Undefined TEMP " + op.str());
+    return temp(op);
+  }
+  return cell(address_of(op));
+}
+
+/// store a value into an operand (temporary or variable)
+void machine::write(const operand &op, std::uint32_t v) {
+  if (op.is_temp()) {
+    tempDefined[frames.back().tempBase + op.temp_number()] = true;
+    temp(op) = v;
+  }
+  else cell(address_of(op)) = v;
+}
+
+/// push a value on the stack
+void machine::push(std::uint32_t v) {
+  if (sp >= MEMORY_SIZE) throw crash("Stack overflow.");
+  mem[sp++] = v;
+}
+
+/// pop a value from the stack
+uint32_t machine::pop() {
+  if (sp == 0) throw crash("Stack underflow.");
+  return mem[--sp];
+}
+
+/// print a value as tvm debug mode does
+static string cell_text(uint32_t v) { return to_string(int32_t(v)); }
+
+/// contents of the stack, for debugging
+static string stack_text(const vector<uint32_t> &mem, size_t sp) {
+  string s = "[";
+  for (size_t i = 0; i < sp; ++i) s += (i ? "," : "") + cell_text(mem[i]);
+  return s + ")";
+}
+
+/// start running subroutine s: its params are the topmost cells
+void machine::push_frame(std::size_t s, std::size_t returnPc, std::uint32_t argCells) {
+  const decodedSubroutine &ds = subs[s];
+  frame f;
+  f.sub = &ds;
+  f.base = int64_t(sp) - int64_t(ds.params.size());
+  f.tempBase = temps.size();
+  f.returnPc = returnPc;
+  f.argCells = argCells;
+  if (sp + ds.varCells > MEMORY_SIZE or frames.size() >= MAX_FRAMES) throw crash("Stack overflow.");
+  fill(mem.begin() + sp, mem.begin() + sp + ds.varCells, 0);
+  sp += ds.varCells;
+  temps.resize(f.tempBase + ds.numTemps);
+  tempDefined.resize(f.tempBase + ds.numTemps);
+  frames.push_back(f);
+}
+
+/// finish running current subroutine: pop its vars and temporaries
+/// (and the args, for a "call f k").
+/// Returns the pc where the caller resumes
+std::size_t machine::pop_frame() {
+  const frame &f = frames.back();
+  size_t returnPc = f.returnPc;
+  if (uint64_t(f.sub->varCells) + f.argCells > sp) throw crash("Stack underflow.");
+  sp -= f.sub->varCells + f.argCells;
+  temps.resize(f.tempBase);
+  tempDefined.resize(f.tempBase);
+  frames.pop_back();
+  return returnPc;
+}
+
+/// print state of the current frame (stack, vars, temporaries)
+void machine::trace_state() const {
+  const frame &f = frames.back();
+  cerr << "VM_DEBUG:           " << stack_text(mem, sp) << endl;
+
+  map<string, uint32_t> vars;
+  for (const auto *vs : {&f.sub->params, &f.sub->vars})
+    for (const auto &v : *vs) {
+      int64_t addr = f.base + f.sub->offsets.find(operand(v.name).handle())->second;
+      vars[v.name] = (addr >= 0 and addr < int64_t(MEMORY_SIZE)) ? mem[addr] : 0;
+    }
+  map<string, uint32_t> tmps;
+  for (uint32_t t = 0; t < f.sub->numTemps; ++t)
+    if (tempDefined[f.tempBase + t]) tmps["%" + to_string(t)] = temps[f.tempBase + t];
+
+  string s;
+  for (const auto &v : vars) s += (s.empty() ? "" : ", ") + v.first + "=" + cell_text(v.second);
+  string t;
+  for (const auto &v : tmps) t += (t.empty() ? "" : ", ") + v.first + "=" + cell_text(v.second);
+  cerr << "VM_DEBUG:           {" << s << "} {" << t << "}" << endl;
+}
+
+
+////////////////////////////////////////////////////////////////////
+/// Execution
+
+/// run loaded program
+int machine::run(bool debug) {
+  mem.assign(MEMORY_SIZE, 0);
+  sp = 0;
+  temps.clear();
+  tempDefined.clear();
+  frames.clear();
+  try {
+    enter(mainIndex, 0, debug);
+    size_t pc = 0;
+    if (engine == JIT and not debug) pc = run_jit(pc);
+    else if (engine == THREADED and not debug) pc = run_threaded(pc);
+    if (not frames.empty()) run_switch(debug, pc);
+  }
+  catch (crash &c) {
+    cout.flush();
+    cerr << "VM_CRASH: " << c.msg << endl;
+    return EXIT_FAILURE;
+  }
+  cout.flush();
+  return EXIT_SUCCESS;
+}
+
+/// enter subroutine s (with debug trace)
+void machine::enter(std::size_t s, std::size_t returnPc, bool debug, std::uint32_t argCells) {
+  if (debug) cerr << "VM_DEBUG: Entering " << subs[s].name << ". stack=" << stack_text(mem, sp) << endl;
+  push_frame(s, returnPc, argCells);
+  if (debug) {
+    const frame &f = frames.back();
+    for (size_t p = f.sub->params.size(); p-- > 0; )
+      cerr << "VM_DEBUG:    Found param " << f.sub->params[p].name << "=" << cell_text(cell(f.base + p)) << endl;
+    for (const auto &v : f.sub->vars) cerr << "VM_DEBUG:    Added variable " << v.name << endl;
+    cerr << "VM_DEBUG:    Starting function execution. " << stack_text(mem, sp) << endl;
+  }
+}
+
+/// the interpreter loop: fetch, switch on the operation code, execute
+void machine::run_switch(bool debug, std::size_t pc) {
+  while (true) {
+    const decodedSubroutine &s = *frames.back().sub;
+    if (pc >= s.code.size()) {
+      if (debug) cerr << "VM_DEBUG:    PC=" << pc << ".    ????" << endl;
+      throw crash("Control reaches end of subroutine " + s.name + ". Missing 'return' ?");
+    }
+    const decodedInstruction &in = s.code[pc];
+    if (debug) cerr << "VM_DEBUG:    PC=" << pc << ". " << s.source[pc].dump() << endl;
+    ++pc;
+
+    switch (in.oper) {
+    case instruction::_LABEL :
+    case instruction::_NOOP : break;
+    case instruction::_UJUMP : pc = in.target; break;
+    case instruction::_FJUMP : if (not read(in.arg1)) pc = in.target; break;
+    case instruction::_FJEQ :
+    case instruction::_FJNE :
+    case instruction::_FJLT :
+    case instruction::_FJLE : {
+      int32_t a = read(in.arg1), b = read(in.arg2);
+      bool c = in.oper == instruction::_FJEQ ? a == b : in.oper == instruction::_FJNE ? a != b :
+               in.oper == instruction::_FJLT ? a < b : a <= b;
+      if (not c) pc = in.target;
+      break;
+    }
+    case instruction::_FJFEQ :
+    case instruction::_FJFNE :
+    case instruction::_FJFLT :
+    case instruction::_FJFLE : {
+      float a = bits_float(read(in.arg1)), b = bits_float(read(in.arg2));
+      bool c = in.oper == instruction::_FJFEQ ? a == b : in.oper == instruction::_FJFNE ? a != b :
+               in.oper == instruction::_FJFLT ? a < b : a <= b;
+      if (not c) pc = in.target;
+      break;
+    }
+    case instruction::_PUSH : push(in.arg1.empty() ? 0 : read(in.arg1)); break;
+    case instruction::_POP : {
+      uint32_t v = pop();
+      if (not in.arg1.empty()) write(in.arg1, v);
+      break;
+    }
+    case instruction::_POPN : {
+      if (in.imm > sp) throw crash("Stack underflow.");
+      sp -= in.imm;
+      break;
+    }
+    case instruction::_CALL : {
+      enter(in.target, pc, debug, in.imm);
+      pc = 0;
+      continue;
+    }
+    case instruction::_RETURN : {
+      if (debug) {
+        trace_state();
+        cerr << "VM_DEBUG:    PC=" << pc-1 << ". return found" << endl;
+      }
+      string name = s.name;
+      pc = pop_frame();
+      if (debug) cerr << "VM_DEBUG: Exiting " << name << ". stack=" << stack_text(mem, sp) << endl;
+      if (frames.empty()) return;
+      break;
+    }
+
+    case instruction::_ADD : write(in.arg1, read(in.arg2) + read(in.arg3)); break;
+    case instruction::_SUB : write(in.arg1, read(in.arg2) - read(in.arg3)); break;
+    case instruction::_MUL : write(in.arg1, read(in.arg2) * read(in.arg3)); break;
+    case instruction::_DIV : {
+      int32_t a = read(in.arg2), b = read(in.arg3);
+      if (b == 0 or (b == -1 and a == INT32_MIN)) throw crash("Division by zero.");
+      write(in.arg1, a / b);
+      break;
+    }
+    case instruction::_EQ : write(in.arg1, read(in.arg2) == read(in.arg3)); break;
+    case instruction::_LT : write(in.arg1, int32_t(read(in.arg2)) < int32_t(read(in.arg3))); break;
+    case instruction::_LE : write(in.arg1, int32_t(read(in.arg2)) <= int32_t(read(in.arg3))); break;
+    case instruction::_AND : {
+      uint32_t a = read(in.arg2), b = read(in.arg3);
+      write(in.arg1, a and b);
+      break;
+    }
+    case instruction::_OR : {
+      uint32_t a = read(in.arg2), b = read(in.arg3);
+      write(in.arg1, a or b);
+      break;
+    }
+    case instruction::_NOT : write(in.arg1, not read(in.arg2)); break;
+    case instruction::_NEG : write(in.arg1, -read(in.arg2)); break;
+    case instruction::_FLOAT : write(in.arg1, float_bits(float(int32_t(read(in.arg2))))); break;
+
+    case instruction::_FADD : write(in.arg1, float_bits(bits_float(read(in.arg2)) + bits_float(read(in.arg3)))); break;
+    case instruction::_FSUB : write(in.arg1, float_bits(bits_float(read(in.arg2)) - bits_float(read(in.arg3)))); break;
+    case instruction::_FMUL : write(in.arg1, float_bits(bits_float(read(in.arg2)) * bits_float(read(in.arg3)))); break;
+    case instruction::_FDIV : write(in.arg1, float_bits(bits_float(read(in.arg2)) / bits_float(read(in.arg3)))); break;
+    case instruction::_FEQ : write(in.arg1, bits_float(read(in.arg2)) == bits_float(read(in.arg3))); break;
+    case instruction::_FLT : write(in.arg1, bits_float(read(in.arg2)) < bits_float(read(in.arg3))); break;
+    case instruction::_FLE : write(in.arg1, bits_float(read(in.arg2)) <= bits_float(read(in.arg3))); break;
+    case instruction::_FNEG : write(in.arg1, float_bits(-bits_float(read(in.arg2)))); break;
+
+    case instruction::_ADDI : write(in.arg1, read(in.arg2) + in.imm); break;
+    case instruction::_SUBI : write(in.arg1, read(in.arg2) - in.imm); break;
+    case instruction::_MULI : write(in.arg1, read(in.arg2) * in.imm); break;
+    case instruction::_DIVI : {
+      int32_t a = read(in.arg2), b = in.imm;
+      if (b == 0 or (b == -1 and a == INT32_MIN)) throw crash("Division by zero.");
+      write(in.arg1, a / b);
+      break;
+    }
+    case instruction::_EQI : write(in.arg1, read(in.arg2) == in.imm); break;
+    case instruction::_LTI : write(in.arg1, int32_t(read(in.arg2)) < int32_t(in.imm)); break;
+    case instruction::_LEI : write(in.arg1, int32_t(read(in.arg2)) <= int32_t(in.imm)); break;
+    case instruction::_GTI : write(in.arg1, int32_t(read(in.arg2)) > int32_t(in.imm)); break;
+    case instruction::_GEI : write(in.arg1, int32_t(read(in.arg2)) >= int32_t(in.imm)); break;
+    case instruction::_FADDI : write(in.arg1, float_bits(bits_float(read(in.arg2)) + bits_float(in.imm))); break;
+    case instruction::_FSUBI : write(in.arg1, float_bits(bits_float(read(in.arg2)) - bits_float(in.imm))); break;
+    case instruction::_FMULI : write(in.arg1, float_bits(bits_float(read(in.arg2)) * bits_float(in.imm))); break;
+    case instruction::_FDIVI : write(in.arg1, float_bits(bits_float(read(in.arg2)) / bits_float(in.imm))); break;
+    case instruction::_FEQI : write(in.arg1, bits_float(read(in.arg2)) == bits_float(in.imm)); break;
+    case instruction::_FLTI : write(in.arg1, bits_float(read(in.arg2)) < bits_float(in.imm)); break;
+    case instruction::_FLEI : write(in.arg1, bits_float(read(in.arg2)) <= bits_float(in.imm)); break;
+    case instruction::_FGTI : write(in.arg1, bits_float(read(in.arg2)) > bits_float(in.imm)); break;
+    case instruction::_FGEI : write(in.arg1, bits_float(read(in.arg2)) >= bits_float(in.imm)); break;
+
+    case instruction::_LOAD : write(in.arg1, read(in.arg2)); break;
+    case instruction::_ILOAD :
+    case instruction::_FLOAD :
+    case instruction::_CHLOAD : write(in.arg1, in.imm); break;
+    case instruction::_XLOAD : {
+      // a1[a2] = a3: a1 is an array var, or a temporary holding its address
+      int64_t base = in.arg1.is_temp() ? int64_t(int32_t(read(in.arg1))) : address_of(in.arg1);
+      int64_t addr = base + int32_t(read(in.arg2));
+      cell(addr) = read(in.arg3);
+      break;
+    }
+    case instruction::_LOADX : {
+      // a1 = a2[a3]
+      int64_t base = in.arg2.is_temp() ? int64_t(int32_t(read(in.arg2))) : address_of(in.arg2);
+      write(in.arg1, cell(base + int32_t(read(in.arg3))));
+      break;
+    }
+    case instruction::_ALOAD : write(in.arg1, uint32_t(address_of(in.arg2))); break;
+    case instruction::_LOADC : write(in.arg1, cell(int32_t(read(in.arg2)))); break;
+    case instruction::_CLOAD : cell(int32_t(read(in.arg1))) = read(in.arg2); break;
+    case instruction::_COPYN : {
+      // copyn a1 a2 k: a1 and a2 are array vars, or temporaries holding their address
+      int64_t dst = in.arg1.is_temp() ? int64_t(int32_t(read(in.arg1))) : address_of(in.arg1);
+      int64_t src = in.arg2.is_temp() ? int64_t(int32_t(read(in.arg2))) : address_of(in.arg2);
+      copy_cells(dst, src, in.imm);
+      break;
+    }
+
+    case instruction::_READI : { int v = 0; cin >> v; write(in.arg1, v); break; }
+    case instruction::_READF : { float v = 0; cin >> v; write(in.arg1, float_bits(v)); break; }
+    case instruction::_READC : { char v = 0; cin >> v; write(in.arg1, (unsigned char)v); break; }
+    case instruction::_WRITEI : cout << int32_t(read(in.arg1)); break;
+    case instruction::_WRITEF : cout << bits_float(read(in.arg1)); break;
+    case instruction::_WRITEC : cout << char(read(in.arg1)); break;
+    case instruction::_WRITELN : cout << '\n'; break;
+    case instruction::_WRITES : cout << strings[in.imm]; break;
+
+    default : throw crash("Invalid instruction at PC=" + to_string(pc-1) + " in " + s.name);
+    }
+    if (debug) trace_state();
+  }
+}
@@ -0,0 +1,305 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+
+#include "code.h"
+#include "codeBinary.h"
+#include "jit.h"
+
+////////////////////////////////////////////////////////////////////
+/// Class machine executes t-code programs, with the same semantics
+/// (and output) as the tvm binary:
+///   - memory is an array of 32-bit cells, used as a stack. Floats
+///     are stored as their bit pattern.
+///   - on a call, the last pushed cells become the callee params
+///     (the first param is the deepest one), and its local vars are
+///     pushed (zero-initialized) on top of them. 'return' pops them.
+///   - temporaries (%N) are private to each activation, and reading
+///     one that has not been written is an error.
+///
+/// Programs are pre-decoded when loaded: every subroutine becomes a
+/// dense array of instructions whose jumps and calls already hold
+/// their target, and whose constants are already converted.
+///
+/// There are two execution engines: a loop that switches on the
+/// operation code of each decoded instruction (also used to trace the
+/// execution in debug mode), and threaded code, where every operand
+/// has been resolved to a frame slot, a temporary slot or an inline
+/// constant, and each instruction jumps directly to the next one
+/// (with computed goto, where the compiler supports it).
+///
+/// The JIT engine runs threaded code while counting calls and taken
+/// back-edges of each subroutine. When a subroutine passes a threshold
+/// it is compiled to x86-64 code, which is entered at its start or at
+/// the loop header being run. Native code leaves to the interpreter at
+/// the instruction where anything would go wrong, so errors are the
+/// ones of the interpreter.
+
+class machine {
+public:
+  /// size of the memory, in cells
+  static const std::size_t MEMORY_SIZE = 1 << 20;
+  /// maximum number of active calls (tvm dies on its own stack when
+  /// recursion is too deep; this reports a stack overflow instead)
+  static const std::size_t MAX_FRAMES = 1 << 20;
+
+  /// execution engines
+  typedef enum {SWITCH, THREADED, JIT} Engine;
+  /// default number of calls and back-edges that make a subroutine hot
+  static const unsigned JIT_THRESHOLD = 100;
+
+  /// constructor and destructor
+  machine();
+  ~machine();
+
+  /// select the execution engine (default is THREADED). Debug mode
+  /// always uses the SWITCH engine
+  void set_engine(Engine e);
+  /// set the number of calls and back-edges to compile a subroutine
+  void set_jit_threshold(unsigned n);
+
+  /// load a program (from a 'code' object or a mapped binary file).
+  /// Load errors are reported on std::cerr, and make it return false
+  bool load(const code &prog);
+  bool load(const binaryCode &bin);
+
+  /// run loaded program from 'main'. In debug mode, a trace of each
+  /// executed instruction is written on std::cerr.
+  /// Returns the exit status of the program.
+  int run(bool debug=false);
+
+protected:
+  /// operations of threaded code. They are more specific than the
+  /// ones of t-code, depending on the kind of their operands
+  typedef enum {T_NOOP, T_UJUMP, T_FJUMP,
+                T_FJEQ, T_FJNE, T_FJLT, T_FJLE, T_FJFEQ, T_FJFNE, T_FJFLT, T_FJFLE, T_PUSH, T_POP, T_DROP, T_POPN, T_CALL, T_RETURN,
+                T_ADD, T_SUB, T_MUL, T_DIV, T_EQ, T_LT, T_LE, T_NEG, T_NOT, T_AND, T_OR, T_FLOAT,
+                T_FADD, T_FSUB, T_FMUL, T_FDIV, T_FEQ, T_FLT, T_FLE, T_FNEG,
+                T_LOAD, T_XLOAD_VAR, T_XLOAD_PTR, T_LOADX_VAR, T_LOADX_PTR, T_ALOAD, T_LOADC, T_CLOAD,
+                T_COPYN, T_READI, T_READF, T_READC, T_WRITEI, T_WRITEF, T_WRITEC, T_WRITELN, T_WRITES,
+                T_UNDEFINED, T_END, T_INVALID} ThreadedOp;
+
+  /// where the value of a resolved operand lives: a slot of the frame
+  /// (params and vars), a temporary, or a constant of the subroutine
+  typedef enum {FRAME_SLOT, TEMP_SLOT, CONST_SLOT} SlotBase;
+  /// checks still needed when accessing a slot: none, whether the
+  /// temporary is defined, or it is an undeclared name
+  typedef enum {NO_CHECK, CHECK_TEMP, UNDEFINED_ID} SlotCheck;
+
+  /// a resolved operand
+  class slot {
+  public:
+    std::uint32_t index;
+    std::uint8_t base, check;
+  };
+
+  /// an instruction of threaded code
+  class threadedInstruction {
+  public:
+    /// code that executes it (computed goto), and its operation
+    const void *handler;
+    std::uint32_t op;
+    slot a1, a2, a3;
+    /// jump target, or called subroutine (index)
+    const threadedInstruction *target;
+    std::uint32_t callee;
+    /// pc of the t-code instruction it comes from
+    std::uint32_t pc;
+  };
+
+  /// decoded instruction
+  class decodedInstruction {
+  public:
+    instruction::Operation oper;
+    operand arg1, arg2, arg3;
+    /// jump target (pc) or called subroutine (index), if any
+    std::uint32_t target;
+    /// value of a constant (ILOAD, FLOAD, CHLOAD), of the literal of
+    /// the immediate forms (ADDI..FGEI), the count of COPYN, the
+    /// string constant of WRITES, or the cells popped by POPN and CALL
+    std::uint32_t imm;
+  };
+
+  /// decoded subroutine
+  class decodedSubroutine {
+  public:
+    std::string name;
+    /// params and local vars, in order. Their cells are contiguous in
+    /// the activation frame, params first
+    std::vector<var> params, vars;
+    /// offset in the frame of each param and local var (by handle)
+    std::unordered_map<std::uint32_t, std::uint32_t> offsets;
+    /// number of cells for local vars
+    std::uint32_t varCells;
+    /// largest temporary number used, plus one
+    std::uint32_t numTemps;
+    /// instructions, and their original form (for debugging)
+    std::vector<decodedInstruction> code;
+    std::vector<instruction> source;
+    /// threaded code (labels are dropped, and a final T_END added),
+    /// position in it of each pc, constants, and undeclared names
+    std::vector<threadedInstruction> threaded;
+    std::vector<std::uint32_t> threadedIndex;
+    std::vector<std::uint32_t> constants;
+    std::vector<std::string> names;
+  };
+
+  /// an activation frame
+  class frame {
+  public:
+    /// running subroutine
+    const decodedSubroutine *sub;
+    /// address of first param (vars follow them)
+    std::int64_t base;
+    /// position of its temporaries in 'temps'
+    std::size_t tempBase;
+    /// where to resume in the caller, and cells it pops then (the
+    /// args of a "call f k")
+    std::size_t returnPc;
+    std::uint32_t argCells;
+  };
+
+  /// error that stops the execution
+  class crash {
+  public:
+    std::string msg;
+    crash(const std::string &m) : msg(m) {}
+  };
+
+  /// loaded program (with its string constants), and index of 'main'
+  std::vector<decodedSubroutine> subs;
+  std::vector<std::string> strings;
+  std::size_t mainIndex;
+  /// selected engine, and whether threaded code has its handlers set
+  Engine engine;
+  bool threadedLinked;
+
+  /// state shared with native code, at fixed offsets
+  class jitContext {
+  public:
+    /// frame slots, temporaries, and their 'defined' flags
+    std::uint32_t *fp, *tp;
+    std::uint8_t *td;
+    /// memory, stack pointer, and address of the frame
+    std::uint32_t *mem;
+    std::size_t *sp;
+    std::int64_t base;
+    /// status returned when leaving native code
+    std::uint64_t status;
+    machine *vm;
+  };
+  /// native code of a subroutine, with the offset of each threaded
+  /// instruction in it, and its hotness
+  class nativeSubroutine {
+  public:
+    std::unique_ptr<executableMemory> code;
+    std::vector<std::uint32_t> offsets;
+    unsigned hotness = 0;
+    bool failed = false;
+  };
+  jitContext context;
+  std::vector<nativeSubroutine> native;
+  std::unique_ptr<executableMemory> trampoline;
+  unsigned jitThreshold;
+  /// set when the threaded engine stops to enter native code
+  bool hot;
+
+  /// memory, and number of cells in use
+  std::vector<std::uint32_t> mem;
+  std::size_t sp;
+  /// temporaries of all active frames, and whether they are defined
+  std::vector<std::uint32_t> temps;
+  std::vector<std::uint8_t> tempDefined;
+  /// active frames
+  std::vector<frame> frames;
+
+  /// create a decoded subroutine, laying out its params and vars
+  static decodedSubroutine new_subroutine(const std::string &name,
+                                          const std::vector<var> &params,
+                                          const std::vector<var> &vars);
+  /// decode one instruction of a subroutine (targets are set apart)
+  static decodedInstruction decode(const instruction &inst, decodedSubroutine &ds);
+  /// check the loaded subroutines can be run (unique names, 'main')
+  bool check_subroutines();
+  /// build the threaded code of a decoded subroutine
+  static void thread(decodedSubroutine &ds);
+
+  /// operations on the current frame
+  void enter(std::size_t s, std::size_t returnPc, bool debug, std::uint32_t argCells=0);
+  void push_frame(std::size_t s, std::size_t returnPc, std::uint32_t argCells=0);
+  std::size_t pop_frame();
+  std::uint32_t & cell(std::int64_t addr);
+  void copy_cells(std::int64_t dst, std::int64_t src, std::uint32_t n);
+  std::int64_t address_of(const operand &op);
+  std::uint32_t & temp(const operand &op);
+  std::uint32_t read(const operand &op);
+  void write(const operand &op, std::uint32_t v);
+  void push(std::uint32_t v);
+  std::uint32_t pop();
+
+  /// the engines: run from given pc of the current frame until the
+  /// program ends. The threaded and JIT ones may stop earlier (on
+  /// calls with missing params), returning the pc where the switch
+  /// loop resumes
+  void run_switch(bool debug, std::size_t pc);
+  std::size_t run_threaded(std::size_t pc);
+  std::size_t run_jit(std::size_t pc);
+
+  /// JIT: count a call or back-edge of subroutine s, compiling it if
+  /// it becomes hot. True if it has native code
+  bool tier_up(std::size_t s);
+  bool jit_compile(std::size_t s);
+  /// address of native code for a pc of subroutine s
+  const void * native_entry(std::size_t s, std::size_t pc) const;
+  /// update the context with the current frame
+  void sync_context();
+  /// run native code until it leaves. Returns its status
+  std::uint64_t run_native(const void *entry);
+  /// status of native code when the program has finished (otherwise,
+  /// it is the pc where the interpreter goes on)
+  static const std::uint64_t NATIVE_DONE = std::uint64_t(1) << 32;
+  /// helpers called from native code (they never throw)
+  static const void * jit_call(jitContext *ctx, std::uint32_t callee, std::uint32_t pc,
+                               std::uint32_t argCells);
+  static const void * jit_return(jitContext *ctx, std::uint32_t pc);
+  /// debug trace helpers
+  void trace_state() const;
+
+  /// bit pattern of a float, and float with a given bit pattern
+  static std::uint32_t float_bits(float f) { std::uint32_t v; std::memcpy(&v, &f, sizeof(v)); return v; }
+  static float bits_float(std::uint32_t v) { float f; std::memcpy(&f, &v, sizeof(f)); return f; }
+};
@@ -0,0 +1,131 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////
+//
+//    tbench - compares the execution engines of ctvm (switch loop,
+//             threaded code and JIT):
+//
+//       ./tbench [-n <runs>] myprogram.t ...
+//
+//    Each program is run <runs> times (default 5) with each engine,
+//    and the best time is reported. The output of the programs is
+//    not shown, but it is checked to be the same for all engines.
+//    Programs should not read any input.
+//
+////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <cstdlib>    // EXIT_FAILURE, EXIT_SUCCESS
+
+#include "code.h"
+#include "codeReader.h"
+#include "machine.h"
+
+
+// run a loaded program once, returning its output and time (seconds)
+static double run_once(machine &vm, std::string &output) {
+  std::ostringstream out;
+  std::streambuf *old = std::cout.rdbuf(out.rdbuf());
+  auto start = std::chrono::steady_clock::now();
+  vm.run();
+  std::cout.flush();
+  auto end = std::chrono::steady_clock::now();
+  std::cout.rdbuf(old);
+  output = out.str();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+
+int main(int argc, const char* argv[]) {
+  int runs = 5;
+  int first = 1;
+  if (argc > 2 and std::string(argv[1]) == "-n") {
+    runs = std::atoi(argv[2]);
+    first = 3;
+  }
+  if (first >= argc or runs <= 0) {
+    std::cerr << "Usage:" << std::endl;
+    std::cerr << "    " << argv[0] << " [-n <runs>] myprogram.t ..." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const machine::Engine engines[] = {machine::SWITCH, machine::THREADED, machine::JIT};
+  const char *names[] = {"switch", "threaded", "jit"};
+  const int numEngines = 3;
+
+  // times, and speedup of each engine over the switch loop
+  std::cout << std::left << std::setw(24) << "program" << std::right;
+  for (int e = 0; e < numEngines; ++e) std::cout << std::setw(12) << names[e];
+  for (int e = 1; e < numEngines; ++e) std::cout << std::setw(10) << names[e];
+  std::cout << std::endl;
+  int status = EXIT_SUCCESS;
+  for (int a = first; a < argc; ++a) {
+    std::ifstream in(argv[a]);
+    if (not in) {
+      std::cerr << "ERROR - cannot open file " << argv[a] << std::endl;
+      return EXIT_FAILURE;
+    }
+    codeReader reader(in);
+    code prog;
+    reader.read(prog);
+    machine vm;
+    if (reader.getNumberOfSyntaxErrors() > 0 or not vm.load(prog)) {
+      std::cerr << "Can not execute " << argv[a] << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    double best[numEngines];
+    std::string output[numEngines];
+    for (int e = 0; e < numEngines; ++e) {
+      vm.set_engine(engines[e]);
+      best[e] = run_once(vm, output[e]);
+      for (int r = 1; r < runs; ++r) {
+        std::string o;
+        best[e] = std::min(best[e], run_once(vm, o));
+      }
+    }
+    std::cout << std::left << std::setw(24) << argv[a] << std::right << std::fixed << std::setprecision(4);
+    for (int e = 0; e < numEngines; ++e) std::cout << std::setw(11) << best[e] << "s";
+    std::cout << std::setprecision(2);
+    for (int e = 1; e < numEngines; ++e) std::cout << std::setw(9) << best[0] / best[e] << "x";
+    std::cout << std::endl;
+    for (int e = 1; e < numEngines; ++e)
+      if (output[e] != output[0]) {
+        std::cerr << "ERROR - " << names[e] << " and " << names[0]
+                  << " engines disagree on the output of " << argv[a] << std::endl;
+        status = EXIT_FAILURE;
+      }
+  }
+  return status;
+}
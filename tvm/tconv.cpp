@@ -0,0 +1,115 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+////////////////////////////////////////////////////////////////
+//
+//    tconv - converts t-code programs between the text format
+//            and the binary (mappable) format, or translates them
+//            to C99 or to x86-64 assembly:
+//
+//       ./tconv myprogram.t myprogram.tb     (text -> binary)
+//       ./tconv myprogram.tb myprogram.t     (binary -> text)
+//       ./tconv myprogram.t myprogram.c      (text or binary -> C)
+//       ./tconv myprogram.t myprogram.s      (text or binary -> asm)
+//       ./tconv -O2 myprogram.t opt.t        (optimized, -> text)
+//
+//    The direction is chosen by looking at the input file (and at
+//    the extension of the output file, for text, C and asm). The
+//    optimization options are the same as for asl.
+//
+////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdlib>    // EXIT_FAILURE, EXIT_SUCCESS
+
+#include "code.h"
+#include "codeReader.h"
+#include "codeBinary.h"
+#include "codeC.h"
+#include "codeAsm.h"
+#include "passManager.h"
+
+
+int main(int argc, const char* argv[]) {
+  // optimization options, then input and output files
+  passManager optimizer = passManager::standard();
+  int first = 1;
+  while (first < argc and optimizer.parse_option(argv[first])) ++first;
+  if (argc - first != 2) {
+    std::cerr << "Usage:" << std::endl;
+    std::cerr << "    " << argv[0] << " " << passManager::usage() << " <input> <output>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const char *inName = argv[first], *outName = argv[first + 1];
+
+  // read the program, in either format
+  code prog;
+  bool binary = binaryCode::is_binary(inName);
+  if (binary) {
+    binaryCode bin;
+    std::string err;
+    if (not bin.map(inName, err)) {
+      std::cerr << "ERROR - " << err << std::endl;
+      return EXIT_FAILURE;
+    }
+    prog = bin.to_code();
+  }
+  else {
+    std::ifstream in(inName);
+    if (not in) {
+      std::cerr << "ERROR - cannot open file " << inName << std::endl;
+      return EXIT_FAILURE;
+    }
+    codeReader reader(in);
+    reader.read(prog);
+    if (reader.getNumberOfSyntaxErrors() > 0) {
+      std::cerr << "There are syntax errors." << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // optimize it, if asked to
+  optimizer.run(prog, std::cerr);
+
+  // write it in the other format, or as C or asm
+  std::string name = outName;
+  std::string ext = name.size() > 2 ? name.substr(name.size() - 2) : "";
+  std::ofstream out(outName, std::ios::binary);
+  if (ext == ".c") cCode::write(prog, out);
+  else if (ext == ".s") asmCode::write(prog, out);
+  else if (binary or ext == ".t") prog.dump(out);
+  else binaryCode::write(prog, out);
+  if (not out) {
+    std::cerr << "ERROR - cannot write file " << outName << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
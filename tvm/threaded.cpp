@@ -0,0 +1,584 @@
+/////////////////////////////////////////////////////////////////
+//
+//    TVM - t-Code Virtual Machine
+//
+//    Copyright (C) 2017  Universitat Politecnica de Catalunya
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU General Public License
+//    as published by the Free Software Foundation; either version 3
+//    of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+//    contact: Lluis Padro (padro@cs.upc.edu)
+//             Computer Science Department
+//             Universitat Politecnica de Catalunya
+//             despatx Omega.320 - Campus Nord UPC
+//             08034 Barcelona.  SPAIN
+//
+////////////////////////////////////////////////////////////////
+
+
+#include <iostream>
+#include <map>
+
+#include "machine.h"
+
+// Computed goto (labels as values) is a GNU extension
+#if defined(__GNUC__)
+#define MACHINE_COMPUTED_GOTO 1
+#endif
+
+using namespace std;
+
+
+////////////////////////////////////////////////////////////////////
+/// Building threaded code
+
+/// operations that write their first operand (if it is given)
+static bool writes_first(instruction::Operation op) {
+  switch (op) {
+  case instruction::_LABEL : case instruction::_UJUMP : case instruction::_FJUMP :
+  case instruction::_FJEQ : case instruction::_FJNE : case instruction::_FJLT :
+  case instruction::_FJLE : case instruction::_FJFEQ : case instruction::_FJFNE :
+  case instruction::_FJFLT : case instruction::_FJFLE :
+  case instruction::_PUSH : case instruction::_CALL : case instruction::_RETURN :
+  case instruction::_XLOAD : case instruction::_CLOAD : case instruction::_COPYN :
+  case instruction::_WRITEI : case instruction::_WRITEF : case instruction::_WRITEC :
+  case instruction::_WRITELN : case instruction::_WRITES : case instruction::_POPN :
+  case instruction::_NOOP : case instruction::_INVALID :
+    return false;
+  default :
+    return true;
+  }
+}
+
+/// largest (instructions x temporaries) for which temporaries are
+/// checked to be defined when building threaded code
+static const size_t MAX_DEFINED_ANALYSIS = 1 << 22;
+
+/// temporaries surely defined before each instruction ('must' forward
+/// analysis over the jumps of the subroutine). Reads of the other
+/// ones keep the check at run time
+static vector<vector<bool>> defined_temps(const vector<instruction> &code, size_t numTemps) {
+  size_t n = code.size();
+  vector<vector<bool>> in(n, vector<bool>(numTemps, true));
+  vector<bool> reached(n, false), queued(n, false);
+  if (n == 0) return in;
+  in[0].assign(numTemps, false);
+  reached[0] = queued[0] = true;
+  vector<size_t> work(1, 0);
+  map<string, size_t> labels;
+  for (size_t pc = 0; pc < n; ++pc)
+    if (code[pc].oper == instruction::_LABEL) labels[code[pc].arg1.str()] = pc;
+
+  while (not work.empty()) {
+    size_t pc = work.back();
+    work.pop_back();
+    queued[pc] = false;
+    const instruction &inst = code[pc];
+    vector<bool> out = in[pc];
+    if (writes_first(inst.oper) and inst.arg1.is_temp()) out[inst.arg1.temp_number()] = true;
+
+    size_t succ[2];
+    int numSucc = 0;
+    if (inst.is_jump()) {
+      auto l = labels.find(inst.jump_label().str());
+      if (l != labels.end()) succ[numSucc++] = l->second;
+    }
+    if (inst.oper != instruction::_UJUMP and inst.oper != instruction::_RETURN) succ[numSucc++] = pc + 1;
+
+    for (int k = 0; k < numSucc; ++k) {
+      size_t s = succ[k];
+      if (s >= n) continue;
+      bool changed = false;
+      if (not reached[s]) {
+        in[s] = out;
+        reached[s] = changed = true;
+      }
+      else {
+        for (size_t t = 0; t < numTemps; ++t)
+          if (in[s][t] and not out[t]) in[s][t] = false, changed = true;
+      }
+      if (changed and not queued[s]) {
+        queued[s] = true;
+        work.push_back(s);
+      }
+    }
+  }
+  return in;
+}
+
+/// build the threaded code of a decoded subroutine (after its jump
+/// and call targets are set)
+void machine::thread(decodedSubroutine &ds) {
+  size_t n = ds.code.size();
+  bool analysed = n * ds.numTemps <= MAX_DEFINED_ANALYSIS;
+  vector<vector<bool>> defined;
+  if (analysed) defined = defined_temps(ds.source, ds.numTemps);
+
+  // resolve an operand whose value is read at given pc
+  auto source = [&](const operand &op, size_t pc) {
+    slot s;
+    s.check = NO_CHECK;
+    if (op.is_temp()) {
+      s.base = TEMP_SLOT;
+      s.index = op.temp_number();
+      if (not analysed or not defined[pc][s.index]) s.check = CHECK_TEMP;
+      return s;
+    }
+    s.base = FRAME_SLOT;
+    auto it = ds.offsets.find(op.handle());
+    if (it != ds.offsets.end()) s.index = it->second;
+    else {
+      s.index = ds.names.size();
+      s.check = UNDEFINED_ID;
+      ds.names.push_back(op.str());
+    }
+    return s;
+  };
+  // resolve an operand that is written (temporaries need no check)
+  auto dest = [&](const operand &op, size_t pc) {
+    slot s = source(op, pc);
+    if (s.check == CHECK_TEMP) s.check = NO_CHECK;
+    return s;
+  };
+  // resolve a constant
+  auto constant = [&](uint32_t v) {
+    slot s;
+    s.base = CONST_SLOT;
+    s.check = NO_CHECK;
+    s.index = ds.constants.size();
+    ds.constants.push_back(v);
+    return s;
+  };
+  // whether a name operand is not declared
+  auto undeclared = [&](const operand &op) {
+    return not op.is_temp() and ds.offsets.find(op.handle()) == ds.offsets.end();
+  };
+
+  static const uint32_t SIMPLE[] = {
+    // _LABEL .. _RETURN are handled apart
+    T_INVALID, T_INVALID, T_INVALID, T_INVALID, T_INVALID, T_INVALID, T_INVALID,
+    T_ADD, T_SUB, T_MUL, T_DIV, T_EQ, T_LT, T_LE, T_NEG, T_NOT, T_AND, T_OR, T_FLOAT,
+    T_FADD, T_FSUB, T_FMUL, T_FDIV, T_FEQ, T_FLT, T_FLE, T_FNEG,
+    T_LOAD, T_LOAD, T_LOAD, T_LOAD, T_INVALID, T_INVALID, T_ALOAD, T_LOADC, T_CLOAD,
+    T_READI, T_READF, T_READC, T_WRITEI, T_WRITEF, T_WRITEC, T_WRITELN, T_NOOP,
+    T_FJEQ, T_FJNE, T_FJLT, T_FJLE, T_FJFEQ, T_FJFNE, T_FJFLT, T_FJFLE,
+    // the immediate forms run as the others, with a constant operand
+    T_ADD, T_SUB, T_MUL, T_DIV, T_EQ, T_LT, T_LE, T_LT, T_LE,
+    T_FADD, T_FSUB, T_FMUL, T_FDIV, T_FEQ, T_FLT, T_FLE, T_FLT, T_FLE,
+    T_COPYN, T_WRITES, T_POPN, T_INVALID};
+
+  ds.threaded.clear();
+  ds.threadedIndex.assign(n + 1, 0);
+  vector<uint32_t> jumpTarget;   // target pc of each threaded jump
+  for (size_t pc = 0; pc < n; ++pc) {
+    const decodedInstruction &di = ds.code[pc];
+    ds.threadedIndex[pc] = ds.threaded.size();
+    threadedInstruction ti;
+    ti.handler = nullptr;
+    ti.op = SIMPLE[di.oper];
+    ti.a1 = ti.a2 = ti.a3 = constant(0);
+    ti.target = nullptr;
+    ti.callee = 0;
+    ti.pc = pc;
+
+    switch (di.oper) {
+    case instruction::_LABEL :
+    case instruction::_NOOP :
+      continue;
+    case instruction::_UJUMP :
+      ti.op = T_UJUMP;
+      break;
+    case instruction::_FJUMP :
+      ti.op = T_FJUMP;
+      ti.a1 = source(di.arg1, pc);
+      break;
+    case instruction::_FJEQ : case instruction::_FJNE : case instruction::_FJLT :
+    case instruction::_FJLE : case instruction::_FJFEQ : case instruction::_FJFNE :
+    case instruction::_FJFLT : case instruction::_FJFLE :
+      // a3 is the label
+      ti.a1 = source(di.arg1, pc);
+      ti.a2 = source(di.arg2, pc);
+      break;
+    case instruction::_PUSH :
+      ti.op = T_PUSH;
+      if (not di.arg1.empty()) ti.a1 = source(di.arg1, pc);
+      break;
+    case instruction::_POP :
+      ti.op = di.arg1.empty() ? T_DROP : T_POP;
+      if (not di.arg1.empty()) ti.a1 = dest(di.arg1, pc);
+      break;
+    case instruction::_POPN :
+      ti.a1 = constant(di.imm);
+      break;
+    case instruction::_CALL :
+      // a1 is the number of cells popped on return
+      ti.op = T_CALL;
+      ti.a1 = constant(di.imm);
+      ti.callee = di.target;
+      break;
+    case instruction::_RETURN :
+      ti.op = T_RETURN;
+      break;
+    case instruction::_ILOAD :
+    case instruction::_FLOAD :
+    case instruction::_CHLOAD :
+      ti.a1 = dest(di.arg1, pc);
+      ti.a2 = constant(di.imm);
+      break;
+    case instruction::_XLOAD :
+      // a1[a2] = a3: a1 is an array var, or a temporary holding its address
+      ti.op = di.arg1.is_temp() ? T_XLOAD_PTR : T_XLOAD_VAR;
+      ti.a1 = source(di.arg1, pc);
+      ti.a2 = source(di.arg2, pc);
+      ti.a3 = source(di.arg3, pc);
+      break;
+    case instruction::_LOADX :
+      // a1 = a2[a3]
+      ti.op = di.arg2.is_temp() ? T_LOADX_PTR : T_LOADX_VAR;
+      ti.a1 = dest(di.arg1, pc);
+      ti.a2 = source(di.arg2, pc);
+      ti.a3 = source(di.arg3, pc);
+      break;
+    case instruction::_ALOAD :
+      ti.a1 = dest(di.arg1, pc);
+      ti.a2 = source(di.arg2, pc);
+      break;
+    case instruction::_WRITES :
+      ti.a1 = constant(di.imm);
+      break;
+    case instruction::_COPYN :
+      // copyn a1 a2 k, with the count as a constant
+      ti.a1 = source(di.arg1, pc);
+      ti.a2 = source(di.arg2, pc);
+      ti.a3 = constant(di.imm);
+      break;
+    case instruction::_GTI : case instruction::_GEI :
+    case instruction::_FGTI : case instruction::_FGEI :
+      // a > k as k < a
+      ti.a1 = dest(di.arg1, pc);
+      ti.a2 = constant(di.imm);
+      ti.a3 = source(di.arg2, pc);
+      break;
+    default :
+      if (ds.source[pc].is_immediate()) {
+        ti.a1 = dest(di.arg1, pc);
+        ti.a2 = source(di.arg2, pc);
+        ti.a3 = constant(di.imm);
+        break;
+      }
+      if (writes_first(di.oper)) ti.a1 = dest(di.arg1, pc);
+      else if (not di.arg1.empty()) ti.a1 = source(di.arg1, pc);
+      if (not di.arg2.empty()) ti.a2 = source(di.arg2, pc);
+      if (not di.arg3.empty()) ti.a3 = source(di.arg3, pc);
+      break;
+    }
+    // names used as addresses must be declared: fail as tvm does
+    if (ti.op == T_XLOAD_VAR and undeclared(di.arg1)) {
+      ti.op = T_UNDEFINED;
+      ti.a1 = source(di.arg1, pc);
+    }
+    else if ((ti.op == T_LOADX_VAR or ti.op == T_ALOAD) and undeclared(di.arg2)) {
+      ti.op = T_UNDEFINED;
+      ti.a1 = source(di.arg2, pc);
+    }
+    else if (ti.op == T_COPYN and (undeclared(di.arg1) or undeclared(di.arg2))) {
+      ti.op = T_UNDEFINED;
+      ti.a1 = source(undeclared(di.arg1) ? di.arg1 : di.arg2, pc);
+    }
+    jumpTarget.push_back(di.target);
+    ds.threaded.push_back(ti);
+  }
+  ds.threadedIndex[n] = ds.threaded.size();
+
+  // final instruction, reached when a subroutine lacks its 'return'
+  threadedInstruction end;
+  end.handler = nullptr;
+  end.op = T_END;
+  end.a1 = end.a2 = end.a3 = constant(0);
+  end.target = nullptr;
+  end.callee = 0;
+  end.pc = n;
+  ds.threaded.push_back(end);
+
+  // jumps point to threaded instructions (the vector is final now)
+  for (size_t i = 0; i + 1 < ds.threaded.size(); ++i) {
+    threadedInstruction &ti = ds.threaded[i];
+    if (ti.op >= T_UJUMP and ti.op <= T_FJFLE) ti.target = &ds.threaded[ds.threadedIndex[jumpTarget[i]]];
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////
+/// Running threaded code
+
+/// run threaded code from given pc of the current frame. With the
+/// JIT engine, it also stops (setting 'hot') when native code can be
+/// entered: on calls to hot subroutines, on back-edges of a hot loop,
+/// and when returning to a subroutine with native code
+std::size_t machine::run_threaded(std::size_t pc) {
+#ifdef MACHINE_COMPUTED_GOTO
+  static const void *const handlers[] = {
+    &&L_T_NOOP, &&L_T_UJUMP, &&L_T_FJUMP,
+    &&L_T_FJEQ, &&L_T_FJNE, &&L_T_FJLT, &&L_T_FJLE, &&L_T_FJFEQ, &&L_T_FJFNE, &&L_T_FJFLT, &&L_T_FJFLE,
+    &&L_T_PUSH, &&L_T_POP, &&L_T_DROP, &&L_T_POPN, &&L_T_CALL, &&L_T_RETURN,
+    &&L_T_ADD, &&L_T_SUB, &&L_T_MUL, &&L_T_DIV, &&L_T_EQ, &&L_T_LT, &&L_T_LE, &&L_T_NEG, &&L_T_NOT,
+    &&L_T_AND, &&L_T_OR, &&L_T_FLOAT,
+    &&L_T_FADD, &&L_T_FSUB, &&L_T_FMUL, &&L_T_FDIV, &&L_T_FEQ, &&L_T_FLT, &&L_T_FLE, &&L_T_FNEG,
+    &&L_T_LOAD, &&L_T_XLOAD_VAR, &&L_T_XLOAD_PTR, &&L_T_LOADX_VAR, &&L_T_LOADX_PTR, &&L_T_ALOAD,
+    &&L_T_LOADC, &&L_T_CLOAD, &&L_T_COPYN,
+    &&L_T_READI, &&L_T_READF, &&L_T_READC, &&L_T_WRITEI, &&L_T_WRITEF, &&L_T_WRITEC, &&L_T_WRITELN,
+    &&L_T_WRITES,
+    &&L_T_UNDEFINED, &&L_T_END, &&L_T_INVALID};
+  static_assert(sizeof(handlers)/sizeof(handlers[0]) == T_INVALID + 1, "a handler is missing");
+  if (not threadedLinked) {
+    for (auto &ds : subs)
+      for (auto &ti : ds.threaded) ti.handler = handlers[ti.op];
+    threadedLinked = true;
+  }
+#define DISPATCH() goto *ip->handler
+#define HANDLER(op) L_##op
+#else
+#define DISPATCH() goto dispatch
+#define HANDLER(op) case op
+#endif
+
+  // state of the current frame, reloaded on calls and returns
+  const decodedSubroutine *sub;
+  int64_t base;
+  uint32_t *regs[3];
+  uint8_t *defined;
+  const threadedInstruction *ip;
+  const bool tiered = engine == JIT;
+  hot = false;
+#define LOAD_FRAME() do {                                          \
+    const frame &f = frames.back();                                \
+    sub = f.sub;                                                   \
+    base = f.base;                                                 \
+    regs[FRAME_SLOT] = mem.data() + base;                          \
+    regs[TEMP_SLOT] = temps.data() + f.tempBase;                   \
+    regs[CONST_SLOT] = const_cast<uint32_t *>(sub->constants.data()); \
+    defined = tempDefined.data() + f.tempBase;                     \
+  } while (0)
+
+  // access to slots, with the few checks that are left
+  auto checked = [&](const slot &s) -> uint32_t {
+    if (s.check == UNDEFINED_ID) throw crash("Undefined ID " + sub->names[s.index]);
+    if (not defined[s.index]) throw crash("Undefined TEMP %" + to_string(s.index));
+    return regs[TEMP_SLOT][s.index];
+  };
+#define R(s) ((s).check ? checked(s) : regs[(s).base][(s).index])
+#define W(s, v) do {                                                 \
+    uint32_t v_ = (v);                                               \
+    if ((s).check) checked(s);                                       \
+    regs[(s).base][(s).index] = v_;                                  \
+    if ((s).base == TEMP_SLOT) defined[(s).index] = 1;               \
+  } while (0)
+#define CELL(addr) (*((addr) >= 0 and (addr) < int64_t(MEMORY_SIZE) ? &mem[addr] \
+                      : (throw crash("Invalid memory reference."), &mem[0])))
+#define NEXT() do { ++ip; DISPATCH(); } while (0)
+
+  LOAD_FRAME();
+  ip = &sub->threaded[sub->threadedIndex[pc]];
+  DISPATCH();
+
+#ifndef MACHINE_COMPUTED_GOTO
+ dispatch:
+  switch (ip->op) {
+#else
+  {
+#endif
+  HANDLER(T_NOOP): NEXT();
+#define BACK_EDGE() do {                                             \
+    if (tiered and ip->target <= ip and tier_up(sub - subs.data())) { \
+      hot = true;                                                    \
+      return ip->target->pc;                                         \
+    }                                                                \
+  } while (0)
+  HANDLER(T_UJUMP): BACK_EDGE(); ip = ip->target; DISPATCH();
+  HANDLER(T_FJUMP):
+    if (R(ip->a1)) ++ip;
+    else {
+      BACK_EDGE();
+      ip = ip->target;
+    }
+    DISPATCH();
+  // compare and jump when the comparison is false
+#define JUMP_UNLESS(cond) do {                                      \
+    if (cond) ++ip;                                                  \
+    else {                                                           \
+      BACK_EDGE();                                                   \
+      ip = ip->target;                                               \
+    }                                                                \
+    DISPATCH();                                                      \
+  } while (0)
+  HANDLER(T_FJEQ): { uint32_t a = R(ip->a1), b = R(ip->a2); JUMP_UNLESS(a == b); }
+  HANDLER(T_FJNE): { uint32_t a = R(ip->a1), b = R(ip->a2); JUMP_UNLESS(a != b); }
+  HANDLER(T_FJLT): { int32_t a = R(ip->a1), b = R(ip->a2); JUMP_UNLESS(a < b); }
+  HANDLER(T_FJLE): { int32_t a = R(ip->a1), b = R(ip->a2); JUMP_UNLESS(a <= b); }
+  HANDLER(T_FJFEQ): { float a = bits_float(R(ip->a1)), b = bits_float(R(ip->a2)); JUMP_UNLESS(a == b); }
+  HANDLER(T_FJFNE): { float a = bits_float(R(ip->a1)), b = bits_float(R(ip->a2)); JUMP_UNLESS(a != b); }
+  HANDLER(T_FJFLT): { float a = bits_float(R(ip->a1)), b = bits_float(R(ip->a2)); JUMP_UNLESS(a < b); }
+  HANDLER(T_FJFLE): { float a = bits_float(R(ip->a1)), b = bits_float(R(ip->a2)); JUMP_UNLESS(a <= b); }
+  HANDLER(T_PUSH): {
+    uint32_t v = R(ip->a1);
+    if (sp >= MEMORY_SIZE) throw crash("Stack overflow.");
+    mem[sp++] = v;
+    NEXT();
+  }
+  HANDLER(T_POP): {
+    if (sp == 0) throw crash("Stack underflow.");
+    W(ip->a1, mem[--sp]);
+    NEXT();
+  }
+  HANDLER(T_DROP): {
+    if (sp == 0) throw crash("Stack underflow.");
+    --sp;
+    NEXT();
+  }
+  HANDLER(T_POPN): {
+    uint32_t k = R(ip->a1);
+    if (k > sp) throw crash("Stack underflow.");
+    sp -= k;
+    NEXT();
+  }
+  HANDLER(T_CALL): {
+    // missing params: the frame would start below the stack, so let
+    // the switch loop (which checks every access) go on from here
+    if (sp < subs[ip->callee].params.size()) return ip->pc;
+    push_frame(ip->callee, ip->pc + 1, R(ip->a1));
+    LOAD_FRAME();
+    if (tiered and tier_up(ip->callee)) {
+      hot = true;
+      return 0;
+    }
+    ip = sub->threaded.data();
+    DISPATCH();
+  }
+  HANDLER(T_RETURN): {
+    size_t returnPc = pop_frame();
+    if (frames.empty()) return 0;
+    LOAD_FRAME();
+    if (tiered and native[sub - subs.data()].code) {
+      hot = true;
+      return returnPc;
+    }
+    ip = &sub->threaded[sub->threadedIndex[returnPc]];
+    DISPATCH();
+  }
+
+  HANDLER(T_ADD): W(ip->a1, R(ip->a2) + R(ip->a3)); NEXT();
+  HANDLER(T_SUB): W(ip->a1, R(ip->a2) - R(ip->a3)); NEXT();
+  HANDLER(T_MUL): W(ip->a1, R(ip->a2) * R(ip->a3)); NEXT();
+  HANDLER(T_DIV): {
+    int32_t a = R(ip->a2), b = R(ip->a3);
+    if (b == 0 or (b == -1 and a == INT32_MIN)) throw crash("Division by zero.");
+    W(ip->a1, a / b);
+    NEXT();
+  }
+  HANDLER(T_EQ): W(ip->a1, R(ip->a2) == R(ip->a3)); NEXT();
+  HANDLER(T_LT): W(ip->a1, int32_t(R(ip->a2)) < int32_t(R(ip->a3))); NEXT();
+  HANDLER(T_LE): W(ip->a1, int32_t(R(ip->a2)) <= int32_t(R(ip->a3))); NEXT();
+  HANDLER(T_NEG): W(ip->a1, -R(ip->a2)); NEXT();
+  HANDLER(T_NOT): W(ip->a1, not R(ip->a2)); NEXT();
+  HANDLER(T_AND): {
+    uint32_t a = R(ip->a2), b = R(ip->a3);
+    W(ip->a1, a and b);
+    NEXT();
+  }
+  HANDLER(T_OR): {
+    uint32_t a = R(ip->a2), b = R(ip->a3);
+    W(ip->a1, a or b);
+    NEXT();
+  }
+  HANDLER(T_FLOAT): W(ip->a1, float_bits(float(int32_t(R(ip->a2))))); NEXT();
+
+  HANDLER(T_FADD): W(ip->a1, float_bits(bits_float(R(ip->a2)) + bits_float(R(ip->a3)))); NEXT();
+  HANDLER(T_FSUB): W(ip->a1, float_bits(bits_float(R(ip->a2)) - bits_float(R(ip->a3)))); NEXT();
+  HANDLER(T_FMUL): W(ip->a1, float_bits(bits_float(R(ip->a2)) * bits_float(R(ip->a3)))); NEXT();
+  HANDLER(T_FDIV): W(ip->a1, float_bits(bits_float(R(ip->a2)) / bits_float(R(ip->a3)))); NEXT();
+  HANDLER(T_FEQ): W(ip->a1, bits_float(R(ip->a2)) == bits_float(R(ip->a3))); NEXT();
+  HANDLER(T_FLT): W(ip->a1, bits_float(R(ip->a2)) < bits_float(R(ip->a3))); NEXT();
+  HANDLER(T_FLE): W(ip->a1, bits_float(R(ip->a2)) <= bits_float(R(ip->a3))); NEXT();
+  HANDLER(T_FNEG): W(ip->a1, float_bits(-bits_float(R(ip->a2)))); NEXT();
+
+  HANDLER(T_LOAD): W(ip->a1, R(ip->a2)); NEXT();
+  HANDLER(T_XLOAD_VAR): {
+    int64_t addr = base + ip->a1.index + int32_t(R(ip->a2));
+    uint32_t v = R(ip->a3);
+    CELL(addr) = v;
+    NEXT();
+  }
+  HANDLER(T_XLOAD_PTR): {
+    int64_t addr = int64_t(int32_t(R(ip->a1))) + int32_t(R(ip->a2));
+    uint32_t v = R(ip->a3);
+    CELL(addr) = v;
+    NEXT();
+  }
+  HANDLER(T_LOADX_VAR): {
+    int64_t addr = base + ip->a2.index + int32_t(R(ip->a3));
+    W(ip->a1, CELL(addr));
+    NEXT();
+  }
+  HANDLER(T_LOADX_PTR): {
+    int64_t addr = int64_t(int32_t(R(ip->a2))) + int32_t(R(ip->a3));
+    W(ip->a1, CELL(addr));
+    NEXT();
+  }
+  HANDLER(T_ALOAD): W(ip->a1, uint32_t(base + ip->a2.index)); NEXT();
+  HANDLER(T_LOADC): {
+    int64_t addr = int32_t(R(ip->a2));
+    W(ip->a1, CELL(addr));
+    NEXT();
+  }
+  HANDLER(T_CLOAD): {
+    int64_t addr = int32_t(R(ip->a1));
+    uint32_t v = R(ip->a2);
+    CELL(addr) = v;
+    NEXT();
+  }
+  HANDLER(T_COPYN): {
+    // an array var is a frame slot, a temporary holds an address
+    int64_t dst = ip->a1.base == FRAME_SLOT ? base + ip->a1.index : int64_t(int32_t(R(ip->a1)));
+    int64_t src = ip->a2.base == FRAME_SLOT ? base + ip->a2.index : int64_t(int32_t(R(ip->a2)));
+    copy_cells(dst, src, R(ip->a3));
+    NEXT();
+  }
+
+  HANDLER(T_READI): { int v = 0; cin >> v; W(ip->a1, v); NEXT(); }
+  HANDLER(T_READF): { float v = 0; cin >> v; W(ip->a1, float_bits(v)); NEXT(); }
+  HANDLER(T_READC): { char v = 0; cin >> v; W(ip->a1, (unsigned char)v); NEXT(); }
+  HANDLER(T_WRITEI): cout << int32_t(R(ip->a1)); NEXT();
+  HANDLER(T_WRITEF): cout << bits_float(R(ip->a1)); NEXT();
+  HANDLER(T_WRITEC): cout << char(R(ip->a1)); NEXT();
+  HANDLER(T_WRITELN): cout << '\n'; NEXT();
+  HANDLER(T_WRITES): cout << strings[R(ip->a1)]; NEXT();
+
+  HANDLER(T_UNDEFINED): checked(ip->a1); NEXT();
+  HANDLER(T_END):
+    throw crash("Control reaches end of subroutine " + sub->name + ". Missing 'return' ?");
+  HANDLER(T_INVALID):
+    throw crash("Invalid instruction at PC=" + to_string(ip->pc) + " in " + sub->name);
+  }
+  return 0;
+
+#undef DISPATCH
+#undef HANDLER
+#undef LOAD_FRAME
+#undef R
+#undef W
+#undef CELL
+#undef NEXT
+#undef BACK_EDGE
+#undef JUMP_UNLESS
+}